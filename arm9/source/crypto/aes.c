@@ -269,6 +269,29 @@ void ctr_decrypt(void *inbuf, void *outbuf, size_t size, uint32_t mode, uint8_t
     }
 }
 
+void ctr_keystream(void *outbuf, size_t size, uint32_t mode, uint8_t *ctr)
+{
+    size_t blocks_left = size;
+    size_t blocks;
+    uint8_t *out = outbuf;
+
+    while (blocks_left)
+    {
+        blocks = (blocks_left >= 0xFFFF) ? 0xFFFF : blocks_left;
+        set_ctr(ctr);
+        *REG_AESCNT = 0;
+        *REG_AESBLKCNT = blocks << 16;
+        *REG_AESCNT = mode |
+                      AES_CNT_START |
+                      AES_CNT_FLUSH_READ |
+                      AES_CNT_FLUSH_WRITE;
+        aes_fifos_keystream(out, blocks);
+        add_ctr(ctr, blocks);
+        out += blocks * AES_BLOCK_SIZE;
+        blocks_left -= blocks;
+    }
+}
+
 void aes_decrypt(void* inbuf, void* outbuf, size_t size, uint32_t mode)
 {
     uint8_t *in  = inbuf;
@@ -374,6 +397,41 @@ void aes_fifos(void* inbuf, void* outbuf, size_t blocks)
     }
 }
 
+void aes_fifos_keystream(void* outbuf, size_t blocks)
+{
+    // same as aes_fifos(), but feeds zeroes, so no input buffer is needed
+    if (!outbuf) return;
+
+    uint8_t *out = outbuf;
+
+    size_t curblock = 0;
+    while (curblock != blocks)
+    {
+        while (aescnt_checkwrite());
+
+        size_t blocks_to_read = blocks - curblock > 4 ? 4 : blocks - curblock;
+
+        for (size_t i = 0; i < blocks_to_read * (AES_BLOCK_SIZE / 4); i++)
+            set_aeswrfifo(0);
+
+        for (size_t rblocks = 0; rblocks < blocks_to_read; ++rblocks)
+        {
+            while (aescnt_checkread()) ;
+            for (uint8_t *ii = out + AES_BLOCK_SIZE * rblocks; ii != out + (AES_BLOCK_SIZE * (rblocks + 1)); ii += 4)
+            {
+                uint32_t data = read_aesrdfifo();
+                ii[0] = data;
+                ii[1] = data >> 8;
+                ii[2] = data >> 16;
+                ii[3] = data >> 24;
+            }
+        }
+
+        out += blocks_to_read * AES_BLOCK_SIZE;
+        curblock += blocks_to_read;
+    }
+}
+
 void set_aeswrfifo(uint32_t value)
 {
     *REG_AESWRFIFO = value;
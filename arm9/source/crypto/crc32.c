@@ -4,7 +4,6 @@
 
 #include "common.h"
 #include "crc32.h"
-#include "vff.h"
 
 u32 crc32_adjust(u32 crc32, u8 input) {
     static const u32 crc32_table[256] = {
@@ -55,36 +54,42 @@ u32 crc32_adjust(u32 crc32, u8 input) {
     return ((crc32 >> 8) & 0x00ffffff) ^ crc32_table[(crc32 ^ input) & 0xff];
 }
 
-u32 crc32_calculate(u32 crc32, const u8* data, u32 length) {
-    for(unsigned i = 0; i < length; i++) {
-        crc32 = crc32_adjust(crc32, data[i]);
+// slicing-by-8 tables, table 0 is the regular byte table, generated on first use
+static u32 crc32_tables[8][256];
+static bool crc32_tables_ready = false;
+
+static void crc32_init_tables(void) {
+    for (u32 i = 0; i < 256; i++)
+        crc32_tables[0][i] = crc32_adjust(0, (u8) i);
+    for (u32 i = 0; i < 256; i++) {
+        u32 crc = crc32_tables[0][i];
+        for (u32 t = 1; t < 8; t++) {
+            crc = (crc >> 8) ^ crc32_tables[0][crc & 0xff];
+            crc32_tables[t][i] = crc;
+        }
     }
-    return crc32;
+    crc32_tables_ready = true;
 }
 
-u32 crc32_calculate_from_file(const char* fileName, u32 offset, u32 length) {
-    FIL inputFile;
-    u32 crc32 = ~0;
-    u32 bufsiz = min(STD_BUFFER_SIZE, length);
-    u8* buffer = (u8*) malloc(bufsiz);
-    if (!buffer) return false;
-    if (fvx_open(&inputFile, fileName, FA_READ) != FR_OK) {
-        free(buffer);
-        return crc32;
-    }
-    fvx_lseek(&inputFile, offset);
+u32 crc32_calculate(u32 crc32, const u8* data, u32 length) {
+    const u32 (*t)[256] = (const u32 (*)[256]) crc32_tables;
+    if (!crc32_tables_ready) crc32_init_tables();
+
+    // bytewise until data is word aligned
+    for (; length && ((u32) data & 0x3); length--)
+        crc32 = (crc32 >> 8) ^ t[0][(crc32 ^ *(data++)) & 0xff];
 
-    bool ret = true;
-    for (u64 pos = 0; (pos < length) && ret; pos += bufsiz) {
-        UINT read_bytes = min(bufsiz, length - pos);
-        UINT bytes_read = read_bytes;
-        if ((fvx_read(&inputFile, buffer, read_bytes, &bytes_read) != FR_OK) ||
-            (read_bytes != bytes_read))
-            ret = false;
-        if (ret) crc32 = crc32_calculate(crc32, buffer, read_bytes);
+    // eight bytes at a time (little endian only)
+    for (; length >= 8; length -= 8, data += 8) {
+        u32 lo = *(const u32*) (const void*) data ^ crc32;
+        u32 hi = *(const u32*) (const void*) (data + 4);
+        crc32 = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^ t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+                t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^ t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
     }
 
-    fvx_close(&inputFile);
-    free(buffer);
-    return ~crc32;
+    // remaining bytes
+    for (; length; length--)
+        crc32 = (crc32 >> 8) ^ t[0][(crc32 ^ *(data++)) & 0xff];
+
+    return crc32;
 }
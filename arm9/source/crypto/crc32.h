@@ -8,4 +8,3 @@
 
 u32 crc32_adjust(u32 crc32, u8 input);
 u32 crc32_calculate(u32 crc32, const u8* data, u32 length);
-u32 crc32_calculate_from_file(const char* fileName, u32 offset, u32 length);
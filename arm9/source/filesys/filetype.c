@@ -1,11 +1,13 @@
 #include "filetype.h"
 #include "fsutil.h"
 #include "image.h"
+#include "sparse.h"
 #include "fatmbr.h"
 #include "nand.h"
 #include "game.h"
 #include "disadiff.h"
 #include "keydb.h"
+#include "nandutil.h"
 #include "ctrtransfer.h"
 #include "scripting.h"
 #include "gm9lua.h"
@@ -41,6 +43,10 @@ u64 IdentifyFileType(const char* path) {
     if (FileGetData(path, header, 0x2C0, 0) < min(0x2C0, fsize)) return 0;
     if (!fsize) return 0;
 
+    // sparse image container, no base type here (see IdentifySparseImageType())
+    if ((fsize >= sizeof(SparseImageHeader)) && (ValidateSparseImageHeader((SparseImageHeader*) data, fsize) == 0))
+        return FLAG_SPARSE;
+
     if (fsize >= 0x200) {
         if (ValidateNandNcsdHeader((NandNcsdHeader*) data) == 0) {
             return (fsize >= GetNandNcsdMinSizeSectors((NandNcsdHeader*) data) * 0x200) ?
@@ -105,6 +111,8 @@ u64 IdentifyFileType(const char* path) {
             return SYS_DIFF;
         } else if (memcmp(header + 0x100, disa_magic, sizeof(disa_magic)) == 0) { // DISA file
             return SYS_DISA;
+        } else if (ValidateNandDiffHeader(header, fsize) == 0) {
+            return BIN_NDIFF; // differential NAND backup
         } else if (memcmp(header, smdh_magic, sizeof(smdh_magic)) == 0) {
             return GAME_SMDH; // SMDH file
         } else if (ValidateTwlHeader((TwlHeader*) data) == 0) {
@@ -192,3 +200,27 @@ u64 IdentifyFileType(const char* path) {
 
     return 0;
 }
+
+// type of the image inside a sparse container, only what can be mounted is of interest
+u64 IdentifySparseImageType(const char* path) {
+    u8 ALIGN(32) header[0x200];
+    SparseImageHeader hdr;
+    void* data = (void*) header;
+
+    if (!(IdentifyFileType(path) & FLAG_SPARSE) ||
+        (FileGetData(path, &hdr, sizeof(SparseImageHeader), 0) != sizeof(SparseImageHeader)) ||
+        (hdr.image_size < 0x200) || (ReadSparseImageFile(path, header, 0, 0x200) != 0))
+        return 0;
+
+    if (ValidateNandNcsdHeader((NandNcsdHeader*) data) == 0) {
+        if (hdr.image_size >= GetNandNcsdMinSizeSectors((NandNcsdHeader*) data) * 0x200)
+            return IMG_NAND | FLAG_SPARSE;
+    } else if (ValidateNcsdHeader((NcsdHeader*) data) == 0) {
+        if (hdr.image_size >= GetNcsdTrimmedSize((NcsdHeader*) data))
+            return GAME_NCSD | FLAG_SPARSE;
+    } else if ((ValidateFatHeader(header) == 0) || (ValidateMbrHeader((MbrHeader*) data) == 0)) {
+        return IMG_FAT | FLAG_SPARSE;
+    }
+
+    return 0;
+}
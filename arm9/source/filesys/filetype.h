@@ -41,8 +41,10 @@
 #define HDR_NAND    (1ULL<<36)
 #define TRANSLATION (1ULL<<37)
 #define TXT_LUA     (1ULL<<38)
+#define BIN_NDIFF   (1ULL<<39)
 #define TYPE_BASE   0xFFFFFFFFFFULL // 40 bit reserved for base types
 
+#define FLAG_SPARSE (1ULL<<57)
 // #define FLAG_FIRM   (1ULL<<58) // <--- for CXIs containing FIRMs
 // #define FLAG_GBAVC  (1ULL<<59) // <--- for GBAVC CXIs
 #define FLAG_DSIW   (1ULL<<60)
@@ -74,6 +76,10 @@
 #define FTYPE_ISDISADIFF(tp)    (tp&(SYS_DIFF|SYS_DISA))
 #define FTYPE_RESTORABLE(tp)    (tp&(IMG_NAND))
 #define FTYPE_EBACKUP(tp)       (tp&(IMG_NAND))
+#define FTYPE_NANDDIFF(tp)      (tp&(IMG_NAND))
+#define FTYPE_NANDREBUILD(tp)   (tp&(BIN_NDIFF))
+#define FTYPE_SPARSABLE(tp)     (tp&(IMG_NAND|IMG_FAT|GAME_NCSD))
+#define FTYPE_UNSPARSABLE(tp)   (tp&(FLAG_SPARSE))
 // #define FTYPE_XORPAD(tp)        (tp&(BIN_NCCHNFO)) // deprecated
 #define FTYPE_XORPAD(tp)        0
 #define FTYPE_KEYINIT(tp)       (tp&(BIN_KEYDB))
@@ -89,3 +95,4 @@
 #define FTYPE_AGBSAVE(tp)       (tp&(SYS_AGBSAVE))
 
 u64 IdentifyFileType(const char* path);
+u64 IdentifySparseImageType(const char* path);
@@ -3,6 +3,7 @@
 #include "virtual.h"
 #include "sddata.h"
 #include "image.h"
+#include "disadiff.h"
 #include "ff.h"
 
 // FATFS filesystem objects (x10)
@@ -66,6 +67,7 @@ bool InitImgFS(const char* path) {
 
 void DeinitExtFS() {
     InitImgFS(NULL);
+    FreeDisaDiffPool();
     SetupNandSdDrive(NULL, NULL, NULL, 0);
     SetupNandSdDrive(NULL, NULL, NULL, 1);
     for (u32 i = NORM_FS - 1; i > 0; i--) {
@@ -85,6 +87,7 @@ void DeinitSDCardFS() {
 void DismountDriveType(u32 type) { // careful with this - no safety checks
     if (type & DriveType(GetMountPath()))
         InitImgFS(NULL); // image is mounted from type -> unmount image drive, too
+    FreeDisaDiffPool(); // pooled DISA/DIFF contexts may refer to the dismounted drives
     if (type & DRV_SDCARD) {
         SetupNandSdDrive(NULL, NULL, NULL, 0);
         SetupNandSdDrive(NULL, NULL, NULL, 1);
@@ -38,6 +38,10 @@ bool CheckWritePermissions(const char* path) {
     // check mounted image write permissions
     if ((drvtype & DRV_IMAGE) && !CheckWritePermissions(GetMountPath()))
         return false; // endless loop when mounted file inside image, but not possible
+    if ((drvtype & DRV_IMAGE) && (GetMountState() & FLAG_SPARSE)) {
+        ShowPrompt(false, "%s", STR_SPARSE_IMAGES_ARE_MOUNTED_READ_ONLY);
+        return false;
+    }
 
     // SD card write protection check
     if ((drvtype & (DRV_SDCARD | DRV_EMUNAND | DRV_ALIAS)) && SD_WRITE_PROTECTED) {
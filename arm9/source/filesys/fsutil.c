@@ -5,8 +5,10 @@
 #include "sddata.h"
 #include "vff.h"
 #include "virtual.h"
+#include "vgame.h"
 #include "image.h"
 #include "sha.h"
+#include "crc32.h"
 #include "sdmmc.h"
 #include "ff.h"
 #include "ui.h"
@@ -162,7 +164,8 @@ size_t FileGetSize(const char* path) {
     return fno.fsize;
 }
 
-bool FileGetSha(const char* path, u8* hash, u64 offset, u64 size, bool sha1) {
+// streams (part of) a file through a hash update function, shared by all file hashing
+static bool FileHashData(const char* path, u64 offset, u64 size, void (*update)(const u8*, u32, void*), void* ctx) {
     bool ret = true;
     FIL file;
     u64 fsize;
@@ -171,27 +174,31 @@ bool FileGetSha(const char* path, u8* hash, u64 offset, u64 size, bool sha1) {
         return false;
 
     fsize = fvx_size(&file);
-    if (offset + size > fsize) return false;
+    if (offset + size > fsize) {
+        fvx_close(&file);
+        return false;
+    }
     if (!size) size = fsize - offset;
     fvx_lseek(&file, offset);
 
     u32 bufsiz = min(STD_BUFFER_SIZE, fsize);
     u8* buffer = (u8*) malloc(bufsiz);
-    if (!buffer) return false;
+    if (!buffer) {
+        fvx_close(&file);
+        return false;
+    }
 
     ShowProgress(0, 0, path);
-    sha_init(sha1 ? SHA1_MODE : SHA256_MODE);
     for (u64 pos = 0; (pos < size) && ret; pos += bufsiz) {
         UINT read_bytes = min(bufsiz, size - pos);
         UINT bytes_read = 0;
-        if (fvx_read(&file, buffer, read_bytes, &bytes_read) != FR_OK)
+        if ((fvx_read(&file, buffer, read_bytes, &bytes_read) != FR_OK) || (bytes_read != read_bytes))
             ret = false;
         if (!ShowProgress(pos + bytes_read, size, path))
             ret = false;
-        sha_update(buffer, bytes_read);
+        update(buffer, bytes_read, ctx);
     }
 
-    sha_get(hash);
     fvx_close(&file);
     free(buffer);
 
@@ -200,6 +207,37 @@ bool FileGetSha(const char* path, u8* hash, u64 offset, u64 size, bool sha1) {
     return ret;
 }
 
+static void FileShaUpdate(const u8* data, u32 size, void* ctx) {
+    (void) ctx;
+    sha_update(data, size);
+}
+
+static void FileCrc32Update(const u8* data, u32 size, void* ctx) {
+    u32* crc32 = (u32*) ctx;
+    *crc32 = crc32_calculate(*crc32, data, size);
+}
+
+bool FileGetSha(const char* path, u8* hash, u64 offset, u64 size, bool sha1) {
+    sha_init(sha1 ? SHA1_MODE : SHA256_MODE);
+    bool ret = FileHashData(path, offset, size, FileShaUpdate, NULL);
+    sha_get(hash);
+    return ret;
+}
+
+bool FileGetCrc32(const char* path, u8* crc, u64 offset, u64 size) {
+    u32 crc32 = ~0;
+    bool ret = FileHashData(path, offset, size, FileCrc32Update, &crc32);
+
+    // big endian, same as it is written in hex
+    crc32 = ~crc32;
+    crc[0] = (crc32 >> 24) & 0xFF;
+    crc[1] = (crc32 >> 16) & 0xFF;
+    crc[2] = (crc32 >>  8) & 0xFF;
+    crc[3] = (crc32 >>  0) & 0xFF;
+
+    return ret;
+}
+
 u32 FileFindData(const char* path, u8* data, u32 size_data, u32 offset_file) {
     FIL file; // used for FAT & virtual
     u64 found = (u64) -1;
@@ -593,6 +631,140 @@ bool PathMoveCopyRec(char* dest, char* orig, u32* flags, bool move, u8* buffer,
     return ret;
 }
 
+// map a RomFS entry to its destination, dpath stays empty if it is not inside the origin dir
+// returns an error string on failure, NULL otherwise
+static const char* GetLv3DestPath(char* dpath, const char* dest, u32 offset, bool dir, const char* prefix) {
+    u32 prefix_len = strnlen(prefix, 255);
+    char lv3path[256];
+    const char* rel = lv3path;
+
+    *dpath = '\0';
+    if (!GetVGameLv3Path(lv3path, 256, offset, dir)) return STR_ERROR_INVALID_ROMFS_ENTRY;
+    if (prefix_len) {
+        if ((strncmp(lv3path, prefix, prefix_len) != 0) || (lv3path[prefix_len] != '/')) return NULL;
+        rel = lv3path + prefix_len + 1;
+    }
+    if (!*rel) return NULL;
+    if (snprintf(dpath, 256, "%s/%s", dest, rel) >= 256) {
+        *dpath = '\0';
+        return STR_ERROR_DESTINATION_PATH_TOO_LONG;
+    }
+
+    return NULL;
+}
+
+// extract a RomFS dir from the game drive in one go,
+// file data is streamed in physical order through a single buffer
+static bool PathExtractLv3Dir(const char* dest, const char* orig, const VirtualDir* vdir, u32* flags, u8* buffer, u32 bufsiz) {
+    bool silent = (flags && (*flags & SILENT));
+    char deststr[UTF_BUFFER_BYTESIZE(36)];
+    const char* errstr = NULL;
+    char prefix[256];
+    char dpath[256];
+    TruncateString(deststr, dest, 36, 8);
+
+    // path of the origin dir inside the RomFS
+    if (!GetVGameLv3Path(prefix, 256, vdir->offset, true)) return false;
+
+    // get dirs and files (files are sorted by data offset)
+    u32 n_dirs = GetVGameLv3Entries(NULL, 0, true);
+    u32 n_files = GetVGameLv3Entries(NULL, 0, false);
+    u32* offsets = (u32*) malloc((n_dirs + n_files) * sizeof(u32));
+    if (!offsets) {
+        if (!silent) ShowPrompt(false, "%s", STR_OUT_OF_MEMORY);
+        return false;
+    }
+    if ((GetVGameLv3Entries(offsets, n_dirs, true) != n_dirs) ||
+        (GetVGameLv3Entries(offsets + n_dirs, n_files, false) != n_files)) {
+        if (!silent) ShowPrompt(false, "%s\n%s", deststr, STR_ERROR_INVALID_ROMFS_ENTRY);
+        free(offsets);
+        return false;
+    }
+
+    // create the destination dir tree
+    if (fvx_rmkdir(dest) != FR_OK) errstr = STR_ERROR_OVERWRITING_FILE_WITH_DIR;
+    for (u32 i = 0; (i < n_dirs) && !errstr; i++) {
+        errstr = GetLv3DestPath(dpath, dest, offsets[i], true, prefix);
+        if (!errstr && *dpath && (fvx_rmkdir(dpath) != FR_OK))
+            errstr = STR_ERROR_OVERWRITING_FILE_WITH_DIR;
+    }
+
+    // keep only files inside the origin dir, get total size
+    u32* files = offsets + n_dirs;
+    u32 n_sel = 0;
+    u64 total = 0;
+    u64 data_end = 0;
+    for (u32 i = 0; (i < n_files) && !errstr; i++) {
+        u64 offset, size;
+        errstr = GetLv3DestPath(dpath, dest, files[i], false, prefix);
+        if (errstr || !*dpath) continue;
+        if (!GetVGameLv3FileData(files[i], &offset, &size)) {
+            errstr = STR_ERROR_INVALID_ROMFS_ENTRY;
+            continue;
+        }
+        files[n_sel++] = files[i];
+        total += size;
+        data_end = max(data_end, offset + size);
+    }
+    if (errstr) {
+        if (!silent) ShowPrompt(false, "%s\n%s", deststr, errstr);
+        free(offsets);
+        return false;
+    }
+
+    // extract files, every part of the data region is read at most once
+    u64 buf_offset = 0;
+    u64 buf_size = 0;
+    u64 current = 0;
+    bool ret = true;
+    if (!ShowProgress(0, 0, orig) && !(flags && (*flags & NO_CANCEL)))
+        ret = !ShowPrompt(true, "%s\n%s", deststr, STR_B_DETECTED_CANCEL);
+    for (u32 i = 0; (i < n_sel) && ret; i++) {
+        u64 offset, size;
+        FIL dfile;
+        GetLv3DestPath(dpath, dest, files[i], false, prefix); // checked above
+        GetVGameLv3FileData(files[i], &offset, &size);
+        if (fvx_open(&dfile, dpath, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+            if (!silent) ShowPrompt(false, "%s\n%s", deststr, STR_ERROR_CANNOT_OPEN_DESTINATION_FILE);
+            ret = false;
+            break;
+        }
+
+        for (u64 pos = offset; (pos < offset + size) && ret;) {
+            if ((pos < buf_offset) || (pos >= buf_offset + buf_size)) { // refill buffer
+                buf_offset = pos;
+                buf_size = min(bufsiz, data_end - pos);
+                if (ReadVGameLv3Data(vdir, buffer, buf_offset, buf_size) != 0) {
+                    if (!silent) ShowPrompt(false, "%s\n%s", deststr, STR_ERROR_CANNOT_READ_ROMFS_DATA);
+                    buf_size = 0;
+                    ret = false;
+                    break;
+                }
+            }
+            UINT btw = min(buf_offset + buf_size, offset + size) - pos;
+            UINT bw = 0;
+            if ((fvx_write(&dfile, buffer + (pos - buf_offset), btw, &bw) != FR_OK) || (bw != btw))
+                ret = false;
+            pos += bw;
+            current += bw;
+            if (ret && !ShowProgress(current, total, orig)) {
+                if (flags && (*flags & NO_CANCEL)) {
+                    ShowPrompt(false, "%s\n%s", deststr, STR_CANCEL_IS_NOT_ALLOWED_HERE);
+                } else ret = !ShowPrompt(true, "%s\n%s", deststr, STR_B_DETECTED_CANCEL);
+                ShowProgress(0, 0, orig);
+                ShowProgress(current, total, orig);
+            }
+        }
+
+        fvx_close(&dfile);
+        if (!ret) fvx_unlink(dpath);
+    }
+    ShowProgress(1, 1, orig);
+
+    free(offsets);
+    return ret;
+}
+
 bool PathMoveCopy(const char* dest, const char* orig, u32* flags, bool move) {
     // check permissions
     if (!flags || !(*flags & OVERRIDE_PERM)) {
@@ -678,8 +850,13 @@ bool PathMoveCopy(const char* dest, const char* orig, u32* flags, bool move) {
         }
 
         // actual move / copy operation
+        // (RomFS dirs on the game drive are extracted in physical order)
+        VirtualDir ovdir;
         bool same_drv = (strncasecmp(lorig, ldest, 2) == 0);
-        bool res = PathMoveCopyRec(ldest, lorig, flags, move && same_drv, buffer, STD_BUFFER_SIZE);
+        bool res = (!move && (odrvtype & DRV_GAME) && (!flags || !(*flags & (CALC_SHA|APPEND_ALL))) &&
+            GetVirtualDir(&ovdir, lorig) && (ovdir.flags & VFLAG_LV3) && GetVGameLv3Entries(NULL, 0, false)) ?
+            PathExtractLv3Dir(ldest, lorig, &ovdir, flags, buffer, STD_BUFFER_SIZE) :
+            PathMoveCopyRec(ldest, lorig, flags, move && same_drv, buffer, STD_BUFFER_SIZE);
         if (move && res && (!flags || !(*flags&SKIP_CUR))) PathDelete(lorig);
 
         free(buffer);
@@ -46,6 +46,9 @@ size_t FileGetSize(const char* path);
 /** Get SHA-256 of file **/
 bool FileGetSha(const char* path, u8* hash, u64 offset, u64 size, bool sha1);
 
+/** Get CRC32 of file (big endian) **/
+bool FileGetCrc32(const char* path, u8* crc, u64 offset, u64 size);
+
 /** Find data in file **/
 u32 FileFindData(const char* path, u8* data, u32 size_data, u32 offset_file);
 
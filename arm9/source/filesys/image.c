@@ -1,8 +1,10 @@
 #include "image.h"
 #include "vff.h"
 #include "nandcmac.h"
+#include "sparse.h"
 
 static FIL mount_file;
+static SparseImage mount_sparse;
 static u64 mount_state = 0;
 
 static char mount_path[256] = { 0 };
@@ -15,6 +17,8 @@ int ReadImageBytes(void* buffer, u64 offset, u64 count) {
     UINT ret;
     if (!count) return -1;
     if (!mount_state) return FR_INVALID_OBJECT;
+    if (mount_state & FLAG_SPARSE)
+        return ReadSparseImageBytes(&mount_sparse, buffer, offset, count);
     if (fvx_tell(&mount_file) != offset) {
         if (fvx_size(&mount_file) < offset) return -1;
         fvx_lseek(&mount_file, offset);
@@ -28,6 +32,7 @@ int WriteImageBytes(const void* buffer, u64 offset, u64 count) {
     UINT ret;
     if (!count) return -1;
     if (!mount_state) return FR_INVALID_OBJECT;
+    if (mount_state & FLAG_SPARSE) return FR_WRITE_PROTECTED; // sparse images are read-only
     if (fvx_tell(&mount_file) != offset)
         fvx_lseek(&mount_file, offset);
     ret = fvx_write(&mount_file, buffer, count, &bytes_written);
@@ -48,6 +53,7 @@ int SyncImage(void) {
 }
 
 u64 GetMountSize(void) {
+    if (mount_state & FLAG_SPARSE) return mount_sparse.header.image_size;
     return mount_state ? fvx_size(&mount_file) : 0;
 }
 
@@ -61,6 +67,7 @@ const char* GetMountPath(void) {
 
 u64 MountImage(const char* path) {
     if (mount_state) {
+        if (mount_state & FLAG_SPARSE) CloseSparseImage(&mount_sparse);
         fvx_close(&mount_file);
         if (fix_cmac) FixFileCmac(mount_path, false);
         fix_cmac = false;
@@ -68,10 +75,17 @@ u64 MountImage(const char* path) {
         *mount_path = 0;
     }
     u64 type = (path) ? IdentifyFileType(path) : 0;
+    if (type & FLAG_SPARSE) type = IdentifySparseImageType(path);
     if (!type) return 0;
-    if ((fvx_open(&mount_file, path, FA_READ | FA_WRITE | FA_OPEN_EXISTING) != FR_OK) &&
-        (fvx_open(&mount_file, path, FA_READ | FA_OPEN_EXISTING) != FR_OK))
+    if ((type & FLAG_SPARSE) ?
+        (fvx_open(&mount_file, path, FA_READ | FA_OPEN_EXISTING) != FR_OK) :
+        ((fvx_open(&mount_file, path, FA_READ | FA_WRITE | FA_OPEN_EXISTING) != FR_OK) &&
+         (fvx_open(&mount_file, path, FA_READ | FA_OPEN_EXISTING) != FR_OK)))
         return 0;
+    if ((type & FLAG_SPARSE) && (OpenSparseImage(&mount_sparse, &mount_file) != 0)) {
+        fvx_close(&mount_file);
+        return 0;
+    }
     fvx_lseek(&mount_file, 0);
     fvx_sync(&mount_file);
     strncpy(mount_path, path, 256);
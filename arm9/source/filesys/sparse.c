@@ -0,0 +1,267 @@
+#include "sparse.h"
+#include "fsperm.h"
+#include "lodepng.h"
+#include "ui.h"
+
+
+u32 ValidateSparseImageHeader(const SparseImageHeader* header, u64 fsize) {
+    static const u8 sparse_magic[] = { SPARSE_MAGIC };
+    if ((memcmp(header->magic, sparse_magic, sizeof(sparse_magic)) != 0) ||
+        (header->block_size != SPARSE_BLOCK_SIZE) || !header->image_size ||
+        (header->n_blocks != (header->image_size + SPARSE_BLOCK_SIZE - 1) / SPARSE_BLOCK_SIZE) ||
+        (header->offset_index != sizeof(SparseImageHeader)) ||
+        ((u64) header->offset_index + ((u64) header->n_blocks * sizeof(SparseBlockEntry)) > fsize))
+        return 1; // the index has to fit inside the file
+    return 0;
+}
+
+u32 OpenSparseImage(SparseImage* sparse, FIL* file) {
+    SparseImageHeader* hdr = &(sparse->header);
+    UINT br;
+
+    memset(sparse, 0, sizeof(SparseImage));
+    sparse->file = file;
+    sparse->cache_block = (u32) -1;
+    if ((fvx_lseek(file, 0) != FR_OK) ||
+        (fvx_read(file, hdr, sizeof(SparseImageHeader), &br) != FR_OK) ||
+        (br != sizeof(SparseImageHeader)) ||
+        (ValidateSparseImageHeader(hdr, fvx_size(file)) != 0))
+        return 1;
+
+    // block index stays in memory for random access (size is bounded by the file size)
+    u32 size_index = (u32) ((u64) hdr->n_blocks * sizeof(SparseBlockEntry));
+    sparse->index = (SparseBlockEntry*) malloc(size_index);
+    sparse->data = (u8*) malloc(SPARSE_BLOCK_SIZE);
+    sparse->cache = (u8*) malloc(SPARSE_BLOCK_SIZE);
+    if (!sparse->index || !sparse->data || !sparse->cache ||
+        (fvx_lseek(file, hdr->offset_index) != FR_OK) ||
+        (fvx_read(file, sparse->index, size_index, &br) != FR_OK) ||
+        (br != size_index)) {
+        CloseSparseImage(sparse);
+        return 1;
+    }
+
+    // all blocks have to be inside the file
+    u64 fsize = fvx_size(file);
+    for (u32 i = 0; i < hdr->n_blocks; i++) {
+        SparseBlockEntry* entry = sparse->index + i;
+        if (entry->size && ((entry->size > SPARSE_BLOCK_RAW_SIZE(hdr, i)) ||
+            ((u64) entry->offset + entry->size > fsize))) {
+            CloseSparseImage(sparse);
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+void CloseSparseImage(SparseImage* sparse) {
+    if (sparse->index) free(sparse->index);
+    if (sparse->data) free(sparse->data);
+    if (sparse->cache) free(sparse->cache);
+    memset(sparse, 0, sizeof(SparseImage));
+}
+
+static u32 InflateSparseBlock(SparseImage* sparse, u32 block) {
+    SparseBlockEntry* entry = sparse->index + block;
+    u32 size_raw = SPARSE_BLOCK_RAW_SIZE(&(sparse->header), block);
+    unsigned char* out = NULL;
+    size_t outsize = 0;
+    UINT br;
+
+    sparse->cache_block = (u32) -1;
+    if ((fvx_lseek(sparse->file, entry->offset) != FR_OK) ||
+        (fvx_read(sparse->file, sparse->data, entry->size, &br) != FR_OK) ||
+        (br != entry->size))
+        return 1;
+    if ((lodepng_inflate(&out, &outsize, sparse->data, entry->size, &lodepng_default_decompress_settings) != 0) ||
+        (outsize != size_raw)) {
+        if (out) free(out);
+        return 1;
+    }
+    memcpy(sparse->cache, out, size_raw);
+    free(out);
+
+    sparse->cache_block = block;
+    return 0;
+}
+
+int ReadSparseImageBytes(SparseImage* sparse, void* buffer, u64 offset, u64 count) {
+    SparseImageHeader* hdr = &(sparse->header);
+    u8* buffer8 = (u8*) buffer;
+    UINT br;
+
+    if (!count || !sparse->index || (offset + count > hdr->image_size)) return -1;
+    while (count) {
+        u32 block = offset / SPARSE_BLOCK_SIZE;
+        u32 pos = offset % SPARSE_BLOCK_SIZE;
+        u32 len = min(SPARSE_BLOCK_SIZE - pos, count);
+        SparseBlockEntry* entry = sparse->index + block;
+        if (!entry->size) { // fill block
+            memset(buffer8, entry->offset & 0xFF, len);
+        } else if (entry->size == SPARSE_BLOCK_RAW_SIZE(hdr, block)) { // stored block(s), read in one go
+            for (u32 i = block + 1; (len < count) && (i < hdr->n_blocks); i++) {
+                SparseBlockEntry* next = sparse->index + i;
+                if ((next->size != SPARSE_BLOCK_RAW_SIZE(hdr, i)) ||
+                    (next->offset != (next - 1)->offset + (next - 1)->size))
+                    break;
+                len = min(len + next->size, count);
+            }
+            FSIZE_t fpos = entry->offset + pos;
+            if (((fvx_tell(sparse->file) != fpos) && (fvx_lseek(sparse->file, fpos) != FR_OK)) ||
+                (fvx_read(sparse->file, buffer8, len, &br) != FR_OK) || (br != len))
+                return -1;
+        } else { // deflated block
+            if ((sparse->cache_block != block) && (InflateSparseBlock(sparse, block) != 0))
+                return -1;
+            memcpy(buffer8, sparse->cache + pos, len);
+        }
+        buffer8 += len;
+        offset += len;
+        count -= len;
+    }
+
+    return 0;
+}
+
+u32 ReadSparseImageFile(const char* path, void* buffer, u64 offset, u32 count) {
+    SparseImage sparse;
+    FIL file;
+
+    if (fvx_open(&file, path, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+        return 1;
+    u32 ret = ((OpenSparseImage(&sparse, &file) == 0) &&
+        (ReadSparseImageBytes(&sparse, buffer, offset, count) == 0)) ? 0 : 1;
+    CloseSparseImage(&sparse);
+    fvx_close(&file);
+
+    return ret;
+}
+
+static bool IsFillBlock(const u8* data, u32 size) {
+    return (size <= 1) || (memcmp(data, data + 1, size - 1) == 0);
+}
+
+u32 BuildSparseImage(const char* path, const char* path_out, bool compress) {
+    static const u8 sparse_magic[] = { SPARSE_MAGIC };
+    SparseImageHeader hdr;
+    FIL src, dst;
+    UINT br, bw;
+
+    if (!CheckWritePermissions(path_out)) return 1;
+    if (fvx_open(&src, path, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+        return 1;
+
+    memset(&hdr, 0, sizeof(SparseImageHeader));
+    memcpy(hdr.magic, sparse_magic, sizeof(sparse_magic));
+    hdr.block_size = SPARSE_BLOCK_SIZE;
+    hdr.image_size = fvx_size(&src);
+    hdr.n_blocks = (hdr.image_size + SPARSE_BLOCK_SIZE - 1) / SPARSE_BLOCK_SIZE;
+    hdr.offset_index = sizeof(SparseImageHeader);
+
+    u32 size_index = hdr.n_blocks * sizeof(SparseBlockEntry);
+    SparseBlockEntry* index = (SparseBlockEntry*) malloc(size_index);
+    u8* buffer = (u8*) malloc(STD_BUFFER_SIZE);
+    if (!hdr.image_size || !index || !buffer ||
+        (fvx_open(&dst, path_out, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK)) {
+        if (index) free(index);
+        if (buffer) free(buffer);
+        fvx_close(&src);
+        return 1;
+    }
+
+    // header and an empty index first, index gets written again when done
+    u32 ret = 0;
+    memset(index, 0, size_index);
+    if ((fvx_write(&dst, &hdr, sizeof(SparseImageHeader), &bw) != FR_OK) || (bw != sizeof(SparseImageHeader)) ||
+        (fvx_write(&dst, index, size_index, &bw) != FR_OK) || (bw != size_index))
+        ret = 1;
+
+    // fill blocks only go to the index, everything else is stored or deflated
+    u64 offset_data = sizeof(SparseImageHeader) + size_index;
+    if (!ShowProgress(0, 0, path)) ret = 1;
+    for (u64 pos = 0; (pos < hdr.image_size) && (ret == 0); pos += STD_BUFFER_SIZE) {
+        UINT btr = (UINT) min(STD_BUFFER_SIZE, hdr.image_size - pos);
+        if ((fvx_read(&src, buffer, btr, &br) != FR_OK) || (br != btr)) {
+            ret = 1;
+            break;
+        }
+        for (u32 off = 0; (off < btr) && (ret == 0); off += SPARSE_BLOCK_SIZE) {
+            SparseBlockEntry* entry = index + ((pos + off) / SPARSE_BLOCK_SIZE);
+            u8* data = buffer + off;
+            u32 size = min(SPARSE_BLOCK_SIZE, btr - off);
+            if (IsFillBlock(data, size)) {
+                entry->offset = *data;
+                entry->size = 0;
+                continue;
+            }
+            unsigned char* out = NULL;
+            size_t outsize = 0;
+            if (compress && (lodepng_deflate(&out, &outsize, data, size, &lodepng_default_compress_settings) == 0) &&
+                (outsize < size)) {
+                data = out;
+                size = outsize;
+            }
+            if (offset_data + size > 0xFFFFFFFF) ret = 1; // won't fit FAT32 anyways
+            else if ((fvx_write(&dst, data, size, &bw) != FR_OK) || (bw != size)) ret = 1;
+            entry->offset = (u32) offset_data;
+            entry->size = size;
+            offset_data += size;
+            if (out) free(out);
+        }
+        if (!ShowProgress(pos + btr, hdr.image_size, path)) ret = 1;
+    }
+
+    if ((ret == 0) && ((fvx_lseek(&dst, hdr.offset_index) != FR_OK) ||
+        (fvx_write(&dst, index, size_index, &bw) != FR_OK) || (bw != size_index)))
+        ret = 1;
+
+    fvx_close(&dst);
+    fvx_close(&src);
+    free(buffer);
+    free(index);
+    if (ret != 0) fvx_unlink(path_out);
+
+    return ret;
+}
+
+u32 ExtractSparseImage(const char* path, const char* path_out) {
+    SparseImage sparse;
+    FIL src, dst;
+    UINT bw;
+
+    if (!CheckWritePermissions(path_out)) return 1;
+    if (fvx_open(&src, path, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+        return 1;
+    u8* buffer = (u8*) malloc(STD_BUFFER_SIZE);
+    if (!buffer || (OpenSparseImage(&sparse, &src) != 0)) {
+        if (buffer) free(buffer);
+        fvx_close(&src);
+        return 1;
+    }
+    if (fvx_open(&dst, path_out, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+        CloseSparseImage(&sparse);
+        fvx_close(&src);
+        free(buffer);
+        return 1;
+    }
+
+    u32 ret = 0;
+    u64 image_size = sparse.header.image_size;
+    if (!ShowProgress(0, 0, path)) ret = 1;
+    for (u64 pos = 0; (pos < image_size) && (ret == 0); pos += STD_BUFFER_SIZE) {
+        UINT btr = (UINT) min(STD_BUFFER_SIZE, image_size - pos);
+        if ((ReadSparseImageBytes(&sparse, buffer, pos, btr) != 0) ||
+            (fvx_write(&dst, buffer, btr, &bw) != FR_OK) || (bw != btr))
+            ret = 1;
+        if (!ShowProgress(pos + btr, image_size, path)) ret = 1;
+    }
+
+    fvx_close(&dst);
+    CloseSparseImage(&sparse);
+    fvx_close(&src);
+    free(buffer);
+    if (ret != 0) fvx_unlink(path_out);
+
+    return ret;
+}
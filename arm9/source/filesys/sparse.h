@@ -0,0 +1,47 @@
+#pragma once
+
+#include "common.h"
+#include "vff.h"
+
+#define SPARSE_MAGIC        'S', 'P', 'A', 'R', 'S', 'E', 0x00, 0x01
+#define SPARSE_EXT          "sparse"
+#define SPARSE_BLOCK_SIZE   0x10000 // must divide STD_BUFFER_SIZE
+
+// raw size of a block (the last one may be shorter)
+#define SPARSE_BLOCK_RAW_SIZE(hdr, i) \
+    ((u32) min((u64) SPARSE_BLOCK_SIZE, (hdr)->image_size - ((u64) (i) * SPARSE_BLOCK_SIZE)))
+
+// sparse image layout: header, block index, block data
+typedef struct {
+    u8  magic[8];
+    u32 block_size;
+    u32 n_blocks;
+    u64 image_size;
+    u32 offset_index; // relative to start of file
+    u8  reserved[4];
+} PACKED_STRUCT SparseImageHeader;
+
+// size == 0: fill block, offset holds the fill byte
+// size == raw block size: stored block
+// anything below: deflated block
+typedef struct {
+    u32 offset; // relative to start of file
+    u32 size;
+} PACKED_STRUCT SparseBlockEntry;
+
+typedef struct {
+    FIL* file;
+    SparseImageHeader header;
+    SparseBlockEntry* index;
+    u8* data; // deflated block data
+    u8* cache; // last inflated block
+    u32 cache_block;
+} SparseImage;
+
+u32 ValidateSparseImageHeader(const SparseImageHeader* header, u64 fsize);
+u32 OpenSparseImage(SparseImage* sparse, FIL* file);
+void CloseSparseImage(SparseImage* sparse);
+int ReadSparseImageBytes(SparseImage* sparse, void* buffer, u64 offset, u64 count);
+u32 ReadSparseImageFile(const char* path, void* buffer, u64 offset, u32 count);
+u32 BuildSparseImage(const char* path, const char* path_out, bool compress);
+u32 ExtractSparseImage(const char* path, const char* path_out);
@@ -31,6 +31,7 @@
 #define BEAT_VLIBUFSZ	(8)
 #define BEAT_MAXPATH	(256)
 #define BEAT_FILEBUFSZ	(256 * 1024)
+#define BEAT_STREAMBUFSZ	(64 * 1024)
 
 #define BEAT_RANGE(c, i)	((c)->ranges[1][i] - (c)->ranges[0][i])
 #define BEAT_UPDATEDELAYMS	(1000 / 4)
@@ -51,6 +52,13 @@ static size_t fs_size(const char *path)
 	return fno.fsize;
 }
 
+static u32 BEAT_FileCrc32(const char *path, size_t offset, size_t len)
+{
+	u8 crc[4];
+	if (!FileGetCrc32(path, crc, offset, len)) return 0;
+	return getbe32(crc);
+}
+
 static const char *basepath(const char *path)
 {
 	const char *ret = path + strlen(path);
@@ -104,9 +112,16 @@ static const u8 bps_chksumoffs[BEAT_FILENUM] = {
 };
 static const u8 bpm_signature[] = { 'B', 'P', 'M', '1' };
 
+/** BUFFERED FILE STREAM */
+typedef struct {
+	u8 *buf;
+	size_t pos, len; // absolute file position and size of the buffered data
+	bool dirty; // buffer holds data not yet written to the file
+} BEAT_Stream;
+
 /** BEAT STATE STORAGE */
 typedef struct {
-	u8 *copybuf;
+	u8 *copybuf, *streambuf;
 	size_t foff[BEAT_FILENUM], eoal_offset;
 	size_t ranges[2][BEAT_FILENUM];
 	u32 ocrc; // Output crc
@@ -121,6 +136,7 @@ typedef struct {
 		};
 	};
 	char processing[BEAT_MAXPATH];
+	BEAT_Stream stream[BEAT_FILENUM];
 	FIL file[BEAT_FILENUM];
 } BEAT_Context;
 
@@ -159,32 +175,119 @@ static const char *BEAT_ErrString(int error)
 	}
 }
 
+static int BEAT_InitStreams(BEAT_Context *ctx)
+{ // Allocate one stream buffer per context file
+	ctx->streambuf = malloc(BEAT_STREAMBUFSZ * BEAT_FILENUM);
+	if (ctx->streambuf == NULL) return BEAT_OUT_OF_MEMORY;
+	for (int i = 0; i < BEAT_FILENUM; i++)
+		ctx->stream[i].buf = ctx->streambuf + (i * BEAT_STREAMBUFSZ);
+	return BEAT_OK;
+}
+
+static int BEAT_Flush(BEAT_Context *ctx, int id)
+{ // Write back buffered data of the context file `id`
+	UINT bw;
+	BEAT_Stream *s = &ctx->stream[id];
+	if (!s->dirty) return BEAT_OK;
+
+	s->dirty = false;
+	if ((fvx_lseek(&ctx->file[id], s->pos) != FR_OK) ||
+		(fvx_write(&ctx->file[id], s->buf, s->len, &bw) != FR_OK) ||
+		(bw != s->len)) return BEAT_IO_ERROR;
+	return BEAT_OK;
+}
+
+static void BEAT_Invalidate(BEAT_Context *ctx, int id, size_t pos)
+{ // Drop the buffer contents, buffer restarts at absolute position `pos`
+	ctx->stream[id].pos = pos;
+	ctx->stream[id].len = 0;
+	ctx->stream[id].dirty = false;
+}
+
+static int BEAT_Fill(BEAT_Context *ctx, int id, size_t abs, size_t len, const u8 **out)
+{ // Make sure `len` bytes at absolute position `abs` are in the buffer
+	UINT br;
+	int res;
+	BEAT_Stream *s = &ctx->stream[id];
+
+	if ((abs >= s->pos) && ((abs + len) <= (s->pos + s->len))) {
+		*out = s->buf + (abs - s->pos);
+		return BEAT_OK;
+	}
+
+	res = BEAT_Flush(ctx, id);
+	if (res != BEAT_OK) return res;
+
+	BEAT_Invalidate(ctx, id, abs);
+	if ((fvx_lseek(&ctx->file[id], abs) != FR_OK) ||
+		(fvx_read(&ctx->file[id], s->buf, BEAT_STREAMBUFSZ, &br) != FR_OK) ||
+		(br < len)) return BEAT_IO_ERROR;
+	s->len = br;
+
+	*out = s->buf;
+	return BEAT_OK;
+}
+
 static int BEAT_Read(BEAT_Context *ctx, int id, void *out, size_t len, int fwd)
 { // Read up to `len` bytes from the context file `id` to the `out` buffer
 	UINT br;
-	FRESULT res;
+	int res;
+	const u8 *blk;
+	size_t abs;
 	if ((len + ctx->foff[id]) > BEAT_RANGE(ctx, id))
 		return BEAT_OVERFLOW;
 
-	fvx_lseek(&ctx->file[id], BEAT_ABSPOS(ctx, id)); // ALWAYS use the state offset + start range
+	abs = BEAT_ABSPOS(ctx, id); // ALWAYS use the state offset + start range
 	ctx->foff[id] += len * fwd;
-	res = fvx_read(&ctx->file[id], out, len, &br);
-	return (res == FR_OK && br == len) ? BEAT_OK : BEAT_IO_ERROR;
+
+	if (len > BEAT_STREAMBUFSZ) { // too big for the buffer, read directly
+		res = BEAT_Flush(ctx, id);
+		if (res != BEAT_OK) return res;
+		if ((fvx_lseek(&ctx->file[id], abs) != FR_OK) ||
+			(fvx_read(&ctx->file[id], out, len, &br) != FR_OK))
+			return BEAT_IO_ERROR;
+		return (br == len) ? BEAT_OK : BEAT_IO_ERROR;
+	}
+
+	res = BEAT_Fill(ctx, id, abs, len, &blk);
+	if (res != BEAT_OK) return res;
+	memcpy(out, blk, len);
+	return BEAT_OK;
 }
 
 static int BEAT_WriteOut(BEAT_Context *ctx, const u8 *in, size_t len, int fwd)
 { // Write `len` bytes from `in` to BEAT_OF, updates the output CRC
 	UINT bw;
-	FRESULT res;
+	int res;
+	size_t abs;
+	BEAT_Stream *s = &ctx->stream[BEAT_OF];
 	if ((len + ctx->foff[BEAT_OF]) > BEAT_RANGE(ctx, BEAT_OF))
 		return BEAT_OVERFLOW;
 
 	// Blindly assume all writes will be done linearly
 	ctx->ocrc = ~crc32_calculate(~ctx->ocrc, in, len);
-	fvx_lseek(&ctx->file[BEAT_OF], BEAT_ABSPOS(ctx, BEAT_OF));
+	abs = BEAT_ABSPOS(ctx, BEAT_OF);
 	ctx->foff[BEAT_OF] += len * fwd;
-	res = fvx_write(&ctx->file[BEAT_OF], in, len, &bw);
-	return (res == FR_OK && bw == len) ? BEAT_OK : BEAT_IO_ERROR;
+
+	if ((abs < s->pos) || (abs > (s->pos + s->len)) ||
+		((abs + len) > (s->pos + BEAT_STREAMBUFSZ))) {
+		// not adjacent to the buffered data or doesn't fit, start over
+		res = BEAT_Flush(ctx, BEAT_OF);
+		if (res != BEAT_OK) return res;
+		BEAT_Invalidate(ctx, BEAT_OF, abs);
+
+		if (len > BEAT_STREAMBUFSZ) { // too big for the buffer, write directly
+			if ((fvx_lseek(&ctx->file[BEAT_OF], abs) != FR_OK) ||
+				(fvx_write(&ctx->file[BEAT_OF], in, len, &bw) != FR_OK))
+				return BEAT_IO_ERROR;
+			return (bw == len) ? BEAT_OK : BEAT_IO_ERROR;
+		}
+	}
+
+	memcpy(s->buf + (abs - s->pos), in, len);
+	s->len = max(s->len, (abs - s->pos) + len);
+	s->dirty = true;
+	return BEAT_OK;
 }
 
 static void BEAT_SeekOff(BEAT_Context *ctx, int id, ssize_t offset)
@@ -242,10 +345,14 @@ static int BEAT_RunActions(BEAT_Context *ctx, const BEAT_Action *acts)
 
 static void BEAT_ReleaseCTX(BEAT_Context *ctx)
 { // Release any resources associated to the context
-	free(ctx->copybuf);
 	for (int i = 0; i < BEAT_FILENUM; i++) {
-		if (fvx_opened(&ctx->file[i])) fvx_close(&ctx->file[i]);
+		if (fvx_opened(&ctx->file[i])) {
+			if (ctx->streambuf) BEAT_Flush(ctx, i);
+			fvx_close(&ctx->file[i]);
+		}
 	}
+	free(ctx->copybuf);
+	free(ctx->streambuf);
 	progress_refcnt--; // lol what even are atomics
 }
 
@@ -267,6 +374,8 @@ static int BPS_InitCTX_Advanced(BEAT_Context *ctx, const char *bps_path, const c
 	// Clear stackbuf
 	memset(ctx, 0, sizeof(*ctx));
 	ctx->eoal_offset = 12;
+	res = BEAT_InitStreams(ctx);
+	if (res != BEAT_OK) return res;
 
 	if (end == 0) {
 		start = 0;
@@ -274,7 +383,7 @@ static int BPS_InitCTX_Advanced(BEAT_Context *ctx, const char *bps_path, const c
 	}
 
 	if (do_chksum) // get BPS checksum
-		chksum[BEAT_PF] = crc32_calculate_from_file(bps_path, start, end - start - 4);
+		chksum[BEAT_PF] = BEAT_FileCrc32(bps_path, start, end - start - 4);
 
 	strcpy(ctx->processing, basepath(bps_path));
 
@@ -344,13 +453,23 @@ static int BPS_InitCTX(BEAT_Context *ctx, const char *bps, const char *in, const
  Used by SourceRead, TargetRead and CreateFile
 */
 static int BEAT_BlkCopy(BEAT_Context *ctx, int src_id, u32 len)
-{
+{ // data goes straight from the source stream buffer to the output stream buffer
+	BEAT_Stream *s = &ctx->stream[src_id];
+	if ((len + ctx->foff[src_id]) > BEAT_RANGE(ctx, src_id))
+		return BEAT_OVERFLOW;
+
 	while(len > 0) {
-		ssize_t blksz = min(len, BEAT_FILEBUFSZ);
-		int res = BEAT_Read(ctx, src_id, ctx->copybuf, blksz, 1);
+		const u8 *blk;
+		size_t abs = BEAT_ABSPOS(ctx, src_id);
+		size_t blksz = min(len, BEAT_STREAMBUFSZ);
+		if ((abs >= s->pos) && (abs < (s->pos + s->len))) // use what's already buffered first
+			blksz = min(blksz, (s->pos + s->len) - abs);
+
+		int res = BEAT_Fill(ctx, src_id, abs, blksz, &blk);
 		if (res != BEAT_OK) return res;
+		BEAT_SeekOff(ctx, src_id, blksz);
 
-		res = BEAT_WriteOut(ctx, ctx->copybuf, blksz, 1);
+		res = BEAT_WriteOut(ctx, blk, blksz, 1);
 		if (res != BEAT_OK) return res;
 
 		if (!BEAT_UpdateProgress(ctx)) return BEAT_ABORTED;
@@ -455,8 +574,10 @@ static int BPS_RunActions(BEAT_Context *ctx)
 	};
 	int res = BEAT_RunActions(ctx, BPS_Actions);
 	if (res == BEAT_ABORTED) return BEAT_ABORTED;
-	if (res == BEAT_EOAL) // Verify hashes
+	if (res == BEAT_EOAL) { // Write back remaining output, verify hashes
+		if (BEAT_Flush(ctx, BEAT_OF) != BEAT_OK) return BEAT_IO_ERROR;
 		return (ctx->ocrc == ctx->xocrc) ? BEAT_OK : BEAT_BADOUTPUT;
+	}
 	return res; // some kind of error
 }
 
@@ -467,7 +588,12 @@ static int BPM_OpenFile(BEAT_Context *ctx, int id, const char *path, size_t max_
 {
 	FRESULT res;
 
-	if (fvx_opened(&ctx->file[id])) fvx_close(&ctx->file[id]);
+	if (fvx_opened(&ctx->file[id])) {
+		int flush_res = BEAT_Flush(ctx, id);
+		fvx_close(&ctx->file[id]);
+		if (flush_res != BEAT_OK) return flush_res;
+	}
+	BEAT_Invalidate(ctx, id, 0);
 	res = fvx_open(&ctx->file[id], path, max_sz ? BEAT_RWCREATE : BEAT_READONLY);
 	if (res != FR_OK) return BEAT_IO_ERROR;
 
@@ -493,13 +619,15 @@ static int BPM_InitCTX(BEAT_Context *ctx, const char *bpm_path, const char *src_
 	u32 chksum, expected_chksum;
 
 	memset(ctx, 0, sizeof(*ctx));
+	res = BEAT_InitStreams(ctx);
+	if (res != BEAT_OK) return res;
 
 	ctx->bpm_path = bpm_path;
 	ctx->source_dir = src_dir;
 	ctx->target_dir = dst_dir;
 	ctx->eoal_offset = 4;
 
-	chksum = crc32_calculate_from_file(bpm_path, 0, fs_size(bpm_path) - 4);
+	chksum = BEAT_FileCrc32(bpm_path, 0, fs_size(bpm_path) - 4);
 	res = BPM_OpenFile(ctx, BEAT_PF, bpm_path, 0);
 	if (res != BEAT_OK) return res;
 	res = BEAT_Read(ctx, BEAT_PF, read_magic, sizeof(read_magic), 1);
@@ -649,7 +777,7 @@ static int BPM_RunActions(BEAT_Context *ctx)
 	};
 	int res = BEAT_RunActions(ctx, BPM_Actions);
 	if (res == BEAT_ABORTED) return BEAT_ABORTED;
-	if (res == BEAT_EOAL) return BEAT_OK;
+	if (res == BEAT_EOAL) return BEAT_Flush(ctx, BEAT_OF);
 	return res;
 }
 
@@ -1,6 +1,7 @@
 #include "cert.h"
 #include "disadiff.h"
 #include "rsa.h"
+#include "vff.h"
 
 typedef struct {
     char magic[4]; // "CERT"
@@ -68,6 +69,45 @@ static struct {
 
 static inline void _Certificate_CleanupImpl(Certificate* cert);
 
+// certs.db gets indexed by full issuer on first use (anything past the cap is walked), cert bodies are loaded on demand
+#define CERTDB_INDEX_MAX 32
+#define CERT_LRU_SIZE    4
+
+typedef struct {
+    char full_issuer[0x41];
+    u32 hash;
+    u32 offset;
+    u32 sig_size;
+    u32 data_size;
+} CertDbIndexEntry;
+
+typedef struct {
+    FSIZE_t fsize; // size / timestamp, to notice a changed certs.db
+    WORD fdate;
+    WORD ftime;
+    u32 n_entries;
+    u32 offset_rest; // index full: certs from here on are only found by walking the db
+    u32 max_offset;
+    CertDbIndexEntry entries[CERTDB_INDEX_MAX];
+} CertDbIndex;
+
+typedef struct {
+    bool used;
+    u32 nand; // 0 -> SysNAND, 1 -> EmuNAND
+    u32 offset; // cert offset in certs.db
+    u32 tick;
+    Certificate cert;
+} CertLruSlot;
+
+static CertDbIndex* _CertDbIndexes[2] = { NULL, NULL };
+static CertLruSlot _CertLru[CERT_LRU_SIZE] = { 0 };
+
+static inline u32 _CertDbIssuerHash(const char* issuer) {
+    u32 hash = 0x811C9DC5; // FNV-1a
+    while (*issuer) hash = (hash ^ (u8) *(issuer++)) * 0x01000193;
+    return hash;
+}
+
 bool Certificate_IsValid(const Certificate* cert) {
     if (!cert || !cert->sig || !cert->data)
         return false;
@@ -554,33 +594,19 @@ static void _SaveToCertStorage(const Certificate* cert, u32 ident) {
 
 // grumble grumble, gotta avoid repeated code when possible or at least if significant enough
 
-static u32 _DisaOpenCertDb(char (*path)[16], bool emunand, DisaDiffRWInfo* info, u8** cache, u32* offset, u32* max_offset) {
+static u32 _DisaOpenCertDb(char (*path)[16], bool emunand, u32* offset, u32* max_offset) {
     GetCertDBPath(*path, emunand);
 
-    u8* _cache = NULL;
-    if (GetDisaDiffRWInfo(*path, info, false) != 0) return 1;
-    _cache = (u8*)malloc(info->size_dpfs_lvl2);
-    if (!_cache) return 1;
-    if (BuildDisaDiffDpfsLvl2Cache(*path, info, _cache, info->size_dpfs_lvl2) != 0) {
-        free(_cache);
-        return 1;
-    }
-
+    // parsed DISA info is kept in the DISA/DIFF pool, lookups below don't re-parse the container
     CertsDbPartitionHeader header;
 
-    if (ReadDisaDiffIvfcLvl4(*path, info, 0, sizeof(CertsDbPartitionHeader), &header) != sizeof(CertsDbPartitionHeader)) {
-        free(_cache);
+    if (ReadDisaDiffIvfcLvl4(*path, NULL, 0, sizeof(CertsDbPartitionHeader), &header) != sizeof(CertsDbPartitionHeader))
         return 1;
-    }
 
     if (getbe32(header.magic) != 0x43455254 /* 'CERT' */ ||
       getbe32(header.unk) != 0 ||
-      getle32(header.used_size) & 0xFF) {
-        free(_cache);
+      getle32(header.used_size) & 0xFF)
         return 1;
-    }
-
-    *cache = _cache;
 
     *offset = sizeof(CertsDbPartitionHeader);
     *max_offset = getle32(header.used_size) + sizeof(CertsDbPartitionHeader);
@@ -588,13 +614,15 @@ static u32 _DisaOpenCertDb(char (*path)[16], bool emunand, DisaDiffRWInfo* info,
     return 0;
 }
 
-static u32 _ProcessNextCertDbEntry(const char* path, DisaDiffRWInfo* info, Certificate* cert, u32 *full_size, char (*full_issuer)[0x41], u32* offset, u32 max_offset) {
+// reads the sig type and the cert body (issuer, name, keytype), the public key is left on disk
+static u32 _ProcessNextCertDbEntry(const char* path, CertDbIndexEntry* entry, u32 offset, u32 max_offset) {
     u8 sig_type_data[4];
     u8 keytype_data[4];
+    CertificateBody body; // header only, pub key is not needed for the index
 
-    if (*offset + 4 > max_offset) return 1;
+    if (offset + 4 > max_offset) return 1;
 
-    if (ReadDisaDiffIvfcLvl4(path, info, *offset, 4, sig_type_data) != 4)
+    if (ReadDisaDiffIvfcLvl4(path, NULL, offset, 4, sig_type_data) != 4)
         return 1;
 
     u32 sig_type = getbe32(sig_type_data);
@@ -604,12 +632,12 @@ static u32 _ProcessNextCertDbEntry(const char* path, DisaDiffRWInfo* info, Certi
     u32 sig_size = _Certificate_GetSignatureChunkSizeFromType(sig_type);
     if (sig_size == 0) return 1;
 
-    u32 keytype_off = *offset + sig_size + offsetof(CertificateBody, keytype);
-    if (keytype_off + 4 > max_offset) return 1;
+    if (offset + sig_size + sizeof(CertificateBody) > max_offset) return 1;
 
-    if (ReadDisaDiffIvfcLvl4(path, info, keytype_off, 4, keytype_data) != 4)
+    if (ReadDisaDiffIvfcLvl4(path, NULL, offset + sig_size, sizeof(CertificateBody), &body) != sizeof(CertificateBody))
         return 1;
 
+    memcpy(keytype_data, body.keytype, 4);
     u32 keytype = getbe32(keytype_data);
 
     if (keytype == 2) return 1; // ECC keys not allowed on db
@@ -617,83 +645,186 @@ static u32 _ProcessNextCertDbEntry(const char* path, DisaDiffRWInfo* info, Certi
     u32 data_size = _Certificate_GetDataChunkSizeFromType(keytype);
     if (data_size == 0) return 1;
 
-    *full_size = sig_size + data_size;
-    if (*offset + *full_size > max_offset) return 1;
+    if (offset + sig_size + data_size > max_offset) return 1;
 
-    cert->sig = (CertificateSignature*)malloc(sig_size);
-    cert->data = (CertificateBody*)malloc(data_size);
-    if (!cert->sig || !cert->data)
+    // same bound as before, the cert itself gets checked via Certificate_IsValid() when loaded
+    size_t issuer_len = strnlen(body.issuer, 0x40);
+    size_t name_len = strnlen(body.name, 0x40);
+    if (snprintf(entry->full_issuer, 0x41, "%.*s-%.*s", (int) issuer_len, body.issuer, (int) name_len, body.name) > 0x40)
         return 1;
 
-    if (ReadDisaDiffIvfcLvl4(path, info, *offset, sig_size, cert->sig) != sig_size)
-        return 1;
+    entry->hash = _CertDbIssuerHash(entry->full_issuer);
+    entry->offset = offset;
+    entry->sig_size = sig_size;
+    entry->data_size = data_size;
 
-    if (ReadDisaDiffIvfcLvl4(path, info, *offset + sig_size, data_size, cert->data) != data_size)
-        return 1;
+    return 0;
+}
 
-    if (!Certificate_IsValid(cert))
-        return 1;
+static void _CertDbIndexFree(u32 nand) {
+    CertDbIndex* index = _CertDbIndexes[nand];
+    if (!index) return;
 
-    if (snprintf(*full_issuer, 0x41, "%s-%s", cert->data->issuer, cert->data->name) > 0x40)
-        return 1;
+    // cached certs came from this certs.db, those have to go too
+    for (u32 i = 0; i < CERT_LRU_SIZE; i++) {
+        if (!_CertLru[i].used || (_CertLru[i].nand != nand)) continue;
+        _Certificate_CleanupImpl(&_CertLru[i].cert);
+        _CertLru[i].used = false;
+    }
 
-    return 0;
+    free(index);
+    _CertDbIndexes[nand] = NULL;
 }
 
-// certificates returned by this call are not to be deemed safe to edit, pointers or pointed data
-u32 LoadCertFromCertDb(Certificate* cert, const char* issuer) {
-    if (!issuer || !cert) return 1;
+// certs.db has no filesystem.. its pretty plain, certificates after another
+// but also, certificates are not equally sized
+// so the whole file is walked once, and from there on only the index is used
+static CertDbIndex* _CertDbIndexGet(u32 nand) {
+    CertDbIndex* index = _CertDbIndexes[nand];
+    char path[16];
+    FILINFO fno;
 
-    u32 _ident = _Issuer_To_StorageIdent(issuer);
-    if (_LoadFromCertStorage(cert, _ident)) {
-        return 0;
+    GetCertDBPath(path, nand ? true : false);
+    if (fvx_stat(path, &fno) != FR_OK) {
+        _CertDbIndexFree(nand);
+        return NULL;
     }
 
-    int ret = 1;
+    // same file as last time? keep the index
+    if (index && (index->fsize == fno.fsize) && (index->fdate == fno.fdate) && (index->ftime == fno.ftime))
+        return index;
 
-    for (int i = 0; i < 2 && ret; ++i) {
-        Certificate cert_local = CERTIFICATE_NULL_INIT;
+    _CertDbIndexFree(nand);
+    index = (CertDbIndex*) malloc(sizeof(CertDbIndex));
+    if (!index) return NULL;
+    memset(index, 0, sizeof(CertDbIndex));
 
-        char path[16];
-        DisaDiffRWInfo info;
-        u8* cache;
+    u32 offset, max_offset;
+    if (_DisaOpenCertDb(&path, nand ? true : false, &offset, &max_offset)) {
+        free(index);
+        return NULL;
+    }
 
-        u32 offset, max_offset;
+    // most cases of bad data lead to giving up, but whatever was indexed up to there stays usable
+    while ((offset < max_offset) && (index->n_entries < CERTDB_INDEX_MAX)) {
+        CertDbIndexEntry* entry = &index->entries[index->n_entries];
+        if (_ProcessNextCertDbEntry(path, entry, offset, max_offset))
+            break;
+        offset += entry->sig_size + entry->data_size;
+        index->n_entries++;
+    }
+    index->offset_rest = (index->n_entries >= CERTDB_INDEX_MAX) ? offset : max_offset;
+    index->max_offset = max_offset;
 
-        if (_DisaOpenCertDb(&path, i ? true : false, &info, &cache, &offset, &max_offset))
-            return 1;
+    index->fsize = fno.fsize;
+    index->fdate = fno.fdate;
+    index->ftime = fno.ftime;
+    _CertDbIndexes[nand] = index;
 
-        // certs.db has no filesystem.. its pretty plain, certificates after another
-        // but also, certificates are not equally sized
-        // so most cases of bad data, leads to giving up
-        while (offset < max_offset) {
-            char full_issuer[0x41];
-            u32 full_size;
+    return index;
+}
 
-            if (_ProcessNextCertDbEntry(path, &info, &cert_local, &full_size, &full_issuer, &offset, max_offset))
-                break;
+static u32 _CertDbIndexFind(const CertDbIndex* index, const char* issuer) {
+    u32 hash = _CertDbIssuerHash(issuer);
+    for (u32 i = 0; i < index->n_entries; i++) {
+        if ((index->entries[i].hash == hash) && !strcmp(index->entries[i].full_issuer, issuer))
+            return i;
+    }
+    return (u32) -1;
+}
 
-            if (!strcmp(full_issuer, issuer)) {
-                ret = 0;
-                break;
-            }
+// returns a pointer to an LRU owned certificate, only valid until the next call
+static const Certificate* _CertDbLoadEntry(u32 nand, const CertDbIndexEntry* entry) {
+    CertLruSlot* slot = NULL;
+    static u32 lru_tick = 0;
 
-            _Certificate_CleanupImpl(&cert_local);
+    // already parsed?
+    for (u32 i = 0; i < CERT_LRU_SIZE; i++) {
+        CertLruSlot* s = &_CertLru[i];
+        if (s->used && (s->nand == nand) && (s->offset == entry->offset)) {
+            s->tick = ++lru_tick;
+            return &s->cert;
+        }
+        // pick either a free slot or the least recently used one
+        if (!slot || (slot->used && (!s->used || (s->tick < slot->tick))))
+            slot = s;
+    }
+
+    if (slot->used) {
+        _Certificate_CleanupImpl(&slot->cert);
+        slot->used = false;
+    }
+
+    char path[16];
+    GetCertDBPath(path, nand ? true : false);
+
+    slot->cert.sig = (CertificateSignature*) malloc(entry->sig_size);
+    slot->cert.data = (CertificateBody*) malloc(entry->data_size);
+    if (!slot->cert.sig || !slot->cert.data ||
+        (ReadDisaDiffIvfcLvl4(path, NULL, entry->offset, entry->sig_size, slot->cert.sig) != entry->sig_size) ||
+        (ReadDisaDiffIvfcLvl4(path, NULL, entry->offset + entry->sig_size, entry->data_size, slot->cert.data) != entry->data_size) ||
+        !Certificate_IsValid(&slot->cert)) {
+        _Certificate_CleanupImpl(&slot->cert);
+        return NULL;
+    }
+
+    slot->used = true;
+    slot->nand = nand;
+    slot->offset = entry->offset;
+    slot->tick = ++lru_tick;
+
+    // while at it, try to save to static storage, if applicable
+    _SaveToCertStorage(&slot->cert, _Issuer_To_StorageIdent(entry->full_issuer));
+
+    return &slot->cert;
+}
+
+static const Certificate* _CertDbLookup(const char* issuer) {
+    for (u32 nand = 0; nand < 2; nand++) {
+        CertDbIndex* index = _CertDbIndexGet(nand);
+        if (!index) continue;
 
-            offset += full_size;
+        u32 idx = _CertDbIndexFind(index, issuer);
+        if (idx != (u32) -1) {
+            const Certificate* cert = _CertDbLoadEntry(nand, &index->entries[idx]);
+            if (cert) return cert;
+            continue;
         }
 
-        if (ret) {
-            _Certificate_CleanupImpl(&cert_local);
-        } else {
-            *cert = cert_local;
-            _SaveToCertStorage(&cert_local, _ident);
+        // not indexed, walk whatever didn't fit the index
+        char path[16];
+        CertDbIndexEntry entry;
+        u32 hash = _CertDbIssuerHash(issuer);
+        GetCertDBPath(path, nand ? true : false);
+        for (u32 offset = index->offset_rest; offset < index->max_offset; offset += entry.sig_size + entry.data_size) {
+            if (_ProcessNextCertDbEntry(path, &entry, offset, index->max_offset))
+                break;
+            if ((entry.hash != hash) || strcmp(entry.full_issuer, issuer))
+                continue;
+            const Certificate* cert = _CertDbLoadEntry(nand, &entry);
+            if (cert) return cert;
+            break;
         }
+    }
+
+    return NULL;
+}
+
+// certificates returned by this call are not to be deemed safe to edit, pointers or pointed data
+u32 LoadCertFromCertDb(Certificate* cert, const char* issuer) {
+    if (!issuer || !cert) return 1;
 
-        free(cache);
+    u32 _ident = _Issuer_To_StorageIdent(issuer);
+    if (_LoadFromCertStorage(cert, _ident)) {
+        return 0;
     }
 
-    return ret;
+    // static storage may have been filled by the lookup
+    const Certificate* cert_db = _CertDbLookup(issuer);
+    if (!cert_db) return 1;
+    if (_LoadFromCertStorage(cert, _ident)) return 0;
+
+    return _Certificate_AllocCopyOutImpl(cert_db, cert);
 }
 
 // I dont expect many certs on a cert bundle, so I'll cap it to 8
@@ -728,48 +859,16 @@ u32 BuildRawCertBundleFromCertDb(void* rawout, size_t* size, const char* const*
 
     int ret = 0;
 
-    for (int i = 0; i < 2 && loaded_count != count && !ret; ++i) {
-        Certificate cert_local = CERTIFICATE_NULL_INIT;
-
-        char path[16];
-        DisaDiffRWInfo info;
-        u8* cache;
-
-        u32 offset, max_offset;
-
-        if (_DisaOpenCertDb(&path, i ? true : false, &info, &cache, &offset, &max_offset))
-            continue;
-
-        while (offset < max_offset) {
-            char full_issuer[0x41];
-            u32 full_size;
-
-            if (_ProcessNextCertDbEntry(path, &info, &cert_local, &full_size, &full_issuer, &offset, max_offset))
-                break;
-
-            for (int j = 0; j < count; j++) {
-                if (certs_loaded & BIT(j)) continue;
-                if (!strcmp(full_issuer, cert_issuers[j])) {
-                    ret = _Certificate_AllocCopyOutImpl(&cert_local, &certs[j]);
-                    if (ret) break;
-                    certs_loaded |= BIT(j);
-                    ++loaded_count;
-                }
-            }
-
-            // while at it, try to save to static storage, if applicable
-            u32 _ident = _Issuer_To_StorageIdent(full_issuer);
-            _SaveToCertStorage(&cert_local, _ident);
-
-            _Certificate_CleanupImpl(&cert_local);
+    for (int i = 0; i < count && !ret; ++i) {
+        if (certs_loaded & BIT(i)) continue;
 
-            if (loaded_count == count || ret) // early exit
-                break;
-
-            offset += full_size;
-        }
+        const Certificate* cert_db = _CertDbLookup(cert_issuers[i]);
+        if (!cert_db) break;
 
-        free(cache);
+        ret = _Certificate_AllocCopyOutImpl(cert_db, &certs[i]);
+        if (ret) break;
+        certs_loaded |= BIT(i);
+        ++loaded_count;
     }
 
     if (!ret && loaded_count == count) {
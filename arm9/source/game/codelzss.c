@@ -9,6 +9,8 @@
 #define CODE_SEG_OFFSET(s)  (((s) & 0x0FFF) + 2)
 #define CODE_SEG_SIZE(s)    ((((s) >> 12) & 0xF) + 3)
 
+#define CODE_PROGRESS_STEP  0x10000
+
 typedef struct {
     u32 off_size_comp; // 0xOOSSSSSS, where O == reverse offset and S == size
     u32 addsize_dec; // decompressed size - compressed size
@@ -45,11 +47,15 @@ u32 DecompressCodeLzss(u8* code, u32* code_size, u32 max_size) {
     u8* ptr_out = data_end;
 
     // main decompression loop
+    u8* ptr_progress = data_end;
     while ((ptr_in > comp_start) && (ptr_out > comp_start)) {
-        if (!ShowProgress(data_end - ptr_out, data_end - data_start, STR_DECOMPRESSING_DOT_CODE)) {
-            if (ShowPrompt(true, "%s", STR_DECOMPRESSING_DOT_CODE_B_DETECTED_CANCEL)) return 1;
-            ShowProgress(0, data_end - data_start, STR_DECOMPRESSING_DOT_CODE);
-            ShowProgress(data_end - ptr_out, data_end - data_start, STR_DECOMPRESSING_DOT_CODE);
+        if (ptr_out <= ptr_progress) { // progress is only updated every CODE_PROGRESS_STEP byte
+            ptr_progress = ptr_out - CODE_PROGRESS_STEP;
+            if (!ShowProgress(data_end - ptr_out, data_end - data_start, STR_DECOMPRESSING_DOT_CODE)) {
+                if (ShowPrompt(true, "%s", STR_DECOMPRESSING_DOT_CODE_B_DETECTED_CANCEL)) return 1;
+                ShowProgress(0, data_end - data_start, STR_DECOMPRESSING_DOT_CODE);
+                ShowProgress(data_end - ptr_out, data_end - data_start, STR_DECOMPRESSING_DOT_CODE);
+            }
         }
 
         // sanity check
@@ -57,6 +63,32 @@ u32 DecompressCodeLzss(u8* code, u32* code_size, u32 max_size) {
 
         // read and process control byte
         u8 ctrlbyte = *(--ptr_in);
+
+        // fast path: enough room left for 8 max size segments on both sides
+        // the pointers can't run out of bounds here, so only the offset needs checking
+        if ((ptr_in - comp_start > 8 * 2) && (ptr_out - comp_start > 8 * CODE_SEG_SIZE(0xFFFF))) {
+            for (int i = 7; i >= 0; i--) {
+                if ((ctrlbyte >> i) & 0x1) {
+                    ptr_in -= 2;
+                    u16 seg_code = getle16(ptr_in);
+                    u32 seg_off = CODE_SEG_OFFSET(seg_code);
+                    u32 seg_len = CODE_SEG_SIZE(seg_code);
+                    if (ptr_out + seg_off >= data_end) return 1;
+
+                    // source is (seg_off + 1) byte above the destination
+                    ptr_out -= seg_len;
+                    if (seg_off + 1 >= seg_len) { // no overlap, copy at once
+                        memcpy(ptr_out, ptr_out + seg_off + 1, seg_len);
+                    } else for (u32 c = seg_len; c > 0; c--) {
+                        ptr_out[c-1] = ptr_out[c+seg_off];
+                    }
+                } else {
+                    *(--ptr_out) = *(--ptr_in);
+                }
+            }
+            continue;
+        }
+
         for (int i = 7; i >= 0; i--) {
             // end conditions met?
             if ((ptr_in <= comp_start) || (ptr_out <= comp_start))
@@ -101,26 +133,29 @@ u32 DecompressCodeLzss(u8* code, u32* code_size, u32 max_size) {
 }
 
 // see https://github.com/dnasdw/3dstool/blob/master/src/backwardlz77.cpp (GPLv3)
+// match finder: hash chains over 3 byte prefixes, most recent (= closest) first
+#define LZSS_WINDOW_SIZE    4098 // max match offset
+#define LZSS_CHAIN_SIZE     8192 // power of 2, > LZSS_WINDOW_SIZE
+#define LZSS_HASH_BITS      12
+#define LZSS_HASH(p)        (((((u32) *(p)) << 8) ^ (((u32) *((p) - 1)) << 4) ^ ((u32) *((p) - 2)) ^ \
+                             (((u32) *(p)) >> 4)) & ((1 << LZSS_HASH_BITS) - 1))
+#define LZSS_FAST_DEPTH     16 // max chain depth for fast compression
+
 typedef struct {
-    u16 WindowPos;
-    u16 WindowLen;
-    s16* OffsetTable;
-    s16* ReversedOffsetTable;
-    s16* ByteTable;
-    s16* EndTable;
+    const u8* pStart;
+    int nMaxDepth;
+    s32* HashTable; // latest position per hash
+    s32* ChainTable; // previous position for the same hash, indexed by position % LZSS_CHAIN_SIZE
 } sCompressInfo;
 
-void initTable(sCompressInfo* a_pInfo, void* a_pWork) {
-    a_pInfo->WindowPos = 0;
-    a_pInfo->WindowLen = 0;
-    a_pInfo->OffsetTable = (s16*)(a_pWork);
-    a_pInfo->ReversedOffsetTable = (s16*)(a_pWork) + 4098;
-    a_pInfo->ByteTable = (s16*)(a_pWork) + 4098 + 4098;
-    a_pInfo->EndTable = (s16*)(a_pWork) + 4098 + 4098 + 256;
-
-    for (int i = 0; i < 256; i++) {
-        a_pInfo->ByteTable[i] = -1;
-        a_pInfo->EndTable[i] = -1;
+void initTable(sCompressInfo* a_pInfo, void* a_pWork, const u8* a_pStart, int a_nMaxDepth) {
+    a_pInfo->pStart = a_pStart;
+    a_pInfo->nMaxDepth = a_nMaxDepth;
+    a_pInfo->HashTable = (s32*)(a_pWork);
+    a_pInfo->ChainTable = (s32*)(a_pWork) + (1 << LZSS_HASH_BITS);
+
+    for (int i = 0; i < (1 << LZSS_HASH_BITS); i++) {
+        a_pInfo->HashTable[i] = -1;
     }
 }
 
@@ -129,28 +164,30 @@ int search(sCompressInfo* a_pInfo, const u8* a_pSrc, int* a_nOffset, int a_nMaxS
         return 0;
     }
 
-    const u8* pSearch = NULL;
+    // the match ends at the byte before a_pSrc and extends downwards
+    const u8* pStart = a_pInfo->pStart;
+    const s32 nPos = (s32)(a_pSrc - 1 - pStart);
+    const s32* pChainTable = a_pInfo->ChainTable;
     int nSize = 2;
-    const u16 uWindowPos = a_pInfo->WindowPos;
-    const u16 uWindowLen = a_pInfo->WindowLen;
-    s16* pReversedOffsetTable = a_pInfo->ReversedOffsetTable;
+    int nDepth = a_pInfo->nMaxDepth;
 
-    for (s16 nOffset = a_pInfo->EndTable[*(a_pSrc - 1)]; nOffset != -1; nOffset = pReversedOffsetTable[nOffset]) {
-        if (nOffset < uWindowPos) {
-            pSearch = a_pSrc + uWindowPos - nOffset;
-        } else {
-            pSearch = a_pSrc + uWindowLen + uWindowPos - nOffset;
+    for (s32 nCandidate = a_pInfo->HashTable[LZSS_HASH(a_pSrc - 1)]; nCandidate != -1; nCandidate = pChainTable[nCandidate % LZSS_CHAIN_SIZE]) {
+        int nOffset = nCandidate - nPos;
+        if (nOffset > LZSS_WINDOW_SIZE) {
+            break;
         }
 
-        if (pSearch - a_pSrc < 3) {
+        if (nOffset < 3) {
             continue;
         }
 
-        if (*(pSearch - 2) != *(a_pSrc - 2) || *(pSearch - 3) != *(a_pSrc - 3)) {
+        const u8* pSearch = pStart + nCandidate + 1;
+        if (*(pSearch - 1) != *(a_pSrc - 1) || *(pSearch - 2) != *(a_pSrc - 2) || *(pSearch - 3) != *(a_pSrc - 3)) {
+            if (nDepth && !--nDepth) break;
             continue;
         }
 
-        int nMaxSize = (int)((s64)min(a_nMaxSize, pSearch - a_pSrc));
+        int nMaxSize = min(a_nMaxSize, nOffset);
         int nCurrentSize = 3;
 
         while (nCurrentSize < nMaxSize && *(pSearch - nCurrentSize - 1) == *(a_pSrc - nCurrentSize - 1)) {
@@ -159,11 +196,15 @@ int search(sCompressInfo* a_pInfo, const u8* a_pSrc, int* a_nOffset, int a_nMaxS
 
         if (nCurrentSize > nSize) {
             nSize = nCurrentSize;
-            *a_nOffset = (int)(pSearch - a_pSrc);
+            *a_nOffset = nOffset;
             if (nSize == a_nMaxSize) {
                 break;
             }
         }
+
+        if (nDepth && !--nDepth) {
+            break;
+        }
     }
 
     if (nSize < 3) {
@@ -173,52 +214,20 @@ int search(sCompressInfo* a_pInfo, const u8* a_pSrc, int* a_nOffset, int a_nMaxS
     return nSize;
 }
 
-void slideByte(sCompressInfo* a_pInfo, const u8* a_pSrc) {
-    u8 uInData = *(a_pSrc - 1);
-    u16 uInsertOffset = 0;
-    const u16 uWindowPos = a_pInfo->WindowPos;
-    const u16 uWindowLen = a_pInfo->WindowLen;
-    s16* pOffsetTable = a_pInfo->OffsetTable;
-    s16* pReversedOffsetTable = a_pInfo->ReversedOffsetTable;
-    s16* pByteTable = a_pInfo->ByteTable;
-    s16* pEndTable = a_pInfo->EndTable;
-
-    if (uWindowLen == 4098) {
-        u8 uOutData = *(a_pSrc + 4097);
-
-        if ((pByteTable[uOutData] = pOffsetTable[pByteTable[uOutData]]) == -1) {
-            pEndTable[uOutData] = -1;
-        } else {
-            pReversedOffsetTable[pByteTable[uOutData]] = -1;
-        }
-
-        uInsertOffset = uWindowPos;
-    } else {
-        uInsertOffset = uWindowLen;
-    }
-
-    s16 nOffset = pEndTable[uInData];
-
-    if (nOffset == -1) {
-        pByteTable[uInData] = uInsertOffset;
-    } else {
-        pOffsetTable[nOffset] = uInsertOffset;
-    }
-
-    pEndTable[uInData] = uInsertOffset;
-    pOffsetTable[uInsertOffset] = -1;
-    pReversedOffsetTable[uInsertOffset] = nOffset;
-
-    if (uWindowLen == 4098) {
-        a_pInfo->WindowPos = (uWindowPos + 1) % 4098;
-    } else {
-        a_pInfo->WindowLen++;
-    }
-}
-
 static inline void slide(sCompressInfo* a_pInfo, const u8* a_pSrc, int a_nSize) {
+    // insert the bytes below a_pSrc into the hash chains
+    s32* pHashTable = a_pInfo->HashTable;
+    s32* pChainTable = a_pInfo->ChainTable;
     for (int i = 0; i < a_nSize; i++) {
-        slideByte(a_pInfo, a_pSrc--);
+        const u8* pByte = --a_pSrc;
+        s32 nPos = (s32)(pByte - a_pInfo->pStart);
+        if (nPos < 2) {
+            break; // too close to the start to be a match source
+        }
+
+        u32 uHash = LZSS_HASH(pByte);
+        pChainTable[nPos % LZSS_CHAIN_SIZE] = pHashTable[uHash];
+        pHashTable[uHash] = nPos;
     }
 }
 
@@ -226,8 +235,8 @@ s64 alignBytes(s64 a_nData, s64 a_nAlignment) {
     return (a_nData + a_nAlignment - 1) / a_nAlignment * a_nAlignment;
 }
 
-bool CompressCodeLzss(const u8* a_pUncompressed, u32 a_uUncompressedSize, u8* a_pCompressed, u32* a_uCompressedSize) {
-    const int s_nCompressWorkSize = (4098 + 4098 + 256 + 256) * sizeof(s16);
+bool CompressCodeLzss(const u8* a_pUncompressed, u32 a_uUncompressedSize, u8* a_pCompressed, u32* a_uCompressedSize, u32 a_uLevel) {
+    const int s_nCompressWorkSize = ((1 << LZSS_HASH_BITS) + LZSS_CHAIN_SIZE) * sizeof(s32);
     bool bResult = true;
 
     if (a_uUncompressedSize > sizeof(CodeLzssFooter) && *a_uCompressedSize >= a_uUncompressedSize) {
@@ -236,7 +245,7 @@ bool CompressCodeLzss(const u8* a_pUncompressed, u32 a_uUncompressedSize, u8* a_
 
         do {
             sCompressInfo info;
-            initTable(&info, pWork);
+            initTable(&info, pWork, a_pUncompressed, (a_uLevel == CODE_LZSS_FAST) ? LZSS_FAST_DEPTH : 0);
 
             const int nMaxSize = 0xF + 3;
             const u8* pSrc = a_pUncompressed + a_uUncompressedSize;
@@ -291,7 +300,8 @@ bool CompressCodeLzss(const u8* a_pUncompressed, u32 a_uUncompressedSize, u8* a_
                 }
             }
 
-            if (!bResult) {
+            if (!bResult || (pSrc - a_pUncompressed > 0)) { // output buffer exhausted
+                bResult = false;
                 break;
             }
 
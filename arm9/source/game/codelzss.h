@@ -4,6 +4,10 @@
 
 #define EXEFS_CODE_NAME  ".code"
 
+// compression levels for CompressCodeLzss()
+#define CODE_LZSS_BEST   0 // exhaustive search of the window
+#define CODE_LZSS_FAST   1 // bounded match search
+
 u32 GetCodeLzssUncompressedSize(void* footer, u32 comp_size);
 u32 DecompressCodeLzss(u8* code, u32* code_size, u32 max_size);
-bool CompressCodeLzss(const u8* a_pUncompressed, u32 a_uUncompressedSize, u8* a_pCompressed, u32* a_uCompressedSize);
+bool CompressCodeLzss(const u8* a_pUncompressed, u32 a_uUncompressedSize, u8* a_pCompressed, u32* a_uCompressedSize, u32 a_uLevel);
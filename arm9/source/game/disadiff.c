@@ -5,6 +5,18 @@
 
 #define GET_DPFS_BIT(b, lvl) (((((u32*) (void*) lvl)[b >> 5]) >> (31 - (b % 32))) & 1)
 
+#define GET_DIRTY_BIT(b, map) (((map)[(b) >> 3] >> ((b) & 7)) & 1)
+#define SET_DIRTY_BIT(b, map) ((map)[(b) >> 3] |= (1 << ((b) & 7)))
+
+#define IVFC_LVL_OFFSET(info, lvl)  ((&((info)->offset_ivfc_lvl1))[(lvl) - 1])
+#define IVFC_LVL_SIZE(info, lvl)    ((&((info)->size_ivfc_lvl1))[(lvl) - 1])
+#define IVFC_LVL_LOG(info, lvl)     ((&((info)->log_ivfc_lvl1))[(lvl) - 1])
+#define IVFC_LVL_BLOCKS(info, lvl)  ((IVFC_LVL_SIZE(info, lvl) + (1 << IVFC_LVL_LOG(info, lvl)) - 1) >> IVFC_LVL_LOG(info, lvl))
+
+#define IVFC_HASH_CHUNK     0x10000 // dirty lvl4 blocks are read in chunks of this size
+
+#define DISADIFF_POOL_SIZE  4 // certs.db, seed save, title.db... SysNAND and EmuNAND
+
 typedef struct {
     u8  magic[8]; // "DISA" 0x00040000
     u32 n_partitions;
@@ -98,6 +110,20 @@ typedef struct {
     u8 padding[4]; // all zeroes when encrypted
 } PACKED_STRUCT DifiStruct;
 
+// parsed DISA/DIFF files, keyed by path
+// contexts never keep the file open, so FatFs file locks (FF_FS_LOCK) are only held during an access
+typedef struct {
+    char path[256]; // empty -> unused
+    FSIZE_t fsize; // size / timestamp, to notice a changed file
+    WORD fdate;
+    WORD ftime;
+    u32 tick;
+    DisaDiffRWInfo info; // owns the DPFS lvl2 cache
+    DisaDiffDirtyMap dirty; // pending hash chain fixes, see FlushDisaDiffPool()
+} DisaDiffContext;
+
+static DisaDiffContext ddpool[DISADIFF_POOL_SIZE] = { 0 };
+
 static FIL ddfile;
 static FIL* ddfp = NULL;
 
@@ -289,9 +315,16 @@ u32 GetDisaDiffRWInfo(const char* path, DisaDiffRWInfo* info, bool partitionB) {
     return 0;
 }
 
+u32 GetDisaDiffDpfsLvl2CacheSize(const DisaDiffRWInfo* info) {
+    // lvl2 bitmap plus room for the worst case lvl3 run table (one run per lvl3 block)
+    const u32 n_blocks_lvl3 = (info->size_dpfs_lvl3 + (1 << info->log_dpfs_lvl3) - 1) >> info->log_dpfs_lvl3;
+    return align(info->size_dpfs_lvl2, 4) + (n_blocks_lvl3 * sizeof(u32));
+}
+
 u32 BuildDisaDiffDpfsLvl2Cache(const char* path, const DisaDiffRWInfo* info, u8* cache, u32 cache_size) {
     const u32 min_cache_bits = (info->size_dpfs_lvl3 + (1 << info->log_dpfs_lvl3) - 1) >> info->log_dpfs_lvl3;
     const u32 min_cache_size = ((min_cache_bits + 31) >> (3 + 2)) << 2;
+    const u32 offset_runs = align(info->size_dpfs_lvl2, 4);
     const u32 offset_lvl1 = info->offset_dpfs_lvl1 + ((info->dpfs_lvl1_selector) ? info->size_dpfs_lvl1 : 0);
 
     // safety (this still assumes all the checks from GetDisaDiffRWInfo())
@@ -326,92 +359,101 @@ u32 BuildDisaDiffDpfsLvl2Cache(const char* path, const DisaDiffRWInfo* info, u8*
         for (u32 b = 0; b < 32; b++) {
             if ((dword >> (31 - b)) & 1) {
                 u32 offset = ((i << 3) + b) << log_lvl2;
-                if (DisaDiffRead((u8*) cache + offset, 1 << log_lvl2, offset_lvl2_1 + offset) != FR_OK) ret = 1;
+                if (offset >= info->size_dpfs_lvl2) break; // don't run over the cache
+                u32 size = min((u32) 1 << log_lvl2, info->size_dpfs_lvl2 - offset); // last block may be partial
+                if (DisaDiffRead((u8*) cache + offset, size, offset_lvl2_1 + offset) != FR_OK) ret = 1;
             }
         }
     }
 
     ((DisaDiffRWInfo*) info)->dpfs_lvl2_cache = cache;
+    ((DisaDiffRWInfo*) info)->dpfs_lvl3_runs = NULL;
+    ((DisaDiffRWInfo*) info)->n_dpfs_lvl3_runs = 0;
+
+    // lvl3 run table, stored behind the bitmap if there is room for it
+    // runs alternate between both lvl3 copies, each entry is the (exclusive) end block of a run
+    if ((ret == 0) && min_cache_bits && (cache_size >= offset_runs + (min_cache_bits * sizeof(u32)))) {
+        u32* runs = (u32*) (void*) (cache + offset_runs);
+        u32 n_runs = 0;
+        u32 bit_state = GET_DPFS_BIT(0, cache);
+        for (u32 b = 1; b < min_cache_bits; b++) {
+            if (GET_DPFS_BIT(b, cache) == bit_state) continue;
+            runs[n_runs++] = b;
+            bit_state = ~bit_state & 0x1;
+        }
+        runs[n_runs++] = min_cache_bits;
+        ((DisaDiffRWInfo*) info)->dpfs_lvl3_runs = runs;
+        ((DisaDiffRWInfo*) info)->n_dpfs_lvl3_runs = n_runs;
+    }
+
     free(lvl1);
     DisaDiffClose();
     return ret;
 }
 
-static u32 ReadDisaDiffDpfsLvl3(const DisaDiffRWInfo* info, u32 offset, u32 size, void* buffer) { // assumes file is already open
-    const u32 offset_start = offset;
-    const u32 offset_end = offset_start + size;
+// size of the contiguous lvl3 run starting at offset (clipped to offset_end), bit_state: lvl3 copy in use
+static u32 GetDisaDiffDpfsLvl3Run(const DisaDiffRWInfo* info, u32 offset, u32 offset_end, u32* bit_state) {
     const u8* lvl2 = info->dpfs_lvl2_cache;
+    const u32* runs = info->dpfs_lvl3_runs;
+    const u32 log_lvl3 = info->log_dpfs_lvl3;
+    const u32 idx_lvl2 = offset >> log_lvl3;
+    u32 run_end;
+
+    *bit_state = GET_DPFS_BIT(idx_lvl2, lvl2);
+    if (runs && (idx_lvl2 < runs[info->n_dpfs_lvl3_runs - 1])) {
+        // binary search for the first run ending behind idx_lvl2
+        u32 lo = 0;
+        u32 hi = info->n_dpfs_lvl3_runs - 1;
+        while (lo < hi) {
+            u32 mid = (lo + hi) >> 1;
+            if (runs[mid] > idx_lvl2) hi = mid;
+            else lo = mid + 1;
+        }
+        run_end = runs[lo];
+    } else { // no run table, walk the bitmap
+        run_end = idx_lvl2 + 1;
+        while (((run_end << log_lvl3) < offset_end) && (GET_DPFS_BIT(run_end, lvl2) == *bit_state))
+            run_end++;
+    }
+
+    return min(run_end << log_lvl3, offset_end) - offset;
+}
+
+static u32 ReadDisaDiffDpfsLvl3(const DisaDiffRWInfo* info, u32 offset, u32 size, void* buffer) { // assumes file is already open
+    const u32 offset_end = offset + size;
     const u32 offset_lvl3_0 = info->offset_dpfs_lvl3;
     const u32 offset_lvl3_1 = offset_lvl3_0 + info->size_dpfs_lvl3;
-    const u32 log_lvl3 = info->log_dpfs_lvl3;
 
-    u32 read_start = offset_start;
-    u32 read_end = read_start;
-    u32 bit_state = 0;
-
-    // full reading below
-    while (size && (read_start < offset_end)) {
-        // read bits until bit_state does not match
-        // idx_lvl2 is a bit offset
-        u32 idx_lvl2 = read_end >> log_lvl3;
-        if (GET_DPFS_BIT(idx_lvl2, lvl2) == bit_state) {
-            read_end = (idx_lvl2+1) << log_lvl3;
-            if (read_end >= offset_end) read_end = offset_end;
-            else continue;
-        }
-        // read data if there is any
-        if (read_start < read_end) {
-            const u32 pos_f = (bit_state ? offset_lvl3_1 : offset_lvl3_0) + read_start;
-            const u32 pos_b = read_start - offset_start;
-            const u32 btr = read_end - read_start;
-            if (DisaDiffRead(((u8*) buffer) + pos_b, btr, pos_f) != FR_OK) size = 0;
-            read_start = read_end;
-        }
-        // flip the bit_state
-        bit_state = ~bit_state & 0x1;
+    // one read per contiguous run
+    for (u32 pos = offset; size && (pos < offset_end);) {
+        u32 bit_state;
+        u32 btr = GetDisaDiffDpfsLvl3Run(info, pos, offset_end, &bit_state);
+        if (DisaDiffRead(((u8*) buffer) + (pos - offset), btr, (bit_state ? offset_lvl3_1 : offset_lvl3_0) + pos) != FR_OK)
+            size = 0;
+        pos += btr;
     }
 
     return size;
 }
 
 static u32 WriteDisaDiffDpfsLvl3(const DisaDiffRWInfo* info, u32 offset, u32 size, const void* buffer) { // assumes file is already open, does not fix hashes
-    const u32 offset_start = offset;
-    const u32 offset_end = offset_start + size;
-    const u8* lvl2 = info->dpfs_lvl2_cache;
+    const u32 offset_end = offset + size;
     const u32 offset_lvl3_0 = info->offset_dpfs_lvl3;
     const u32 offset_lvl3_1 = offset_lvl3_0 + info->size_dpfs_lvl3;
-    const u32 log_lvl3 = info->log_dpfs_lvl3;
 
-    u32 write_start = offset_start;
-    u32 write_end = write_start;
-    u32 bit_state = 0;
-
-    // full reading below
-    while (size && (write_start < offset_end)) {
-        // write bits until bit_state does not match
-        // idx_lvl2 is a bit offset
-        u32 idx_lvl2 = write_end >> log_lvl3;
-        if (GET_DPFS_BIT(idx_lvl2, lvl2) == bit_state) {
-            write_end = (idx_lvl2+1) << log_lvl3;
-            if (write_end >= offset_end) write_end = offset_end;
-            else continue;
-        }
-        // write data if there is any
-        if (write_start < write_end) {
-            const u32 pos_f = (bit_state ? offset_lvl3_1 : offset_lvl3_0) + write_start;
-            const u32 pos_b = write_start - offset_start;
-            const u32 btw = write_end - write_start;
-            if (DisaDiffWrite(((u8*) buffer) + pos_b, btw, pos_f) != FR_OK) size = 0;
-            write_start = write_end;
-        }
-        // flip the bit_state
-        bit_state = ~bit_state & 0x1;
+    // one write per contiguous run
+    for (u32 pos = offset; size && (pos < offset_end);) {
+        u32 bit_state;
+        u32 btw = GetDisaDiffDpfsLvl3Run(info, pos, offset_end, &bit_state);
+        if (DisaDiffWrite(((const u8*) buffer) + (pos - offset), btw, (bit_state ? offset_lvl3_1 : offset_lvl3_0) + pos) != FR_OK)
+            size = 0;
+        pos += btw;
     }
 
     return size;
 }
 
-u32 FixDisaDiffPartitionHash(const DisaDiffRWInfo* info) {
+static u32 FixDisaDiffPartitionHash(const DisaDiffRWInfo* info) { // assumes file is already open
     const u32 size = info->size_table;
     u8 sha_buf[0x20];
     u8* buf;
@@ -434,75 +476,255 @@ u32 FixDisaDiffPartitionHash(const DisaDiffRWInfo* info) {
     return 0;
 }
 
-u32 FixDisaDiffIvfcLevel(const DisaDiffRWInfo* info, u32 level, u32 offset, u32 size, u32* next_offset, u32* next_size) {
-    if (level == 0)
-        return FixDisaDiffPartitionHash(info);
-
-    if (level > 4)
-        return 1;
-
-    const u32 offset_ivfc_lvl = (&(info->offset_ivfc_lvl1))[level - 1];
-    const u32 size_ivfc_lvl = (&(info->size_ivfc_lvl1))[level - 1];
-    const u32 log_ivfc_lvl = (&(info->log_ivfc_lvl1))[level - 1];
-    const u32 block_size = 1 << log_ivfc_lvl;
-    u32 read_size = block_size;
-    u32 align_offset = (offset >> log_ivfc_lvl) << log_ivfc_lvl; // align starting offset
-    u32 align_size = size + offset - align_offset; // increase size by the amount starting offset decreased when aligned
-
-    if (level != 1) {
-        if (next_offset) *next_offset = (align_offset >> log_ivfc_lvl) * 0x20;
-        if (next_size) *next_size = ((align_size >> log_ivfc_lvl) + (((align_size % block_size) == 0) ? 0 : 1)) * 0x20;
+// rehash all dirty lvl4 blocks and everything above them, upper levels (1...3) are kept in memory,
+// only touched hash blocks are recomputed and written back (assumes file is already open)
+static u32 FixDisaDiffIvfcChainWorker(const DisaDiffRWInfo* info, const DisaDiffDirtyMap* dirty) {
+    u8* lvl[4] = { NULL };
+    u8* dirty_lvl[5] = { NULL };
+    u32 size_upper = 0;
+    u32 size_dirty = 0;
+    u32 size_chunk = IVFC_HASH_CHUNK;
+
+    for (u32 l = 1; l <= 4; l++) {
+        if (l < 4) {
+            size_upper += IVFC_LVL_SIZE(info, l);
+            size_dirty += (IVFC_LVL_BLOCKS(info, l) + 7) >> 3;
+        }
+        size_chunk = max(size_chunk, (u32) 1 << IVFC_LVL_LOG(info, l));
     }
 
-    u8 sha_buf[0x20];
-    u8* buf;
+    // one allocation: upper levels, dirty maps for upper levels, chunk buffer
+    u8* buffer = (u8*) malloc(size_upper + size_dirty + size_chunk);
+    if (!buffer) return 1;
+    u8* chunk = buffer + size_upper + size_dirty;
+    lvl[1] = buffer;
+    dirty_lvl[1] = buffer + size_upper;
+    for (u32 l = 2; l <= 3; l++) {
+        lvl[l] = lvl[l-1] + IVFC_LVL_SIZE(info, l-1);
+        dirty_lvl[l] = dirty_lvl[l-1] + ((IVFC_LVL_BLOCKS(info, l-1) + 7) >> 3);
+    }
+    dirty_lvl[4] = dirty->bitmap;
+    memset(dirty_lvl[1], 0, size_dirty);
 
-    if (!(buf = malloc(block_size)))
-        return 1;
+    // read upper levels to memory
+    u32 ret = 0;
+    for (u32 l = 1; (l <= 3) && (ret == 0); l++)
+        if (ReadDisaDiffDpfsLvl3(info, IVFC_LVL_OFFSET(info, l), IVFC_LVL_SIZE(info, l), lvl[l]) != IVFC_LVL_SIZE(info, l))
+            ret = 1;
+
+    // lvl4: hash dirty blocks, contiguous dirty blocks are read in one go
+    const u32 log_lvl4 = IVFC_LVL_LOG(info, 4);
+    const u32 size_lvl4 = IVFC_LVL_SIZE(info, 4);
+    for (u32 i = 0; (i < dirty->n_blocks) && (ret == 0);) {
+        if (!GET_DIRTY_BIT(i, dirty->bitmap)) {
+            i++;
+            continue;
+        }
+        u32 n = 1;
+        while ((i + n < dirty->n_blocks) && GET_DIRTY_BIT(i + n, dirty->bitmap) &&
+            (((n + 1) << log_lvl4) <= size_chunk)) n++;
+        u32 offset = i << log_lvl4;
+        u32 size = min(n << log_lvl4, size_lvl4 - offset);
+        memset(chunk, 0, n << log_lvl4);
+        if ((info->ivfc_use_extlvl4) ? (DisaDiffRead(chunk, size, info->offset_ivfc_lvl4 + offset) != FR_OK) :
+            (ReadDisaDiffDpfsLvl3(info, info->offset_ivfc_lvl4 + offset, size, chunk) != size)) {
+            ret = 1;
+            break;
+        }
+        for (u32 k = 0; k < n; k++, i++) {
+            if ((i + 1) * 0x20 > IVFC_LVL_SIZE(info, 3)) {
+                ret = 1;
+                break;
+            }
+            sha_quick(lvl[3] + (i * 0x20), chunk + (k << log_lvl4), 1 << log_lvl4, SHA256_MODE);
+            SET_DIRTY_BIT((i * 0x20) >> IVFC_LVL_LOG(info, 3), dirty_lvl[3]);
+        }
+    }
 
-    while (align_size > 0) {
-        if (align_offset + block_size > size_ivfc_lvl) {
-            memset(buf, 0, block_size);
-            read_size -= (align_offset + block_size - size_ivfc_lvl);
+    // lvl3 ... lvl1: hash dirty blocks from memory, into the level above (or the master hash)
+    for (u32 l = 3; (l >= 1) && (ret == 0); l--) {
+        const u32 log_lvl = IVFC_LVL_LOG(info, l);
+        const u32 size_lvl = IVFC_LVL_SIZE(info, l);
+        for (u32 j = 0; (j < IVFC_LVL_BLOCKS(info, l)) && (ret == 0); j++) {
+            if (!GET_DIRTY_BIT(j, dirty_lvl[l])) continue;
+            u8 sha_buf[0x20];
+            u32 offset = j << log_lvl;
+            memset(chunk, 0, 1 << log_lvl);
+            memcpy(chunk, lvl[l] + offset, min((u32) 1 << log_lvl, size_lvl - offset));
+            sha_quick(sha_buf, chunk, 1 << log_lvl, SHA256_MODE);
+            if (l == 1) {
+                if (DisaDiffWrite(sha_buf, 0x20, info->offset_difi + info->offset_master_hash + (j * 0x20)) != FR_OK)
+                    ret = 1;
+            } else if ((j + 1) * 0x20 > IVFC_LVL_SIZE(info, l-1)) {
+                ret = 1;
+            } else {
+                memcpy(lvl[l-1] + (j * 0x20), sha_buf, 0x20);
+                SET_DIRTY_BIT((j * 0x20) >> IVFC_LVL_LOG(info, l-1), dirty_lvl[l-1]);
+            }
         }
+        if (l == 1) break;
+    }
 
-        if (((level == 4) && info->ivfc_use_extlvl4) ? (DisaDiffRead(buf, read_size, align_offset + offset_ivfc_lvl) != FR_OK) :
-            (ReadDisaDiffDpfsLvl3(info, align_offset + offset_ivfc_lvl, read_size, buf) != read_size)) {
-            free(buf);
-            return 1;
+    // write back touched blocks of the upper levels
+    for (u32 l = 1; (l <= 3) && (ret == 0); l++) {
+        const u32 log_lvl = IVFC_LVL_LOG(info, l);
+        const u32 n_blocks = IVFC_LVL_BLOCKS(info, l);
+        for (u32 j = 0; (j < n_blocks) && (ret == 0);) {
+            if (!GET_DIRTY_BIT(j, dirty_lvl[l])) {
+                j++;
+                continue;
+            }
+            u32 n = 1;
+            while ((j + n < n_blocks) && GET_DIRTY_BIT(j + n, dirty_lvl[l])) n++;
+            u32 offset = j << log_lvl;
+            u32 size = min(n << log_lvl, IVFC_LVL_SIZE(info, l) - offset);
+            if (WriteDisaDiffDpfsLvl3(info, IVFC_LVL_OFFSET(info, l) + offset, size, lvl[l] + offset) != size)
+                ret = 1;
+            j += n;
         }
+    }
 
-        sha_quick(sha_buf, buf, block_size, SHA256_MODE);
+    free(buffer);
+    return ret;
+}
 
+u32 InitDisaDiffDirtyMap(DisaDiffDirtyMap* dirty, const DisaDiffRWInfo* info) {
+    dirty->n_blocks = IVFC_LVL_BLOCKS(info, 4);
+    dirty->n_dirty = 0;
+    dirty->bitmap = (u8*) malloc((dirty->n_blocks + 7) >> 3);
+    if (!dirty->bitmap) return 1;
+    memset(dirty->bitmap, 0, (dirty->n_blocks + 7) >> 3);
+    return 0;
+}
 
-        if ((level == 1) ? (DisaDiffWrite(sha_buf, 0x20, info->offset_difi + info->offset_master_hash + ((align_offset >> log_ivfc_lvl) * 0x20)) != FR_OK) :
-            (WriteDisaDiffDpfsLvl3(info, (&(info->offset_ivfc_lvl1))[level - 2] + ((align_offset >> log_ivfc_lvl) * 0x20), 0x20, sha_buf) != 0x20)) {
-            free(buf);
-            return 1;
+void FreeDisaDiffDirtyMap(DisaDiffDirtyMap* dirty) {
+    if (dirty->bitmap) free(dirty->bitmap);
+    memset(dirty, 0, sizeof(DisaDiffDirtyMap));
+}
+
+void MarkDisaDiffDirty(DisaDiffDirtyMap* dirty, const DisaDiffRWInfo* info, u32 offset, u32 size) {
+    if (!size || !dirty->bitmap) return;
+    u32 first = offset >> info->log_ivfc_lvl4;
+    u32 last = (offset + size - 1) >> info->log_ivfc_lvl4;
+    for (u32 i = first; (i <= last) && (i < dirty->n_blocks); i++) {
+        if (GET_DIRTY_BIT(i, dirty->bitmap)) continue;
+        SET_DIRTY_BIT(i, dirty->bitmap);
+        dirty->n_dirty++;
+    }
+}
+
+u32 FixDisaDiffIvfcChain(const char* path, const DisaDiffRWInfo* info, DisaDiffDirtyMap* dirty, bool fix_partition_hash) {
+    if (!dirty->n_dirty && !fix_partition_hash) return 0;
+    if (DisaDiffOpen(path) != FR_OK) return 1;
+
+    u32 ret = 0;
+    if (dirty->n_dirty && (FixDisaDiffIvfcChainWorker(info, dirty) != 0)) ret = 1;
+    else if (fix_partition_hash && (FixDisaDiffPartitionHash(info) != 0)) ret = 1;
+
+    DisaDiffClose();
+    if (ret == 0) {
+        memset(dirty->bitmap, 0, (dirty->n_blocks + 7) >> 3);
+        dirty->n_dirty = 0;
+    }
+    return ret;
+}
+
+static void FreeDisaDiffContext(DisaDiffContext* ctx) {
+    if (ctx->info.dpfs_lvl2_cache) free(ctx->info.dpfs_lvl2_cache);
+    FreeDisaDiffDirtyMap(&(ctx->dirty));
+    memset(ctx, 0, sizeof(DisaDiffContext));
+}
+
+static void SyncDisaDiffContextStat(DisaDiffContext* ctx) { // call after writing to the file
+    FILINFO fno;
+    if (fvx_stat(ctx->path, &fno) != FR_OK) {
+        FreeDisaDiffContext(ctx);
+        return;
+    }
+    ctx->fsize = fno.fsize;
+    ctx->fdate = fno.fdate;
+    ctx->ftime = fno.ftime;
+}
+
+static u32 FlushDisaDiffContext(DisaDiffContext* ctx) {
+    if (!*(ctx->path) || !ctx->dirty.n_dirty) return 0;
+    u32 ret = FixDisaDiffIvfcChain(ctx->path, &(ctx->info), &(ctx->dirty), true);
+    SyncDisaDiffContextStat(ctx);
+    return ret;
+}
+
+static DisaDiffContext* GetDisaDiffContext(const char* path) {
+    static u32 tick = 0;
+    DisaDiffContext* ctx = NULL;
+    FILINFO fno;
+
+    if (!path || (strnlen(path, 256) >= 256) || (fvx_stat(path, &fno) != FR_OK))
+        return NULL;
+
+    // already known and unchanged?
+    for (u32 i = 0; i < DISADIFF_POOL_SIZE; i++) {
+        if (strncmp(ddpool[i].path, path, 256) != 0) continue;
+        ctx = &(ddpool[i]);
+        if ((ctx->fsize == fno.fsize) && (ctx->fdate == fno.fdate) && (ctx->ftime == fno.ftime)) {
+            ctx->tick = ++tick;
+            return ctx;
         }
+        FreeDisaDiffContext(ctx); // changed behind our back, pending fixes are void
+        break;
+    }
 
-        align_offset += block_size;
-        align_size = ((align_size < block_size) ? 0 : (align_size - block_size));
+    // pick either a free slot or the least recently used one
+    if (!ctx) {
+        for (u32 i = 0; i < DISADIFF_POOL_SIZE; i++) {
+            DisaDiffContext* c = &(ddpool[i]);
+            if (!ctx || (*(ctx->path) && (!*(c->path) || (c->tick < ctx->tick))))
+                ctx = c;
+        }
+        if (*(ctx->path)) {
+            FlushDisaDiffContext(ctx);
+            FreeDisaDiffContext(ctx);
+        }
     }
 
-    free(buf);
+    // parse the file
+    DisaDiffRWInfo* info = &(ctx->info);
+    if ((GetDisaDiffRWInfo(path, info, false) != 0) ||
+        !(info->dpfs_lvl2_cache = (u8*) malloc(GetDisaDiffDpfsLvl2CacheSize(info))) ||
+        (BuildDisaDiffDpfsLvl2Cache(path, info, info->dpfs_lvl2_cache, GetDisaDiffDpfsLvl2CacheSize(info)) != 0) ||
+        (InitDisaDiffDirtyMap(&(ctx->dirty), info) != 0)) {
+        FreeDisaDiffContext(ctx);
+        return NULL;
+    }
 
-    return 0;
+    strncpy(ctx->path, path, 256);
+    ctx->fsize = fno.fsize;
+    ctx->fdate = fno.fdate;
+    ctx->ftime = fno.ftime;
+    ctx->tick = ++tick;
+    return ctx;
+}
+
+u32 FlushDisaDiffPool(const char* path) {
+    u32 ret = 0;
+    for (u32 i = 0; i < DISADIFF_POOL_SIZE; i++) {
+        if (path && (strncmp(ddpool[i].path, path, 256) != 0)) continue;
+        if (FlushDisaDiffContext(&(ddpool[i])) != 0) ret = 1;
+    }
+    return ret;
+}
+
+void FreeDisaDiffPool(void) {
+    FlushDisaDiffPool(NULL);
+    for (u32 i = 0; i < DISADIFF_POOL_SIZE; i++)
+        FreeDisaDiffContext(&(ddpool[i]));
 }
 
 u32 ReadDisaDiffIvfcLvl4(const char* path, const DisaDiffRWInfo* info, u32 offset, u32 size, void* buffer) { // offset: offset inside IVFC lvl4
-    // DisaDiffRWInfo not provided?
-    DisaDiffRWInfo info_l;
-    u8* cache = NULL;
+    // DisaDiffRWInfo not provided? -> get it from the pool
     if (!info) {
-        info = &info_l;
-        if (GetDisaDiffRWInfo(path, (DisaDiffRWInfo*) info, false) != 0) return 0;
-        cache = malloc(info->size_dpfs_lvl2);
-        if (!cache) return 0;
-        if (BuildDisaDiffDpfsLvl2Cache(path, info, cache, info->size_dpfs_lvl2) != 0) {
-            free(cache);
-            return 0;
-        }
+        DisaDiffContext* ctx = GetDisaDiffContext(path);
+        if (!ctx) return 0;
+        info = &(ctx->info);
     }
 
     // open file pointer
@@ -521,25 +743,16 @@ u32 ReadDisaDiffIvfcLvl4(const char* path, const DisaDiffRWInfo* info, u32 offse
     }
 
     DisaDiffClose();
-    if (cache) free(cache);
     return size;
 }
 
 u32 WriteDisaDiffIvfcLvl4(const char* path, const DisaDiffRWInfo* info, u32 offset, u32 size, const void* buffer) { // offset: offset inside IVFC lvl4. cmac still needs fixed after calling this.
-    // DisaDiffRWInfo not provided?
-    DisaDiffRWInfo info_l;
-    u8* cache = NULL;
+    // DisaDiffRWInfo not provided? -> get it from the pool, hash chain is fixed on FlushDisaDiffPool()
+    DisaDiffContext* ctx = NULL;
     if (!info) {
-        info = &info_l;
-        if (GetDisaDiffRWInfo(path, (DisaDiffRWInfo*) info, false) != 0)
+        if (!(ctx = GetDisaDiffContext(path)))
             return 0;
-        cache = malloc(info->size_dpfs_lvl2);
-        if (!cache)
-            return 0;
-        if (BuildDisaDiffDpfsLvl2Cache(path, info, cache, info->size_dpfs_lvl2) != 0) {
-            free(cache);
-            return 0;
-        }
+        info = &(ctx->info);
     }
 
     // sanity check - offset & size
@@ -557,17 +770,21 @@ u32 WriteDisaDiffIvfcLvl4(const char* path, const DisaDiffRWInfo* info, u32 offs
         size = WriteDisaDiffDpfsLvl3(info, info->offset_ivfc_lvl4 + offset, size, buffer);
     }
 
-    if ((size != 0) && ddfp) { // if we're writing to a mounted image, the hash chain will be handled later by vdisadiff
-        u32 hashfix_offset = offset, hashfix_size = size;
-        for (int i = 4; i >= 0; i--) {
-            if (FixDisaDiffIvfcLevel(info, i, hashfix_offset, hashfix_size, &hashfix_offset, &hashfix_size) != 0) {
+    if ((size != 0) && ctx) {
+        MarkDisaDiffDirty(&(ctx->dirty), info, offset, size);
+    } else if ((size != 0) && ddfp) { // if we're writing to a mounted image, the hash chain will be handled later by vdisadiff
+        DisaDiffDirtyMap dirty;
+        if (InitDisaDiffDirtyMap(&dirty, info) != 0) size = 0;
+        else {
+            MarkDisaDiffDirty(&dirty, info, offset, size);
+            if ((FixDisaDiffIvfcChainWorker(info, &dirty) != 0) ||
+                (FixDisaDiffPartitionHash(info) != 0))
                 size = 0;
-                break;
-            }
         }
+        FreeDisaDiffDirtyMap(&dirty);
     }
 
     DisaDiffClose();
-    if (cache) free(cache);
+    if (ctx) SyncDisaDiffContextStat(ctx);
     return size;
 }
\ No newline at end of file
@@ -44,11 +44,29 @@ typedef struct {
     u8  dpfs_lvl1_selector;
     u8  ivfc_use_extlvl4;
     u8* dpfs_lvl2_cache; // optional, NULL when unused
+    u32* dpfs_lvl3_runs; // run table inside the lvl2 cache, NULL when unused
+    u32 n_dpfs_lvl3_runs;
 } __attribute__((packed)) DisaDiffRWInfo;
 
+// dirty IVFC lvl4 blocks, accumulated across writes and fixed in one go
+typedef struct {
+    u8* bitmap;
+    u32 n_blocks;
+    u32 n_dirty;
+} DisaDiffDirtyMap;
+
 u32 GetDisaDiffRWInfo(const char* path, DisaDiffRWInfo* info, bool partitionB);
+u32 GetDisaDiffDpfsLvl2CacheSize(const DisaDiffRWInfo* info);
 u32 BuildDisaDiffDpfsLvl2Cache(const char* path, const DisaDiffRWInfo* info, u8* cache, u32 cache_size);
 u32 ReadDisaDiffIvfcLvl4(const char* path, const DisaDiffRWInfo* info, u32 offset, u32 size, void* buffer);
 u32 WriteDisaDiffIvfcLvl4(const char* path, const DisaDiffRWInfo* info, u32 offset, u32 size, const void* buffer);
-// Not intended for external use other than vdisadiff
-u32 FixDisaDiffIvfcLevel(const DisaDiffRWInfo* info, u32 level, u32 offset, u32 size, u32* next_offset, u32* next_size);
\ No newline at end of file
+
+u32 InitDisaDiffDirtyMap(DisaDiffDirtyMap* dirty, const DisaDiffRWInfo* info);
+void FreeDisaDiffDirtyMap(DisaDiffDirtyMap* dirty);
+void MarkDisaDiffDirty(DisaDiffDirtyMap* dirty, const DisaDiffRWInfo* info, u32 offset, u32 size);
+u32 FixDisaDiffIvfcChain(const char* path, const DisaDiffRWInfo* info, DisaDiffDirtyMap* dirty, bool fix_partition_hash);
+
+// pool of parsed DISA/DIFF files, used when no DisaDiffRWInfo is provided
+// writes through the pool only get their hash chain fixed on flush (cmac still needs fixed after that)
+u32 FlushDisaDiffPool(const char* path);
+void FreeDisaDiffPool(void);
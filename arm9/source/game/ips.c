@@ -9,6 +9,9 @@
 #include "ui.h"
 #include "vff.h"
 
+#define IPS_PATCHBUF_SIZE   0x10000
+#define IPS_EOF_MARKER      0x454F46 // "EOF"
+
 typedef enum {
     IPS_OK,
     IPS_NOTTHIS,
@@ -21,14 +24,33 @@ typedef enum {
     IPS_MEMORY
 } IPSERROR;
 
-static FIL patchFile, inFile, outFile;
-static size_t patchSize;
-static u8 *patch;
-static u32 patchOffset;
+// buffered forward reader for the patch file
+typedef struct {
+    FIL* fp;
+    u8* buffer;
+    u32 pos; // read position inside the buffer
+    u32 len; // valid bytes in the buffer
+    u32 offset; // file offset of the buffer
+} IpsReader;
+
+// buffered sequential writer for the output file
+typedef struct {
+    FIL* fp;
+    u8* buffer;
+    u32 len; // bytes waiting to be written
+} IpsWriter;
 
-char errName[256];
+typedef struct {
+    FIL patchFile, inFile, outFile;
+    bool patchOpen, inOpen, outOpen;
+    IpsReader patch;
+    IpsWriter out;
+    u8* copybuf; // STD_BUFFER_SIZE, also backs the writer
+    const char* errName;
+} IpsContext;
 
-int displayError(int errcode) {
+static int displayError(IpsContext* ctx, int errcode) {
+    const char* errName = ctx->errName;
     switch(errcode) {
         case IPS_NOTTHIS:
             ShowPrompt(false, "%s\n%s", errName, STR_PATCH_MOST_LIKELY_NOT_FOR_THIS_FILE); break;
@@ -47,129 +69,195 @@ int displayError(int errcode) {
         case IPS_MEMORY:
             ShowPrompt(false, "%s\n%s", errName, STR_NOT_ENOUGH_MEMORY); break;
     }
-    fvx_close(&patchFile);
-    fvx_close(&inFile);
-    fvx_close(&outFile);
+    if (ctx->patchOpen) fvx_close(&ctx->patchFile);
+    if (ctx->inOpen) fvx_close(&ctx->inFile);
+    if (ctx->outOpen) fvx_close(&ctx->outFile);
+    if (ctx->patch.buffer) free(ctx->patch.buffer);
+    if (ctx->copybuf) free(ctx->copybuf);
     return errcode;
 }
 
-typedef enum {
-    COPY_IN,
-    COPY_PATCH,
-    COPY_RLE
-} COPYMODE;
-
-bool IPScopy(u8 mode, u32 size, u8 rle) {
-    bool ret = true;
-    if (mode == COPY_PATCH) {
-        UINT bytes_written = size;
-        if ((fvx_write(&outFile, &patch[patchOffset], size, &bytes_written) != FR_OK) ||
-            (size != bytes_written))
-            ret = false;
-        patchOffset += size;
-    } else {
-        u32 bufsiz = min(STD_BUFFER_SIZE, size);
-        u8* buffer = malloc(bufsiz);
-        if (!buffer) return false;
-        if (mode == COPY_RLE) memset(buffer, rle, bufsiz);
-
-        for (u64 pos = 0; (pos < size) && ret; pos += bufsiz) {
-            UINT read_bytes = min(bufsiz, size - pos);
-            UINT bytes_written = read_bytes;
-            if (((mode == COPY_IN) && (fvx_read(&inFile, buffer, read_bytes, &bytes_written) != FR_OK)) ||
-                ((mode == COPY_PATCH) && (fvx_read(&patchFile, buffer, read_bytes, &bytes_written) != FR_OK)) ||
-                (read_bytes != bytes_written))
-                ret = false;
-            if ((ret && (fvx_write(&outFile, buffer, read_bytes, &bytes_written) != FR_OK)) ||
-                (read_bytes != bytes_written))
-                ret = false;
-        }
+static void IPSreaderSeek(IpsReader* r, u32 offset) {
+    if ((offset >= r->offset) && (offset <= r->offset + r->len)) {
+        r->pos = offset - r->offset;
+    } else { // outside of the buffer, refill on next read
+        r->offset = offset;
+        r->pos = r->len = 0;
+    }
+}
+
+static u32 IPSreaderTell(IpsReader* r) {
+    return r->offset + r->pos;
+}
 
-        free(buffer);
+static bool IPSreaderFill(IpsReader* r) {
+    UINT br;
+    r->offset += r->pos;
+    r->pos = r->len = 0;
+    if ((fvx_lseek(r->fp, r->offset) != FR_OK) ||
+        (fvx_read(r->fp, r->buffer, IPS_PATCHBUF_SIZE, &br) != FR_OK))
+        return false;
+    r->len = br;
+    return (br > 0);
+}
+
+// returns a pointer to up to len bytes of patch data, advances the reader
+static const u8* IPSreaderGet(IpsReader* r, u32 len, u32* got) {
+    if ((r->pos >= r->len) && !IPSreaderFill(r)) return NULL;
+    *got = min(len, r->len - r->pos);
+    const u8* ptr = r->buffer + r->pos;
+    r->pos += *got;
+    return ptr;
+}
+
+static bool IPSreadBE(IpsReader* r, u32 nbytes, u32* val) {
+    *val = 0;
+    while (nbytes) {
+        u32 got;
+        const u8* ptr = IPSreaderGet(r, nbytes, &got);
+        if (!ptr) return false;
+        for (u32 i = 0; i < got; i++)
+            *val = (*val << 8) | ptr[i];
+        nbytes -= got;
     }
+    return true;
+}
+
+static bool IPSwriterFlush(IpsWriter* w) {
+    UINT bw;
+    if (!w->len) return true;
+    bool ret = (fvx_write(w->fp, w->buffer, w->len, &bw) == FR_OK) && (bw == w->len);
+    w->len = 0;
     return ret;
 }
 
-u8 read8() {
-    if (patchOffset >= patchSize) return 0;
-    return patch[patchOffset++];
+// emit data from memory (data != NULL), from file (in != NULL) or as fill bytes
+static bool IPSwriterEmit(IpsWriter* w, const u8* data, FIL* in, u8 fill, u32 size) {
+    while (size) {
+        if ((w->len >= STD_BUFFER_SIZE) && !IPSwriterFlush(w)) return false;
+        u32 chunk = min(size, STD_BUFFER_SIZE - w->len);
+        u8* dst = w->buffer + w->len;
+        if (data) {
+            memcpy(dst, data, chunk);
+            data += chunk;
+        } else if (in) {
+            UINT br;
+            if ((fvx_read(in, dst, chunk, &br) != FR_OK) || (br != chunk)) return false;
+        } else memset(dst, fill, chunk);
+        w->len += chunk;
+        size -= chunk;
+    }
+    return true;
+}
+
+// emit the unpatched range [from, to) of the output: input data, zeroes beyond the input
+static bool IPSwriterEmitGap(IpsContext* ctx, u32 from, u32 to, u32 inSize) {
+    if (from >= to) return true;
+    if (from < inSize) {
+        u32 in_end = min(to, inSize);
+        if ((fvx_lseek(&ctx->inFile, from) != FR_OK) ||
+            !IPSwriterEmit(&ctx->out, NULL, &ctx->inFile, 0, in_end - from))
+            return false;
+        from = in_end;
+    }
+    return IPSwriterEmit(&ctx->out, NULL, NULL, 0, to - from);
 }
 
-UINT read16() {
-    if (patchOffset+1 >= patchSize) return 0;
-    UINT buf = patch[patchOffset++] << 8;
-    buf |= patch[patchOffset++];
-    return buf;
+// random access fallback: write directly at the current output position
+static bool IPSwriteDirect(IpsContext* ctx, FIL* in, bool from_patch, u8 rle, u32 size) {
+    while (size) {
+        UINT bw;
+        const u8* src = ctx->copybuf;
+        u32 chunk = min(size, STD_BUFFER_SIZE);
+        if (from_patch) { // write straight out of the patch buffer
+            src = IPSreaderGet(&ctx->patch, size, &chunk);
+            if (!src) return false;
+        } else if (in) {
+            UINT br;
+            if ((fvx_read(in, ctx->copybuf, chunk, &br) != FR_OK) || (br != chunk)) return false;
+        } else memset(ctx->copybuf, rle, chunk);
+        if ((fvx_write(&ctx->outFile, src, chunk, &bw) != FR_OK) || (bw != chunk))
+            return false;
+        size -= chunk;
+    }
+    return true;
 }
 
-UINT read24() {
-    if (patchOffset+2 >= patchSize) return 0;
-    UINT buf = patch[patchOffset++] << 16;
-    buf |= patch[patchOffset++] << 8;
-    buf |= patch[patchOffset++];
-    return buf;
+static bool IPSprogress(u64 current, u64 total, const char* name) {
+    if (!ShowProgress(current, total, name)) {
+        if (ShowPrompt(true, "%s\n%s", name, STR_B_DETECTED_CANCEL)) return false;
+        ShowProgress(0, total, name);
+        ShowProgress(current, total, name);
+    }
+    return true;
 }
 
 int ApplyIPSPatch(const char* patchName, const char* inName, const char* outName) {
+    IpsContext context = { 0 };
+    IpsContext* ctx = &context;
+    IpsReader* patch = &ctx->patch;
     int error = IPS_INVALID;
-    UINT outlen_min, outlen_max, outlen_min_mem;
-    snprintf(errName, sizeof(errName), "%s", patchName);
+    u32 outlen_min, outlen_max, outlen_min_mem;
+    ctx->errName = patchName;
 
-    if (fvx_open(&patchFile, patchName, FA_READ) != FR_OK) return displayError(IPS_INVALID_FILE_PATH);
-    patchSize = fvx_size(&patchFile);
+    if (fvx_open(&ctx->patchFile, patchName, FA_READ) != FR_OK) return displayError(ctx, IPS_INVALID_FILE_PATH);
+    ctx->patchOpen = true;
+    u32 patchSize = fvx_size(&ctx->patchFile);
     ShowProgress(0, patchSize, patchName);
 
-    patch = malloc(patchSize);
-    if (!patch || fvx_read(&patchFile, patch, patchSize, NULL) != FR_OK) return displayError(IPS_MEMORY);
+    patch->fp = &ctx->patchFile;
+    patch->buffer = malloc(IPS_PATCHBUF_SIZE);
+    ctx->copybuf = malloc(STD_BUFFER_SIZE);
+    if (!patch->buffer || !ctx->copybuf) return displayError(ctx, IPS_MEMORY);
 
-    // Check validity of patch
-    if (patchSize < 8) return displayError(IPS_INVALID);
-    if (read8() != 'P' ||
-        read8() != 'A' ||
-        read8() != 'T' ||
-        read8() != 'C' ||
-        read8() != 'H')
-    {
-        return displayError(IPS_INVALID);
+    // Check validity of patch (first pass, patch data is only skipped)
+    u8 magic[5];
+    u32 magic_len = 0;
+    if (patchSize < 8) return displayError(ctx, IPS_INVALID);
+    while (magic_len < 5) {
+        u32 got;
+        const u8* ptr = IPSreaderGet(patch, 5 - magic_len, &got);
+        if (!ptr) return displayError(ctx, IPS_INVALID);
+        memcpy(magic + magic_len, ptr, got);
+        magic_len += got;
     }
+    if (memcmp(magic, "PATCH", 5) != 0) return displayError(ctx, IPS_INVALID);
 
-    unsigned int offset = read24();
-    unsigned int outlen = 0;
-    unsigned int thisout = 0;
-    unsigned int lastoffset = 0;
+    u32 offset, size, rle;
+    u32 outlen = 0;
+    u32 thisout = 0;
+    u32 lastoffset = 0;
+    u32 lastout = 0;
     bool w_scrambled = false;
-    while (offset != 0x454F46) // 454F46=EOF
+    bool sorted = true; // hunks ascending and not overlapping
+    if (!IPSreadBE(patch, 3, &offset)) return displayError(ctx, IPS_INVALID);
+    while (offset != IPS_EOF_MARKER)
     {
-        if (!ShowProgress(patchOffset, patchSize, patchName)) {
-            if (ShowPrompt(true, "%s\n%s", patchName, STR_B_DETECTED_CANCEL)) return displayError(IPS_CANCELED);
-            ShowProgress(0, patchSize, patchName);
-            ShowProgress(patchOffset, patchSize, patchName);
-        }
+        if (!IPSprogress(IPSreaderTell(patch), patchSize, patchName))
+            return displayError(ctx, IPS_CANCELED);
 
-        unsigned int size = read16();
+        if (!IPSreadBE(patch, 2, &size)) return displayError(ctx, IPS_INVALID);
         if (size == 0)
         {
-            size = read16();
-            if (!size) return displayError(IPS_INVALID);
-            thisout = offset + size;
-            read8();
-        }
-        else
-        {
-            thisout = offset + size;
-            patchOffset += size;
+            if (!IPSreadBE(patch, 2, &size) || !size) return displayError(ctx, IPS_INVALID);
+            if (!IPSreadBE(patch, 1, &rle)) return displayError(ctx, IPS_INVALID);
         }
+        else IPSreaderSeek(patch, IPSreaderTell(patch) + size);
+        thisout = offset + size;
         if (offset < lastoffset) w_scrambled = true;
+        if (offset < lastout) sorted = false;
         lastoffset = offset;
+        lastout = thisout;
         if (thisout > outlen) outlen = thisout;
-        if (patchOffset >= patchSize) return displayError(IPS_INVALID);
-        offset = read24();
+        if (IPSreaderTell(patch) >= patchSize) return displayError(ctx, IPS_INVALID);
+        if (!IPSreadBE(patch, 3, &offset)) return displayError(ctx, IPS_INVALID);
     }
     outlen_min_mem = outlen;
     outlen_max = 0xFFFFFFFF;
-    if (patchOffset+3 == patchSize)
+    if (IPSreaderTell(patch) + 3 == patchSize)
     {
-        unsigned int truncate = read24();
+        u32 truncate;
+        if (!IPSreadBE(patch, 3, &truncate)) return displayError(ctx, IPS_INVALID);
         outlen_max = truncate;
         if (outlen > truncate)
         {
@@ -177,54 +265,99 @@ int ApplyIPSPatch(const char* patchName, const char* inName, const char* outName
             w_scrambled = true;
         }
     }
-    if (patchOffset != patchSize) return displayError(IPS_INVALID);
+    if (IPSreaderTell(patch) != patchSize) return displayError(ctx, IPS_INVALID);
     outlen_min = outlen;
     error = IPS_OK;
     if (w_scrambled) error = IPS_SCRAMBLED;
 
     // start applying patch
     bool inPlace = false;
-    if (!CheckWritePermissions(outName)) return displayError(IPS_INVALID_FILE_PATH);
+    if (!CheckWritePermissions(outName)) return displayError(ctx, IPS_INVALID_FILE_PATH);
     if (strncasecmp(inName, outName, 256) == 0)
     {
-        if (fvx_open(&outFile, outName, FA_WRITE | FA_READ) != FR_OK) return displayError(IPS_INVALID_FILE_PATH);
-        inFile = outFile;
+        // in place: only the patched ranges get written, nothing is copied
+        if (fvx_open(&ctx->outFile, outName, FA_WRITE | FA_READ) != FR_OK) return displayError(ctx, IPS_INVALID_FILE_PATH);
+        ctx->outOpen = true;
         inPlace = true;
     }
-    else if ((fvx_open(&inFile, inName, FA_READ) != FR_OK) ||
-            (fvx_open(&outFile, outName, FA_CREATE_ALWAYS | FA_WRITE | FA_READ) != FR_OK))
-            return displayError(IPS_INVALID_FILE_PATH);
+    else
+    {
+        if (fvx_open(&ctx->inFile, inName, FA_READ) != FR_OK) return displayError(ctx, IPS_INVALID_FILE_PATH);
+        ctx->inOpen = true;
+        if (fvx_open(&ctx->outFile, outName, FA_CREATE_ALWAYS | FA_WRITE | FA_READ) != FR_OK) return displayError(ctx, IPS_INVALID_FILE_PATH);
+        ctx->outOpen = true;
+    }
 
-    size_t inSize = fvx_size(&inFile);
+    u64 inSize64 = fvx_size(inPlace ? &ctx->outFile : &ctx->inFile);
+    u32 inSize = (u32) min(inSize64, 0xFFFFFFFF);
     outlen = max(outlen_min, min(inSize, outlen_max));
-    fvx_lseek(&outFile, max(outlen, outlen_min_mem));
-    fvx_lseek(&outFile, 0);
-    size_t outSize = outlen;
+    fvx_lseek(&ctx->outFile, max(outlen, outlen_min_mem));
+    fvx_lseek(&ctx->outFile, 0);
+    u32 outSize = outlen;
     ShowProgress(0, outSize, outName);
 
-    fvx_lseek(&inFile, 0);
-    if (!inPlace && !IPScopy(COPY_IN, min(inSize, outlen), 0)) return displayError(IPS_MEMORY);
-    fvx_lseek(&outFile, inSize);
-    if (outSize > inSize && !IPScopy(COPY_RLE, outSize - inSize, 0)) return displayError(IPS_MEMORY);
+    ctx->out.fp = &ctx->outFile;
+    ctx->out.buffer = ctx->copybuf;
+    IPSreaderSeek(patch, 5);
+    if (!IPSreadBE(patch, 3, &offset)) return displayError(ctx, IPS_INVALID);
 
-    fvx_lseek(&patchFile, 5);
-    offset = read24();
-    while (offset != 0x454F46)
+    if (sorted && !inPlace)
     {
-        if (!ShowProgress(offset, outSize, outName)) {
-            if (ShowPrompt(true, "%s\n%s", outName, STR_B_DETECTED_CANCEL)) return displayError(IPS_CANCELED);
-            ShowProgress(0, outSize, outName);
-            ShowProgress(offset, outSize, outName);
+        // single forward pass: input, hunks and gaps go out in order
+        u32 pos = 0;
+        while (offset != IPS_EOF_MARKER)
+        {
+            if (!IPSprogress(pos, outSize, outName)) return displayError(ctx, IPS_CANCELED);
+            if (!IPSwriterEmitGap(ctx, pos, offset, inSize) ||
+                !IPSreadBE(patch, 2, &size))
+                return displayError(ctx, IPS_MEMORY);
+            if (size == 0)
+            {
+                if (!IPSreadBE(patch, 2, &size) || !IPSreadBE(patch, 1, &rle) ||
+                    !IPSwriterEmit(&ctx->out, NULL, NULL, (u8) rle, size))
+                    return displayError(ctx, IPS_MEMORY);
+            }
+            else for (u32 left = size; left;)
+            {
+                u32 got;
+                const u8* ptr = IPSreaderGet(patch, left, &got);
+                if (!ptr || !IPSwriterEmit(&ctx->out, ptr, NULL, 0, got))
+                    return displayError(ctx, IPS_MEMORY);
+                left -= got;
+            }
+            pos = offset + size;
+            if (!IPSreadBE(patch, 3, &offset)) return displayError(ctx, IPS_INVALID);
         }
+        if (!IPSwriterEmitGap(ctx, pos, outSize, inSize) || !IPSwriterFlush(&ctx->out))
+            return displayError(ctx, IPS_MEMORY);
+    }
+    else
+    {
+        // random access: copy the input first (unless in place), then write the hunks
+        if (!inPlace && ((fvx_lseek(&ctx->inFile, 0) != FR_OK) ||
+            !IPSwriteDirect(ctx, &ctx->inFile, false, 0, min(inSize, outlen))))
+            return displayError(ctx, IPS_MEMORY);
+        fvx_lseek(&ctx->outFile, inSize);
+        if (outSize > inSize && !IPSwriteDirect(ctx, NULL, false, 0, outSize - inSize)) return displayError(ctx, IPS_MEMORY);
+
+        while (offset != IPS_EOF_MARKER)
+        {
+            if (!IPSprogress(offset, outSize, outName)) return displayError(ctx, IPS_CANCELED);
 
-        fvx_lseek(&outFile, offset);
-        unsigned int size = read16();
-        if (size == 0 && !IPScopy(COPY_RLE, read16(), read8())) return displayError(IPS_MEMORY);
-        else if (size != 0 && !IPScopy(COPY_PATCH, size, 0)) return displayError(IPS_MEMORY);
-        offset = read24();
+            fvx_lseek(&ctx->outFile, offset);
+            if (!IPSreadBE(patch, 2, &size)) return displayError(ctx, IPS_INVALID);
+            if (size == 0)
+            {
+                if (!IPSreadBE(patch, 2, &size) || !IPSreadBE(patch, 1, &rle) ||
+                    !IPSwriteDirect(ctx, NULL, false, (u8) rle, size))
+                    return displayError(ctx, IPS_MEMORY);
+            }
+            else if (!IPSwriteDirect(ctx, NULL, true, 0, size)) return displayError(ctx, IPS_MEMORY);
+            if (!IPSreadBE(patch, 3, &offset)) return displayError(ctx, IPS_INVALID);
+        }
     }
 
-    fvx_lseek(&outFile, outSize);
-    f_truncate(&outFile);
-    return displayError(error);
+    fvx_lseek(&ctx->outFile, outSize);
+    f_truncate(&ctx->outFile);
+    return displayError(ctx, error);
 }
@@ -40,15 +40,28 @@ u32 FixNcchInfoEntry(NcchInfoEntry* entry, u32 version) {
     return 0;
 }
 
-u32 BuildNcchInfoXorpad(void* buffer, NcchInfoEntry* entry, u32 size, u32 offset) {
-    // set NCCH key
+u32 SetupNcchInfoXorpadKey(NcchInfoEntry* entry) {
     // build faux NCCH header from entry
     NcchHeader ncch = { 0 };
     memcpy(ncch.signature, entry->keyY, 16);
     ncch.flags[3] = (u8) entry->ncchFlag3;
     ncch.flags[7] = (u8) (entry->ncchFlag7 & ~0x04);
     ncch.programId = ncch.partitionId = entry->titleId;
-    if (SetNcchKey(&ncch, NCCH_GET_CRYPTO(&ncch), 1) != 0)
+    return SetNcchKey(&ncch, NCCH_GET_CRYPTO(&ncch), 1);
+}
+
+u32 BuildNcchInfoXorpadStream(void* buffer, u32 size, u8* ctr) {
+    // key has to be set up via SetupNcchInfoXorpadKey() before
+    // write keystream directly, ctr is advanced past the output
+    // buffer must have room for size rounded up to AES block size
+    ctr_keystream(buffer, (size + 0xF) / 0x10, AES_CNT_CTRNAND_MODE, ctr);
+
+    return 0;
+}
+
+u32 BuildNcchInfoXorpad(void* buffer, NcchInfoEntry* entry, u32 size, u32 offset) {
+    // set NCCH key
+    if (SetupNcchInfoXorpadKey(entry) != 0)
         return 1;
 
     // write xorpad
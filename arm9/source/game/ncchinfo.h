@@ -27,4 +27,6 @@ typedef struct {
 
 u32 GetNcchInfoVersion(NcchInfoHeader* info);
 u32 FixNcchInfoEntry(NcchInfoEntry* entry, u32 version);
+u32 SetupNcchInfoXorpadKey(NcchInfoEntry* entry);
+u32 BuildNcchInfoXorpadStream(void* buffer, u32 size, u8* ctr);
 u32 BuildNcchInfoXorpad(void* buffer, NcchInfoEntry* entry, u32 size, u32 offset);
@@ -227,3 +227,148 @@ u32 ReadNitroRomEntry(u64* offset, u64* size, bool* is_dir, u32 fileid, u8* fnt_
 
     return 0;
 }
+
+u32 GetNitroRomEntryName(char* name, u8* fnt, u32 offset_entry, u32 n_chars) {
+    u8* fnt_entry = fnt + offset_entry;
+    u32 name_len = FNT_ENTRY_FNLEN(fnt_entry);
+    if (name_len >= n_chars) return 1;
+    memset(name, 0, n_chars);
+    memcpy(name, fnt_entry + 1, name_len);
+    for (u32 i = 0; i < name_len; i++)
+        if (name[i] == '%') name[i] = '_';
+
+    // Shift-JIS workaround
+    for (u32 i = 0; i < name_len; i++) {
+        if ((u8) name[i] >= 0x80) { // this is a Shift-JIS filename
+            // the sequence below is UTF-8 for "Japanese"
+            snprintf(name, 32, "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e%08lX.sjis", offset_entry);
+            break;
+        }
+    }
+
+    return 0;
+}
+
+// hash (display) name + parent dir id, case insensitive like the name matching
+static u32 HashNitroRomName(const char* name, u32 dirid) {
+    u32 hash = dirid ^ 123456789;
+    for (; *name; name++) {
+        u8 c = (u8) *name;
+        if ((c >= 'A') && (c <= 'Z')) c += 'a' - 'A';
+        hash = ((hash>>5) | (hash<<27)) ^ c;
+    }
+    return hash;
+}
+
+// validate a single dir subtable, count its entries
+static u32 ValidateNitroRomDir(u32 dirid, u32* n_entries, TwlHeader* hdr, u8* fnt, u8* fat) {
+    NitroFntBaseEntry* fnt_dir = &((NitroFntBaseEntry*) fnt)[dirid];
+    NitroFatEntry* fat_lut = (NitroFatEntry*) fat;
+    u8* fnt_end = fnt + hdr->fnt_size;
+    u32 fid = fnt_dir->file0_id;
+    u32 n = 0;
+
+    if (fnt_dir->subtable_offset >= hdr->fnt_size) return 1;
+    for (u8* entry = fnt + fnt_dir->subtable_offset;; entry = FNT_ENTRY_NEXT(entry)) {
+        if (entry >= fnt_end) return 1; // corrupt subtable
+        if (!*entry) break; // end of table reached
+        if (FNT_ENTRY_NEXT(entry) > fnt_end) return 1; // corrupt subtable
+        if (!FNT_ENTRY_ISDIR(entry)) {
+            if ((fid+1)*sizeof(NitroFatEntry) > hdr->fat_size) return 1; // corrupt fnt / fat
+            if (fat_lut[fid].start_address > fat_lut[fid].end_address) return 1; // corrupt fat
+            fid++;
+        }
+        n++;
+    }
+
+    *n_entries = n;
+    return 0;
+}
+
+u32 BuildNitroRomIndex(NitroRomIndex* index, TwlHeader* hdr, u8* fnt, u8* fat) {
+    NitroFntBaseEntry* fnt_base = (NitroFntBaseEntry*) fnt;
+    u32 n_dirs = fnt_base->parent_id;
+    char name[256];
+
+    memset(index, 0, sizeof(NitroRomIndex));
+
+    // base sanity checks
+    if ((hdr->fnt_size < sizeof(NitroFntBaseEntry)) || (fnt_base->subtable_offset > hdr->fnt_size))
+        return 1; // invalid FNT
+    if (!n_dirs || (n_dirs > 0x1000) || (n_dirs*sizeof(NitroFntBaseEntry) > fnt_base->subtable_offset))
+        return 1; // invalid FNT
+
+    // first pass: count entries (corrupt dirs are left empty)
+    u32 n_entries = 0;
+    for (u32 d = 0; d < n_dirs; d++) {
+        u32 n = 0;
+        if (ValidateNitroRomDir(d, &n, hdr, fnt, fat) == 0)
+            n_entries += n;
+    }
+
+    // allocate entries, dir table and hash table in one go
+    u32 mod_hash = 1;
+    while (mod_hash < n_entries) mod_hash <<= 1;
+    u8* buffer = (u8*) malloc((n_entries * sizeof(NitroRomIndexEntry)) +
+        ((n_dirs + 1 + mod_hash) * sizeof(u32)));
+    if (!buffer) return 1;
+    index->entries = (NitroRomIndexEntry*) (void*) buffer;
+    index->dirs = (u32*) (void*) (buffer + (n_entries * sizeof(NitroRomIndexEntry)));
+    index->hashtab = index->dirs + n_dirs + 1;
+    index->n_dirs = n_dirs;
+    index->n_entries = n_entries;
+    index->mod_hash = mod_hash;
+    memset(index->hashtab, 0xFF, mod_hash * sizeof(u32));
+
+    // second pass: fill in entries, dir by dir
+    u32 idx = 0;
+    for (u32 d = 0; d < n_dirs; d++) {
+        NitroFntBaseEntry* fnt_dir = &((NitroFntBaseEntry*) fnt)[d];
+        u32 n = 0;
+        index->dirs[d] = idx;
+        if (ValidateNitroRomDir(d, &n, hdr, fnt, fat) != 0) continue;
+        u8* fnt_entry = fnt + fnt_dir->subtable_offset;
+        u32 fileid = fnt_dir->file0_id;
+        for (u32 i = 0; i < n; i++, idx++) {
+            NitroRomIndexEntry* entry = index->entries + idx;
+            entry->offset_entry = fnt_entry - fnt;
+            entry->fileid = fileid;
+            entry->dirid = d;
+            NextNitroRomEntry(&fileid, &fnt_entry);
+        }
+    }
+    index->dirs[n_dirs] = idx;
+
+    // hash chains, inserted backwards so each chain stays in FNT order
+    for (u32 i = n_entries; i > 0; i--) {
+        NitroRomIndexEntry* entry = index->entries + (i-1);
+        GetNitroRomEntryName(name, fnt, entry->offset_entry, 256);
+        u32 bucket = HashNitroRomName(name, entry->dirid) & (mod_hash - 1);
+        entry->next_hash = index->hashtab[bucket];
+        index->hashtab[bucket] = i-1;
+    }
+
+    return 0;
+}
+
+void FreeNitroRomIndex(NitroRomIndex* index) {
+    if (index->entries) free(index->entries);
+    memset(index, 0, sizeof(NitroRomIndex));
+}
+
+NitroRomIndexEntry* FindNitroRomEntry(const char* name, u32 dirid, NitroRomIndex* index, u8* fnt) {
+    if (!index->entries || (dirid >= index->n_dirs)) return NULL;
+
+    char entry_name[256];
+    u32 hash = HashNitroRomName(name, dirid);
+    for (u32 i = index->hashtab[hash & (index->mod_hash - 1)]; i < index->n_entries;
+        i = index->entries[i].next_hash) {
+        NitroRomIndexEntry* entry = index->entries + i;
+        if (entry->dirid != dirid) continue;
+        if ((GetNitroRomEntryName(entry_name, fnt, entry->offset_entry, 256) == 0) &&
+            (strncasecmp(name, entry_name, 256) == 0))
+            return entry;
+    }
+
+    return NULL;
+}
@@ -126,6 +126,24 @@ typedef struct {
     u8  ignored3[0xD00]; // ignored
 } PACKED_STRUCT TwlHeader;
 
+// NitroFS index entry (one per FNT subtable entry)
+typedef struct {
+    u32 offset_entry; // offset of the entry inside the FNT
+    u16 fileid; // fileid for files, running fileid for dirs
+    u16 dirid; // parent dir id
+    u32 next_hash; // next entry in the same hash bucket
+} NitroRomIndexEntry;
+
+// NitroFS index, built once after loading FNT / FAT
+typedef struct {
+    NitroRomIndexEntry* entries;
+    u32* dirs; // first entry index for each dir id (+1 end marker)
+    u32* hashtab; // first entry index for each hash bucket
+    u32 n_dirs;
+    u32 n_entries;
+    u32 mod_hash;
+} NitroRomIndex;
+
 u32 ValidateTwlHeader(TwlHeader* twl);
 u32 VerifyTwlIconData(TwlIconData* icon, u32 size);
 u32 BuildTwlSaveHeader(void* sav, u32 size);
@@ -136,3 +154,7 @@ u32 GetTwlIcon(u16* icon, const TwlIconData* twl_icon);
 u32 FindNitroRomDir(u32 dirid, u32* fileid, u8** fnt_entry, TwlHeader* hdr, u8* fnt, u8* fat);
 u32 NextNitroRomEntry(u32* fileid, u8** fnt_entry);
 u32 ReadNitroRomEntry(u64* offset, u64* size, bool* is_dir, u32 fileid, u8* fnt_entry, u8* fat);
+u32 GetNitroRomEntryName(char* name, u8* fnt, u32 offset_entry, u32 n_chars);
+u32 BuildNitroRomIndex(NitroRomIndex* index, TwlHeader* hdr, u8* fnt, u8* fat);
+void FreeNitroRomIndex(NitroRomIndex* index);
+NitroRomIndexEntry* FindNitroRomEntry(const char* name, u32 dirid, NitroRomIndex* index, u8* fnt);
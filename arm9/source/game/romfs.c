@@ -1,6 +1,10 @@
 #include "romfs.h"
 #include "utf.h"
 
+#define LV3_DIRMETA_HDR_SIZE    0x18 // dir meta without name
+#define LV3_FILEMETA_HDR_SIZE   0x20 // file meta without name
+#define LV3_MAX_DEPTH           64
+
 
 // get lvl datablock offset from IVC (zero for total size)
 // see: https://github.com/profi200/Project_CTR/blob/046bb359ee95423938886dbf477d00690aaecd3e/ctrtool/ivfc.c#L88-L111
@@ -49,6 +53,85 @@ u32 ValidateLv3Header(RomFsLv3Header* lv3, u32 max_size) {
         (!max_size || (lv3->offset_filedata <= max_size))) ? 0 : 1;
 }
 
+// walk dir / file meta, convert names to UTF-8 (count only if entries is NULL)
+static u32 WalkLv3Names(RomFsLv3NameEntry* entries, char* names, u32* size_names, u8* meta, u32 size_meta, u32 size_hdr) {
+    u32 n = 0;
+    u32 offset = 0;
+
+    while (offset + size_hdr <= size_meta) {
+        u32 name_len = getle32(meta + offset + size_hdr - 4);
+        char name[256] = { 0 };
+        if (name_len > 0x200) return (u32) -1; // corrupt meta
+        // same conversion as for displayed names (see vgame.c)
+        utf16_to_utf8((u8*) name, (u16*) (void*) (meta + offset + size_hdr), 255, name_len / 2);
+        u32 len = strnlen(name, 255) + 1;
+        if (entries) {
+            entries[n].offset_meta = offset;
+            entries[n].offset_name = *size_names;
+            memcpy(names + *size_names, name, len);
+        }
+        *size_names += len;
+        offset += size_hdr + align(name_len, 4);
+        n++;
+    }
+
+    return (offset > size_meta) ? (u32) -1 : n;
+}
+
+static u32 HashLv3Name(const char* name, u32 offset_parent) {
+    u32 hash = offset_parent ^ 123456789;
+    for (; *name; name++)
+        hash = ((hash>>5) | (hash<<27)) ^ (u8) *name;
+    return hash;
+}
+
+static void HashLv3NameTable(RomFsLv3NameTable* table, u8* meta, char* names) {
+    memset(table->hashtab, 0xFF, table->mod_hash * sizeof(u32));
+    // inserted backwards, so chains stay in meta order
+    for (u32 i = table->n_entries; i > 0; i--) {
+        RomFsLv3NameEntry* entry = table->entries + (i-1);
+        u32 offset_parent = getle32(meta + entry->offset_meta); // first for both, dirs & files
+        u32 bucket = HashLv3Name(names + entry->offset_name, offset_parent) & (table->mod_hash - 1);
+        entry->next_hash = table->hashtab[bucket];
+        table->hashtab[bucket] = i-1;
+    }
+}
+
+// build UTF-8 name table and name hash index, this is optional
+static u32 BuildLv3NameIndex(RomFsLv3Index* index) {
+    u32 size_names = 0;
+    u32 n_dirs = WalkLv3Names(NULL, NULL, &size_names, index->dirmeta, index->size_dirmeta, LV3_DIRMETA_HDR_SIZE);
+    u32 n_files = WalkLv3Names(NULL, NULL, &size_names, index->filemeta, index->size_filemeta, LV3_FILEMETA_HDR_SIZE);
+    if ((n_dirs == (u32) -1) || (n_files == (u32) -1)) return 1;
+
+    u32 mod_dir = 1;
+    u32 mod_file = 1;
+    while (mod_dir < n_dirs) mod_dir <<= 1;
+    while (mod_file < n_files) mod_file <<= 1;
+
+    // everything goes into one allocation, names last
+    u8* buffer = (u8*) malloc(((n_dirs + n_files) * sizeof(RomFsLv3NameEntry)) +
+        ((mod_dir + mod_file) * sizeof(u32)) + size_names);
+    if (!buffer) return 1;
+    index->dirnames.entries = (RomFsLv3NameEntry*) (void*) buffer;
+    index->filenames.entries = index->dirnames.entries + n_dirs;
+    index->dirnames.hashtab = (u32*) (void*) (index->filenames.entries + n_files);
+    index->filenames.hashtab = index->dirnames.hashtab + mod_dir;
+    index->names = (char*) (index->filenames.hashtab + mod_file);
+    index->dirnames.n_entries = n_dirs;
+    index->filenames.n_entries = n_files;
+    index->dirnames.mod_hash = mod_dir;
+    index->filenames.mod_hash = mod_file;
+
+    size_names = 0;
+    WalkLv3Names(index->dirnames.entries, index->names, &size_names, index->dirmeta, index->size_dirmeta, LV3_DIRMETA_HDR_SIZE);
+    WalkLv3Names(index->filenames.entries, index->names, &size_names, index->filemeta, index->size_filemeta, LV3_FILEMETA_HDR_SIZE);
+    HashLv3NameTable(&(index->dirnames), index->dirmeta, index->names);
+    HashLv3NameTable(&(index->filenames), index->filemeta, index->names);
+
+    return 0;
+}
+
 // build index of RomFS lvl3
 u32 BuildLv3Index(RomFsLv3Index* index, u8* lv3) {
     RomFsLv3Header* hdr = (void*)lv3;
@@ -64,9 +147,25 @@ u32 BuildLv3Index(RomFsLv3Index* index, u8* lv3) {
     index->size_dirmeta = hdr->size_dirmeta;
     index->size_filemeta = hdr->size_filemeta;
 
+    // name index is not a requirement, lookups fall back to UTF-16
+    memset(&(index->dirnames), 0, sizeof(RomFsLv3NameTable));
+    memset(&(index->filenames), 0, sizeof(RomFsLv3NameTable));
+    index->names = NULL;
+    if (BuildLv3NameIndex(index) != 0) {
+        if (index->dirnames.entries) free(index->dirnames.entries);
+        memset(&(index->dirnames), 0, sizeof(RomFsLv3NameTable));
+        memset(&(index->filenames), 0, sizeof(RomFsLv3NameTable));
+        index->names = NULL;
+    }
+
     return 0;
 }
 
+void FreeLv3Index(RomFsLv3Index* index) {
+    if (index->dirnames.entries) free(index->dirnames.entries);
+    memset(index, 0, sizeof(RomFsLv3Index));
+}
+
 // hash lvl3 path - this is used to find the first offset in the file / dir hash table
 u32 HashLv3Path(u16* wname, u32 name_len, u32 offset_parent) {
     u32 hash = offset_parent ^ 123456789;
@@ -75,9 +174,27 @@ u32 HashLv3Path(u16* wname, u32 name_len, u32 offset_parent) {
     return hash;
 }
 
+// look up an entry via the UTF-8 name hash index
+static RomFsLv3NameEntry* FindLv3NameEntry(const char* name, u32 offset_parent, RomFsLv3NameTable* table, u8* meta, char* names) {
+    u32 hash = HashLv3Name(name, offset_parent);
+    for (u32 i = table->hashtab[hash & (table->mod_hash - 1)]; i < table->n_entries; i = table->entries[i].next_hash) {
+        RomFsLv3NameEntry* entry = table->entries + i;
+        if ((getle32(meta + entry->offset_meta) == offset_parent) &&
+            (strncmp(names + entry->offset_name, name, 256) == 0))
+            return entry;
+    }
+    return NULL;
+}
+
 RomFsLv3DirMeta* GetLv3DirMeta(const char* name, u32 offset_parent, RomFsLv3Index* index) {
     RomFsLv3DirMeta* meta;
 
+    // UTF-8 name index, if available
+    if (index->names) {
+        RomFsLv3NameEntry* entry = FindLv3NameEntry(name, offset_parent, &(index->dirnames), index->dirmeta, index->names);
+        return entry ? (RomFsLv3DirMeta*) (void*) (index->dirmeta + entry->offset_meta) : NULL;
+    }
+
     // wide (UTF-16) name
     u16 wname[256];
     int name_len = utf8_to_utf16(wname, (u8*) name, 255, 255);
@@ -103,6 +220,12 @@ RomFsLv3DirMeta* GetLv3DirMeta(const char* name, u32 offset_parent, RomFsLv3Inde
 RomFsLv3FileMeta* GetLv3FileMeta(const char* name, u32 offset_parent, RomFsLv3Index* index) {
     RomFsLv3FileMeta* meta;
 
+    // UTF-8 name index, if available
+    if (index->names) {
+        RomFsLv3NameEntry* entry = FindLv3NameEntry(name, offset_parent, &(index->filenames), index->filemeta, index->names);
+        return entry ? (RomFsLv3FileMeta*) (void*) (index->filemeta + entry->offset_meta) : NULL;
+    }
+
     // wide (UTF-16) name
     u16 wname[256];
     int name_len = utf8_to_utf16(wname, (u8*) name, 255, 255);
@@ -124,3 +247,87 @@ RomFsLv3FileMeta* GetLv3FileMeta(const char* name, u32 offset_parent, RomFsLv3In
 
     return (offset >= index->size_filemeta) ? NULL : meta;
 }
+
+// get UTF-8 name of dir / file meta from the name table (NULL if not available)
+const char* GetLv3Name(u32 offset_meta, bool is_dir, RomFsLv3Index* index) {
+    RomFsLv3NameTable* table = is_dir ? &(index->dirnames) : &(index->filenames);
+    if (!index->names) return NULL;
+
+    // binary search, entries are sorted by meta offset
+    u32 lo = 0;
+    u32 hi = table->n_entries;
+    while (lo < hi) {
+        u32 mid = lo + ((hi - lo) / 2);
+        u32 offset_mid = table->entries[mid].offset_meta;
+        if (offset_mid == offset_meta) return index->names + table->entries[mid].offset_name;
+        else if (offset_mid < offset_meta) lo = mid + 1;
+        else hi = mid;
+    }
+
+    return NULL;
+}
+
+// get full path (relative to RomFS root) of dir / file meta
+u32 GetLv3Path(char* path, u32 n_chars, u32 offset_meta, bool is_dir, RomFsLv3Index* index) {
+    const char* names[LV3_MAX_DEPTH];
+    u32 depth = 0;
+
+    // collect names, from the bottom up
+    if (!is_dir) {
+        if (offset_meta + LV3_FILEMETA_HDR_SIZE > index->size_filemeta) return 1;
+        names[depth++] = GetLv3Name(offset_meta, false, index);
+        offset_meta = getle32(index->filemeta + offset_meta);
+    }
+    for (; offset_meta; offset_meta = getle32(index->dirmeta + offset_meta)) {
+        if ((depth >= LV3_MAX_DEPTH) || (offset_meta + LV3_DIRMETA_HDR_SIZE > index->size_dirmeta))
+            return 1; // too deep or corrupt
+        names[depth++] = GetLv3Name(offset_meta, true, index);
+    }
+
+    // put the path together
+    u32 len = 0;
+    *path = '\0';
+    while (depth--) {
+        const char* name = names[depth];
+        if (!name) return 1;
+        len += snprintf(path + len, n_chars - len, "%s%s", len ? "/" : "", name);
+        if (len >= n_chars) return 1;
+    }
+
+    return 0;
+}
+
+typedef struct {
+    u64 offset_data;
+    u32 offset_meta;
+} Lv3DataOrderEntry;
+
+static int compLv3DataOrderEntry(const void* e1, const void* e2) {
+    const Lv3DataOrderEntry* entry2 = (const Lv3DataOrderEntry*) e2;
+    const Lv3DataOrderEntry* entry1 = (const Lv3DataOrderEntry*) e1;
+    if (entry1->offset_data != entry2->offset_data)
+        return (entry1->offset_data > entry2->offset_data) ? 1 : -1;
+    return (entry1->offset_meta > entry2->offset_meta) ? 1 : (entry1->offset_meta < entry2->offset_meta) ? -1 : 0;
+}
+
+// get all file meta offsets, sorted by data offset (offsets needs room for filenames.n_entries)
+// this is what bulk extraction walks, so file data is read in physical order
+u32 GetLv3FilesByDataOffset(u32* offsets, RomFsLv3Index* index) {
+    u32 n_files = index->filenames.n_entries;
+    if (!index->names) return 1;
+    if (!n_files) return 0;
+
+    Lv3DataOrderEntry* order = (Lv3DataOrderEntry*) malloc(n_files * sizeof(Lv3DataOrderEntry));
+    if (!order) return 1;
+    for (u32 i = 0; i < n_files; i++) {
+        RomFsLv3FileMeta* meta = (RomFsLv3FileMeta*) (void*) (index->filemeta + index->filenames.entries[i].offset_meta);
+        order[i].offset_data = meta->offset_data;
+        order[i].offset_meta = index->filenames.entries[i].offset_meta;
+    }
+    qsort(order, n_files, sizeof(Lv3DataOrderEntry), compLv3DataOrderEntry);
+    for (u32 i = 0; i < n_files; i++)
+        offsets[i] = order[i].offset_meta;
+
+    free(order);
+    return 0;
+}
@@ -79,6 +79,19 @@ typedef struct {
     u16 wname[256]; // 256 assumed to be max name length
 } PACKED_STRUCT RomFsLv3FileMeta;
 
+typedef struct {
+    u32 offset_meta; // offset of dir / file meta
+    u32 offset_name; // offset of UTF-8 name in name table
+    u32 next_hash; // next entry (index) with the same name hash
+} PACKED_STRUCT RomFsLv3NameEntry;
+
+typedef struct {
+    RomFsLv3NameEntry* entries; // sorted by offset_meta
+    u32* hashtab;
+    u32  n_entries;
+    u32  mod_hash;
+} PACKED_STRUCT RomFsLv3NameTable;
+
 typedef struct {
     RomFsLv3Header* header;
     u32* dirhash;
@@ -90,6 +103,10 @@ typedef struct {
     u32  mod_file;
     u32  size_dirmeta;
     u32  size_filemeta;
+    // UTF-8 names & name hash index (NULL if not available)
+    RomFsLv3NameTable dirnames;
+    RomFsLv3NameTable filenames;
+    char* names;
 } PACKED_STRUCT RomFsLv3Index;
 
 
@@ -97,6 +114,10 @@ u64 GetRomFsLvOffset(RomFsIvfcHeader* ivfc, u32 lvl);
 u32 ValidateRomFsHeader(RomFsIvfcHeader* ivfc, u32 max_size);
 u32 ValidateLv3Header(RomFsLv3Header* lv3, u32 max_size);
 u32 BuildLv3Index(RomFsLv3Index* index, u8* lv3);
+void FreeLv3Index(RomFsLv3Index* index);
 u32 HashLv3Path(u16* wname, u32 name_len, u32 offset_parent);
 RomFsLv3DirMeta* GetLv3DirMeta(const char* name, u32 offset_parent, RomFsLv3Index* index);
 RomFsLv3FileMeta* GetLv3FileMeta(const char* name, u32 offset_parent, RomFsLv3Index* index);
+const char* GetLv3Name(u32 offset_meta, bool is_dir, RomFsLv3Index* index);
+u32 GetLv3Path(char* path, u32 n_chars, u32 offset_meta, bool is_dir, RomFsLv3Index* index);
+u32 GetLv3FilesByDataOffset(u32* offsets, RomFsLv3Index* index);
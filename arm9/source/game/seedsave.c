@@ -162,6 +162,7 @@ u32 InstallSeedDbToSystem(SeedInfo* seed_info, bool to_emunand) {
 
     // write back to system (warning: no write protection checks here)
     u32 size = WriteDisaDiffIvfcLvl4(path, NULL, SEEDSAVE_AREA_OFFSET, sizeof(SeedDb), seeddb);
+    if (FlushDisaDiffPool(path) != 0) size = 0;
     FixFileCmac(path, false);
 
     free (seeddb);
@@ -200,6 +201,7 @@ u32 SetupSeedPrePurchase(u64 titleId, bool to_emunand) {
 
     // write back to system (warning: no write protection checks here)
     u32 size = WriteDisaDiffIvfcLvl4(path, NULL, TITLETAG_AREA_OFFSET, sizeof(TitleTag), titletag);
+    if (FlushDisaDiffPool(path) != 0) size = 0;
     FixFileCmac(path, false);
     
     free(titletag);
@@ -945,6 +945,27 @@ u32 ShaCalculator(const char* path, bool sha1) {
     return 0;
 }
 
+u32 Crc32Calculator(const char* path) {
+    char pathstr[UTF_BUFFER_BYTESIZE(32)];
+    u8 crc[4];
+    TruncateString(pathstr, path, 32, 8);
+    if (!FileGetCrc32(path, crc, 0, 0)) {
+        ShowPrompt(false, "%s", STR_CALCULATING_CRC32_FAILED);
+        return 1;
+    } else {
+        static char pathstr_prev[UTF_BUFFER_BYTESIZE(32)] = { 0 };
+        static u8 crc_prev[4] = { 0 };
+        bool match_prev = (memcmp(crc, crc_prev, 4) == 0);
+        ShowPrompt(false, "%s\n%08lX%s%s", pathstr, getbe32(crc),
+            (match_prev) ? STR_IDENTICAL_WITH_PREVIOUS : "",
+            (match_prev) ? pathstr_prev : "");
+        strncpy(pathstr_prev, pathstr, UTF_BUFFER_BYTESIZE(32));
+        memcpy(crc_prev, crc, 4);
+    }
+
+    return 0;
+}
+
 u32 CmacCalculator(const char* path) {
     char pathstr[UTF_BUFFER_BYTESIZE(32)];
     TruncateString(pathstr, path, 32, 8);
@@ -1207,8 +1228,12 @@ u32 FileHandlerMenu(char* current_path, u32* cursor, u32* scroll, PaneData** pan
     // don't handle TMDs inside the game drive, won't work properly anyways
     if ((filetype & GAME_TMD) && (drvtype & DRV_GAME)) filetype &= ~GAME_TMD;
 
+    // sparse images can only be mounted or converted back, everything else needs the raw image
+    u64 filetype_sparse = (filetype & FLAG_SPARSE) ? (IdentifySparseImageType(file_path) | FLAG_SPARSE) : 0;
+    if (filetype_sparse) filetype = 0;
+
     // special stuff, only available for known filetypes (see int special below)
-    bool mountable = (FTYPE_MOUNTABLE(filetype) && !(drvtype & DRV_IMAGE) &&
+    bool mountable = (FTYPE_MOUNTABLE((filetype | filetype_sparse)) && !(drvtype & DRV_IMAGE) &&
         !((drvtype & (DRV_SYSNAND|DRV_EMUNAND)) && (drvtype & DRV_VIRTUAL) && (filetype & IMG_FAT)));
     bool verificable = (FTYPE_VERIFICABLE(filetype));
     bool decryptable = (FTYPE_DECRYPTABLE(filetype));
@@ -1237,6 +1262,10 @@ u32 FileHandlerMenu(char* current_path, u32* cursor, u32* scroll, PaneData** pan
     bool extrcodeable = (FTYPE_HASCODE(filetype));
     bool restorable = (FTYPE_RESTORABLE(filetype) && IS_UNLOCKED && !(drvtype & DRV_SYSNAND));
     bool ebackupable = (FTYPE_EBACKUP(filetype));
+    bool diffbackupable = (FTYPE_NANDDIFF(filetype) && (drvtype & DRV_VIRTUAL) && (drvtype & (DRV_SYSNAND|DRV_EMUNAND)));
+    bool ndiffrebuildable = (FTYPE_NANDREBUILD(filetype));
+    bool sparsable = (FTYPE_SPARSABLE(filetype));
+    bool unsparsable = (FTYPE_UNSPARSABLE(filetype_sparse));
     bool ncsdfixable = (FTYPE_NCSDFIXABLE(filetype));
     bool xorpadable = (FTYPE_XORPAD(filetype));
     bool keyinitable = (FTYPE_KEYINIT(filetype)) && !((drvtype & DRV_VIRTUAL) && (drvtype & DRV_SYSNAND));
@@ -1264,7 +1293,7 @@ u32 FileHandlerMenu(char* current_path, u32* cursor, u32* scroll, PaneData** pan
     bool special_opt =
         mountable || verificable || decryptable || encryptable || cia_buildable || cia_buildable_legit ||
         cxi_dumpable || tik_buildable || key_buildable || titleinfo || renamable || trimable || transferable ||
-        hsinjectable || restorable || xorpadable || ebackupable || ncsdfixable || extrcodeable || keyinitable ||
+        hsinjectable || restorable || xorpadable || ebackupable || diffbackupable || ndiffrebuildable || sparsable || unsparsable || ncsdfixable || extrcodeable || keyinitable ||
         keyinstallable || bootable || scriptable || fontable || translationable || viewable || installable ||
         agbexportable || agbimportable || cia_installable || tik_installable || tik_dumpable || cif_installable ||
 	luascriptable;
@@ -1288,6 +1317,7 @@ u32 FileHandlerMenu(char* current_path, u32* cursor, u32* scroll, PaneData** pan
     int textviewer = (filetype & TXT_GENERIC || FileGetSize(file_path) == 0) ? ++n_opt : -1;
     int calcsha256 = ++n_opt;
     int calcsha1 = ++n_opt;
+    int calccrc32 = ++n_opt;
     int calccmac = (CheckCmacPath(file_path) == 0) ? ++n_opt : -1;
     int fileinfo = ++n_opt;
     int copystd = (!in_output_path) ? ++n_opt : -1;
@@ -1299,7 +1329,7 @@ u32 FileHandlerMenu(char* current_path, u32* cursor, u32* scroll, PaneData** pan
     int titleman = -1;
     if (DriveType(current_path) & DRV_TITLEMAN) {
         // special case: title manager (disable almost everything)
-        hexviewer = textviewer = calcsha256 = calcsha1 = calccmac = fileinfo = copystd = inject = searchdrv = -1;
+        hexviewer = textviewer = calcsha256 = calcsha1 = calccrc32 = calccmac = fileinfo = copystd = inject = searchdrv = -1;
         special = 1;
         titleman = 2;
         n_opt = 2;
@@ -1320,6 +1350,7 @@ u32 FileHandlerMenu(char* current_path, u32* cursor, u32* scroll, PaneData** pan
     snprintf(installkeydb_str, sizeof(installkeydb_str), STR_INSTALL_X, KEYDB_NAME);
 
     if (special > 0) optionstr[special-1] =
+        (filetype_sparse)       ? STR_SPARSE_IMAGE_OPTIONS :
         (filetype & IMG_NAND)   ? STR_NAND_IMAGE_OPTIONS   :
         (filetype & IMG_FAT)    ? (transferable) ? STR_CTRNAND_OPTIONS : STR_MOUNT_FAT_IMAGE :
         (filetype & GAME_CIA)   ? STR_CIA_IMAGE_OPTIONS    :
@@ -1349,6 +1380,7 @@ u32 FileHandlerMenu(char* current_path, u32* cursor, u32* scroll, PaneData** pan
         (filetype & BIN_KEYDB)  ? STR_AESKEYDB_OPTIONS     :
         (filetype & BIN_LEGKEY) ? buildkeydb_str           :
         (filetype & BIN_NCCHNFO)? STR_NCCHINFO_OPTIONS     :
+        (filetype & BIN_NDIFF)  ? STR_REBUILD_FULL_NAND_IMAGE :
         (filetype & TXT_SCRIPT) ? STR_EXECUTE_GM9_SCRIPT   :
         (filetype & TXT_LUA)    ? STR_EXECUTE_LUA_SCRIPT   :
         (FTYPE_FONT(filetype))  ? STR_FONT_OPTIONS         :
@@ -1359,6 +1391,7 @@ u32 FileHandlerMenu(char* current_path, u32* cursor, u32* scroll, PaneData** pan
     optionstr[hexviewer-1] = STR_SHOW_IN_HEXEDITOR;
     optionstr[calcsha256-1] = STR_CALCULATE_SHA256;
     optionstr[calcsha1-1] = STR_CALCULATE_SHA1;
+    if (calccrc32 > 0) optionstr[calccrc32-1] = STR_CALCULATE_CRC32;
     optionstr[fileinfo-1] = STR_SHOW_FILE_INFO;
     if (textviewer > 0) optionstr[textviewer-1] = STR_SHOW_IN_TEXTVIEWER;
     if (calccmac > 0) optionstr[calccmac-1] = STR_CALCULATE_CMAC;
@@ -1390,6 +1423,11 @@ u32 FileHandlerMenu(char* current_path, u32* cursor, u32* scroll, PaneData** pan
         GetDirContents(current_dir, current_path);
         return 0;
     }
+    else if (user_select == calccrc32) { // -> calculate CRC32
+        Crc32Calculator(file_path);
+        GetDirContents(current_dir, current_path);
+        return 0;
+    }
     else if (user_select == calccmac) { // -> calculate CMAC
         optionstr[0] = STR_CHECK_CURRENT_CMAC_ONLY;
         optionstr[1] = STR_VERIFY_CMAC_FOR_ALL;
@@ -1488,6 +1526,10 @@ u32 FileHandlerMenu(char* current_path, u32* cursor, u32* scroll, PaneData** pan
     int mount = (mountable) ? ++n_opt : -1;
     int restore = (restorable) ? ++n_opt : -1;
     int ebackup = (ebackupable) ? ++n_opt : -1;
+    int diffbackup = (diffbackupable) ? ++n_opt : -1;
+    int ndiffrebuild = (ndiffrebuildable) ? ++n_opt : -1;
+    int sparse = (sparsable) ? ++n_opt : -1;
+    int unsparse = (unsparsable) ? ++n_opt : -1;
     int ncsdfix = (ncsdfixable) ? ++n_opt : -1;
     int decrypt = (decryptable) ? ++n_opt : -1;
     int encrypt = (encryptable) ? ++n_opt : -1;
@@ -1525,6 +1567,10 @@ u32 FileHandlerMenu(char* current_path, u32* cursor, u32* scroll, PaneData** pan
     if (mount > 0) optionstr[mount-1] = (filetype & GAME_TMD) ? STR_MOUNT_CXI_NDS_TO_DRIVE : STR_MOUNT_IMAGE_TO_DRIVE;
     if (restore > 0) optionstr[restore-1] = STR_RESTORE_SYSNAND_SAFE;
     if (ebackup > 0) optionstr[ebackup-1] = STR_UPDATE_EMBEDDED_BACKUP;
+    if (diffbackup > 0) optionstr[diffbackup-1] = STR_DIFFERENTIAL_BACKUP;
+    if (ndiffrebuild > 0) optionstr[ndiffrebuild-1] = STR_REBUILD_FULL_NAND_IMAGE;
+    if (sparse > 0) optionstr[sparse-1] = STR_BUILD_SPARSE_IMAGE;
+    if (unsparse > 0) optionstr[unsparse-1] = STR_CONVERT_TO_RAW_IMAGE;
     if (ncsdfix > 0) optionstr[ncsdfix-1] = STR_REBUILD_NCSD_HEADER;
     if (show_info > 0) optionstr[show_info-1] = STR_SHOW_TITLE_INFO;
     if (decrypt > 0) optionstr[decrypt-1] = (cryptable_inplace) ? STR_DECRYPT_FILE : decryptto_str;
@@ -1776,6 +1822,8 @@ u32 FileHandlerMenu(char* current_path, u32* cursor, u32* scroll, PaneData** pan
         if ((n_marked > 1) && ShowPrompt(true, STR_TRY_TO_INSTALL_N_SELECTED_FILES, n_marked)) {
             u32 n_success = 0;
             u32 n_other = 0;
+            // title database changes get committed once for all game files
+            bool batch = (InstallFunction == &InstallGameFile) && (BeginInstallBatch(n_marked) == 0);
             ShowString(STR_TRYING_TO_INSTALL_N_FILES, n_marked);
             for (u32 i = 0; i < current_dir->n_entries; i++) {
                 const char* path = current_dir->entry[i].path;
@@ -1796,6 +1844,11 @@ u32 FileHandlerMenu(char* current_path, u32* cursor, u32* scroll, PaneData** pan
                 }
                 current_dir->entry[i].marked = false;
             }
+            if (batch && n_success) ShowString(STR_UPDATING_TITLE_DATABASES_PLEASE_WAIT);
+            if (batch && (EndInstallBatch(to_emunand) != 0)) {
+                ShowPrompt(false, "%s", STR_UPDATING_TITLE_DATABASES_FAILED_ROLLED_BACK);
+                n_success = 0;
+            }
             if (n_other) {
                 ShowPrompt(false, STR_N_OF_N_FILES_INSTALLED_N_OF_N_NOT_SAME_TYPE,
                     n_success, n_marked, n_other, n_marked);
@@ -1865,8 +1918,28 @@ u32 FileHandlerMenu(char* current_path, u32* cursor, u32* scroll, PaneData** pan
             u32 n_success = 0;
             u32 n_other = 0;
             u32 n_processed = 0;
-            if (!ShowPrompt(true, STR_TRY_TO_VERIFY_N_SELECTED_FILES, n_marked)) // confirmation
+            if (!(filetype & IMG_NAND)) { // game files: optionally keep a manifest
+                optionstr[0] = STR_VERIFY_SELECTED_FILES;
+                optionstr[1] = STR_VERIFY_AND_UPDATE_MANIFEST;
+                user_select = ShowSelectPrompt(2, optionstr, STR_TRY_TO_VERIFY_N_SELECTED_FILES, n_marked);
+                if (!user_select) return 1;
+            } else if (!ShowPrompt(true, STR_TRY_TO_VERIFY_N_SELECTED_FILES, n_marked)) // confirmation
                 return 1;
+            if (!(filetype & IMG_NAND) && (user_select == 2)) {
+                const char** paths = (const char**) malloc(n_marked * sizeof(const char*));
+                if (!paths) return 1;
+                u32 n_paths = 0;
+                for (u32 i = 0; (i < current_dir->n_entries) && (n_paths < n_marked); i++)
+                    if (current_dir->entry[i].marked) paths[n_paths++] = current_dir->entry[i].path;
+                u32 n_total = 0;
+                u32 n_skipped = 0;
+                fvx_rmkdir(OUTPUT_PATH);
+                if (VerifyGameFileBatch(paths, n_paths, VERIFY_MANIFEST_PATH, sig_check, &n_total, &n_success, &n_skipped) != 0)
+                    ShowPrompt(false, "%s\n%s", STR_VERIFICATION_FAILED, VERIFY_MANIFEST_PATH);
+                ShowPrompt(false, STR_N_OF_N_FILES_VERIFIED_MANIFEST, n_success, n_total, n_skipped, VERIFY_MANIFEST_PATH);
+                free(paths);
+                return 0;
+            }
             for (u32 i = 0; i < current_dir->n_entries; i++) {
                 const char* path = current_dir->entry[i].path;
                 if (!current_dir->entry[i].marked)
@@ -1989,36 +2062,57 @@ u32 FileHandlerMenu(char* current_path, u32* cursor, u32* scroll, PaneData** pan
         return 0;
     }
     else if (user_select == trim) { // -> Game file trimmer
-        if ((n_marked > 1) && ShowPrompt(true, STR_TRY_TO_TRIM_N_SELECTED_FILES, n_marked)) {
+        if (n_marked > 1) {
             u32 n_success = 0;
             u32 n_other = 0;
+            u32 n_trimmable = 0;
             u32 n_processed = 0;
             u64 savings = 0;
             char savingsstr[32];
+            u64* trimsizes = (u64*) malloc(current_dir->n_entries * sizeof(u64));
+            if (!trimsizes) return 1;
+            // first pass: find out how much space can be reclaimed
             for (u32 i = 0; i < current_dir->n_entries; i++) {
                 const char* path = current_dir->entry[i].path;
-                u64 prevsize = 0;
+                trimsizes[i] = 0;
                 if (!current_dir->entry[i].marked)
                     continue;
-                if (!ShowProgress(n_processed++, n_marked, path)) break;
+                if (!ShowProgress(n_processed++, n_marked, path)) {
+                    free(trimsizes);
+                    return 0;
+                }
                 if (!(IdentifyFileType(path) & filetype & TYPE_BASE)) {
                     n_other++;
                     continue;
                 }
-                prevsize = FileGetSize(path);
-                if (TrimGameFile(path) == 0) {
-                    n_success++;
+                trimsizes[i] = GetGameFileTrimmedSize(path);
+                if (trimsizes[i] && (trimsizes[i] < current_dir->entry[i].size)) {
+                    savings += current_dir->entry[i].size - trimsizes[i];
+                    n_trimmable++;
+                }
+            }
+            FormatBytes(savingsstr, savings, true);
+            if (!ShowPrompt(true, STR_N_OF_N_FILES_CAN_BE_TRIMMED_X_RECLAIMABLE, n_trimmable, n_marked, savingsstr)) {
+                free(trimsizes);
+                return 0;
+            }
+            // second pass: trim everything (trimmed sizes get recomputed there)
+            savings = 0;
+            n_processed = 0;
+            for (u32 i = 0; i < current_dir->n_entries; i++) {
+                const char* path = current_dir->entry[i].path;
+                u64 prevsize = current_dir->entry[i].size;
+                if (!trimsizes[i])
+                    continue;
+                if (trimsizes[i] < prevsize) { // already trimmed files don't count for progress
+                    if (!ShowProgress(n_processed++, n_trimmable, path)) break;
+                    if (TrimGameFile(path) != 0) continue; // failed, leave it marked
                     savings += prevsize - FileGetSize(path);
-                } else { // on failure: show error, continue (should not happen)
-                    char lpathstr[UTF_BUFFER_BYTESIZE(32)];
-                    TruncateString(lpathstr, path, 32, 8);
-                    if (ShowPrompt(true, "%s\n%s", lpathstr, STR_TRIMMING_FAILED_CONTINUE)) {
-                        ShowProgress(0, n_marked, path); // restart progress bar
-                        continue;
-                    } else break;
                 }
+                n_success++;
                 current_dir->entry[i].marked = false;
             }
+            free(trimsizes);
             FormatBytes(savingsstr, savings, true);
             if (n_other) ShowPrompt(false, STR_N_OF_N_FILES_TRIMMED_N_OF_N_NOT_OF_SAME_TYPE_X_SAVED,
                 n_success, n_marked, n_other, n_marked, savingsstr);
@@ -2149,8 +2243,12 @@ u32 FileHandlerMenu(char* current_path, u32* cursor, u32* scroll, PaneData** pan
         return 0;
     }
     else if (user_select == restore) { // -> restore SysNAND (A9LH preserving)
-        ShowPrompt(false, "%s\n%s", pathstr, (SafeRestoreNandDump(file_path) == 0) ?
-            STR_NAND_RESTORE_SUCCESS : STR_NAND_RESTORE_FAILED);
+        u64 written = 0;
+        if (SafeRestoreNandDump(file_path, &written) == 0) {
+            char bytestr[32];
+            FormatBytes(bytestr, written, true);
+            ShowPrompt(false, STR_PATH_NAND_RESTORE_SUCCESS_X_WRITTEN, pathstr, bytestr);
+        } else ShowPrompt(false, "%s\n%s", pathstr, STR_NAND_RESTORE_FAILED);
         return 0;
     }
     else if (user_select == ncsdfix) { // -> inject sighaxed NCSD
@@ -2162,9 +2260,17 @@ u32 FileHandlerMenu(char* current_path, u32* cursor, u32* scroll, PaneData** pan
     }
     else if ((user_select == xorpad) || (user_select == xorpad_inplace)) { // -> build xorpads
         bool inplace = (user_select == xorpad_inplace);
-        bool success = (BuildNcchInfoXorpads((inplace) ? current_path : OUTPUT_PATH, file_path) == 0);
-        ShowPrompt(false, (success) ? STR_PATH_NCCHINFO_PADGEN_SUCCESS : STR_PATH_NCCHINFO_PADGEN_FAILED,
+        u64 pad_size = 0;
+        u64 pad_msec = 0;
+        bool success = (BuildNcchInfoXorpads((inplace) ? current_path : OUTPUT_PATH, file_path, &pad_size, &pad_msec) == 0);
+        char resultstr[UTF_BUFFER_BYTESIZE(256)];
+        snprintf(resultstr, sizeof(resultstr), (success) ? STR_PATH_NCCHINFO_PADGEN_SUCCESS : STR_PATH_NCCHINFO_PADGEN_FAILED,
             pathstr, (!success || inplace) ? '\0' : '\n', OUTPUT_PATH);
+        if (success) {
+            u64 rate = (pad_size * 100 * 1000) / (max(pad_msec, 1) * 1024 * 1024); // in 1/100 MiB/s
+            ShowPrompt(false, STR_NCCHINFO_PADGEN_STATS, resultstr, (u32) (pad_size / (1024 * 1024)),
+                (u32) (pad_msec / 1000), (u32) ((pad_msec % 1000) / 100), (u32) (rate / 100), (u32) (rate % 100));
+        } else ShowPrompt(false, "%s", resultstr);
         GetDirContents(current_dir, current_path);
         for (; *cursor < current_dir->n_entries; (*cursor)++) {
             DirEntry* entry = &(current_dir->entry[*cursor]);
@@ -2185,6 +2291,68 @@ u32 FileHandlerMenu(char* current_path, u32* cursor, u32* scroll, PaneData** pan
         GetDirContents(current_dir, current_path);
         return 0;
     }
+    else if (user_select == diffbackup) { // -> differential NAND backup (only changed regions)
+        const char* base_path = (drvtype & DRV_SYSNAND) ? NAND_DIFF_BASE_SYSNAND : NAND_DIFF_BASE_EMUNAND;
+        char path_out[256];
+        u32 n_changed, n_regions;
+        fvx_rmkdir(OUTPUT_PATH);
+        u32 ret = DiffBackupNandDump(file_path, base_path, path_out, &n_changed, &n_regions);
+        if (ret == 2) return 0; // overwriting the base image was declined
+        else if (ret != 0)
+            ShowPrompt(false, STR_PATH_DIFFERENTIAL_BACKUP_FAILED, pathstr);
+        else if (!*path_out)
+            ShowPrompt(false, STR_PATH_NO_CHANGES_SINCE_LAST_BACKUP, pathstr);
+        else if (!n_changed)
+            ShowPrompt(false, STR_PATH_FULL_NAND_BACKUP_WRITTEN_TO, pathstr, path_out);
+        else ShowPrompt(false, STR_PATH_N_OF_N_REGIONS_CHANGED_DELTA_WRITTEN, pathstr, n_changed, n_regions, path_out);
+        return 0;
+    }
+    else if (user_select == ndiffrebuild) { // -> rebuild full NAND image from base + deltas
+        char path_out[256];
+        char* name = strrchr(file_path, '/');
+        char* ext;
+        snprintf(path_out, sizeof(path_out), "%s/%s", OUTPUT_PATH, name ? name + 1 : file_path);
+        if ((ext = strrchr(path_out, '.')) > strrchr(path_out, '/')) *ext = '\0';
+        strncat(path_out, ".bin", sizeof(path_out) - strnlen(path_out, sizeof(path_out)) - 1);
+        fvx_rmkdir(OUTPUT_PATH);
+        if (RebuildNandDiffBackup(file_path, path_out) == 0)
+            ShowPrompt(false, STR_PATH_NAND_IMAGE_REBUILT_TO, pathstr, path_out);
+        else ShowPrompt(false, STR_PATH_NAND_IMAGE_REBUILD_FAILED, pathstr);
+        GetDirContents(current_dir, current_path);
+        return 0;
+    }
+    else if (user_select == sparse) { // -> build sparse image, optionally deflated
+        char path_out[256];
+        char bytestr0[32];
+        char bytestr1[32];
+        optionstr[0] = STR_SPARSE_ONLY_FAST;
+        optionstr[1] = STR_SPARSE_AND_DEFLATE_SMALLER;
+        user_select = ShowSelectPrompt(2, optionstr, "%s", pathstr);
+        if (!user_select) return 0;
+        snprintf(path_out, sizeof(path_out), "%s/%s.%s", OUTPUT_PATH, file_name, SPARSE_EXT);
+        fvx_rmkdir(OUTPUT_PATH);
+        if (BuildSparseImage(file_path, path_out, (user_select == 2)) == 0) {
+            FormatBytes(bytestr0, fvx_qsize(path_out), true);
+            FormatBytes(bytestr1, FileGetSize(file_path), true);
+            ShowPrompt(false, STR_PATH_SPARSE_IMAGE_WRITTEN_TO_X_OF_X, pathstr, path_out, bytestr0, bytestr1);
+        } else ShowPrompt(false, STR_PATH_SPARSE_IMAGE_BUILD_FAILED, pathstr);
+        GetDirContents(current_dir, current_path);
+        return 0;
+    }
+    else if (user_select == unsparse) { // -> convert sparse image back to raw
+        char path_out[256];
+        char* ext;
+        snprintf(path_out, sizeof(path_out), "%s/%s", OUTPUT_PATH, file_name);
+        if (((ext = strrchr(path_out, '.')) > strrchr(path_out, '/')) && (strncasecmp(ext + 1, SPARSE_EXT, 8) == 0))
+            *ext = '\0';
+        else strncat(path_out, ".bin", sizeof(path_out) - strnlen(path_out, sizeof(path_out)) - 1);
+        fvx_rmkdir(OUTPUT_PATH);
+        if (ExtractSparseImage(file_path, path_out) == 0)
+            ShowPrompt(false, STR_PATH_RAW_IMAGE_WRITTEN_TO, pathstr, path_out);
+        else ShowPrompt(false, STR_PATH_RAW_IMAGE_CONVERSION_FAILED, pathstr);
+        GetDirContents(current_dir, current_path);
+        return 0;
+    }
     else if (user_select == keyinit) { // -> initialise keys from aeskeydb.bin
         if (ShowPrompt(true, "%s", STR_WARNING_KEYS_NOT_VERIFIED_CONTINUE_AT_YOUR_OWN_RISK))
             ShowPrompt(false, "%s\n%s", pathstr, (InitKeyDb(file_path) == 0) ?
@@ -2699,8 +2867,13 @@ u32 GodMode(int entrypoint) {
                         scroll = 0;
                     }
                 } else if (user_select == fixcmac) {
-                    RecursiveFixFileCmac(curr_entry->path);
-                    ShowPrompt(false, "%s", STR_FIX_CMACS_FOR_DRIVE_FINISHED);
+                    CmacBatchStats stats;
+                    RecursiveFixFileCmacBatch(curr_entry->path, &stats);
+                    u32 n_total = stats.n_ok + stats.n_fixed + stats.n_failed + stats.n_nocmac;
+                    ShowPrompt(false, STR_FIX_CMACS_FOR_DRIVE_FINISHED_STATS,
+                        stats.n_ok, stats.n_fixed, n_total, stats.n_nocmac, n_total, stats.n_failed,
+                        stats.n_category[CMAC_CAT_SAVEDATA], stats.n_category[CMAC_CAT_EXTDATA],
+                        stats.n_category[CMAC_CAT_DATABASE], stats.n_category[CMAC_CAT_CMD] + stats.n_category[CMAC_CAT_OTHER]);
                 } else if (user_select == dirnfo) {
                     if (DirFileAttrMenu(curr_entry->path, curr_entry->name)) {
                         ShowPrompt(false, "%s",(current_path[0] == '\0') ? STR_FAILED_TO_ANALYZE_DRIVE : STR_FAILED_TO_ANALYZE_DIR);
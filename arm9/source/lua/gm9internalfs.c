@@ -4,6 +4,7 @@
 #include "ui.h"
 #include "utils.h"
 #include "sha.h"
+#include "crc32.h"
 #include "nand.h"
 #include "language.h"
 #include "hid.h"
@@ -558,13 +559,17 @@ static int internalfs_hash_file(lua_State* L) {
 
     u32 flags = 0;
     if (extra) {
-        flags = GetFlagsFromTable(L, 4, flags, USE_SHA1);
+        flags = GetFlagsFromTable(L, 4, flags, USE_SHA1 | USE_CRC32);
     }
 
-    const u8 hashlen = (flags & USE_SHA1) ? 20 : 32;
+    const u8 hashlen = (flags & USE_CRC32) ? 4 : (flags & USE_SHA1) ? 20 : 32;
     u8 hash_fil[0x20];
 
-    if (size == 0) {
+    if (flags & USE_CRC32) {
+        if (size == 0) memset(hash_fil, 0, 4); // CRC32 of empty data
+        else if (!FileGetCrc32(path, hash_fil, offset, size))
+            return luaL_error(L, "FileGetCrc32 failed on %s", path);
+    } else if (size == 0) {
         // shortcut by just returning the hash of empty data
         memcpy(hash_fil, (flags & USE_SHA1) ? no_data_hash_1 : no_data_hash_256, hashlen);
     } else if (!(FileGetSha(path, hash_fil, offset, size, (flags & USE_SHA1)))) {
@@ -582,13 +587,19 @@ static int internalfs_hash_data(lua_State* L) {
 
     u32 flags = 0;
     if (extra) {
-        flags = GetFlagsFromTable(L, 2, flags, USE_SHA1);
+        flags = GetFlagsFromTable(L, 2, flags, USE_SHA1 | USE_CRC32);
     }
 
-    const u8 hashlen = (flags & USE_SHA1) ? 20 : 32;
+    const u8 hashlen = (flags & USE_CRC32) ? 4 : (flags & USE_SHA1) ? 20 : 32;
     u8 hash_fil[0x20];
 
-    if (data_length == 0) {
+    if (flags & USE_CRC32) {
+        u32 crc = ~crc32_calculate(~0, (const u8*) data, data_length);
+        hash_fil[0] = (crc >> 24) & 0xFF;
+        hash_fil[1] = (crc >> 16) & 0xFF;
+        hash_fil[2] = (crc >>  8) & 0xFF;
+        hash_fil[3] = (crc >>  0) & 0xFF;
+    } else if (data_length == 0) {
         // shortcut by just returning the hash of empty data
         memcpy(hash_fil, (flags & USE_SHA1) ? no_data_hash_1 : no_data_hash_256, hashlen);
     } else {
@@ -113,7 +113,7 @@ static int title_compress_code(lua_State* L) {
 
     CheckWritePermissionsLuaError(L, path_dst);
     ShowString("%s", STR_COMPRESSING_DOT_CODE);
-    bool ret = (CompressCode(path_src, path_dst) == 0);
+    bool ret = (CompressCode(path_src, path_dst, CODE_LZSS_BEST) == 0);
     if (!ret) {
         return luaL_error(L, "failed to compress code from %s", path_src);
     }
@@ -56,6 +56,19 @@ static const u8 ALIGN(4) sector0x96dev_sha256[0x20] = { // hash for legit sector
 
 static u8 ALIGN(4) CtrNandCtr[16];
 static u8 ALIGN(4) TwlNandCtr[16];
+
+// counter for the sector following the last crypted range, saves add_ctr() on sequential access
+static struct {
+    u8 ALIGN(4) ctr[16];
+    u32 sector;
+    bool twl;
+    bool valid;
+} NandCtrCache = { .valid = false };
+
+// bounce buffer for misaligned NAND reads / writes that fit into a few sectors
+#define NAND_BOUNCE_SECTORS 8
+#define NAND_SPAN_SECTORS(offset, count) ((u32) ((((offset) + (count) + 0x1FF) / 0x200) - ((offset) / 0x200)))
+static u8 ALIGN(32) NandBounceBuffer[NAND_BOUNCE_SECTORS * 0x200];
 static u8 ALIGN(4) OtpSha256[32] = { 0 };
 static bool Crypto0x96 = false;
 
@@ -107,6 +120,7 @@ bool InitNandCrypto(bool init_full)
     sha_quick(shasum, (u8*) NandCid, 16, SHA1_MODE);
     for(u32 i = 0; i < 16; i++) // little endian and reversed order
         TwlNandCtr[i] = shasum[15-i];
+    NandCtrCache.valid = false;
 
     // part #2: TWL KEY (if not already set up)
     // see: https://www.3dbrew.org/wiki/Memory_layout#ARM9_ITCM
@@ -217,19 +231,55 @@ bool CheckGenuineNandNcsd(void)
     return (sha_cmp((IS_O3DS) ? gen_o3ds_hash : gen_n3ds_hash, gen_hdr, 0x100, SHA256_MODE) == 0);
 }
 
+static void GetNandCtr(u8* ctr, u32 sector, bool twl)
+{
+    // get the NAND CTR for the sector, from the cached one if possible
+    if (NandCtrCache.valid && (NandCtrCache.twl == twl) && (sector >= NandCtrCache.sector)) {
+        memcpy(ctr, NandCtrCache.ctr, 16);
+        if (sector > NandCtrCache.sector)
+            add_ctr(ctr, (sector - NandCtrCache.sector) * (0x200 / 0x10));
+    } else {
+        memcpy(ctr, twl ? TwlNandCtr : CtrNandCtr, 16);
+        add_ctr(ctr, sector * (0x200 / 0x10));
+    }
+}
+
+static void CacheNandCtr(const u8* ctr, u32 sector, bool twl)
+{
+    memcpy(NandCtrCache.ctr, ctr, 16);
+    NandCtrCache.sector = sector;
+    NandCtrCache.twl = twl;
+    NandCtrCache.valid = true;
+}
+
 void CryptNand(void* buffer, u32 sector, u32 count, u32 keyslot)
 {
     u32 mode = (keyslot != 0x03) ? AES_CNT_CTRNAND_MODE : AES_CNT_TWLNAND_MODE; // somewhat hacky
     u8 ALIGN(32) ctr[16];
     u32 blocks = count * (0x200 / 0x10);
+    bool twl = (keyslot == 0x03); // hacky again
 
-    // copy NAND CTR and increment it
-    memcpy(ctr, (keyslot != 0x03) ? CtrNandCtr : TwlNandCtr, 16); // hacky again
-    add_ctr(ctr, sector * (0x200 / 0x10));
+    GetNandCtr(ctr, sector, twl);
 
-    // decrypt the data
+    // decrypt the data (this also advances the CTR past the last sector)
     use_aeskey(keyslot);
     ctr_decrypt((void*) buffer, (void*) buffer, blocks, mode, ctr);
+
+    CacheNandCtr(ctr, sector + count, twl);
+}
+
+void XorpadNand(void* buffer, u32 sector, u32 count, u32 keyslot)
+{
+    // same as CryptNand() on a zeroed buffer, but writes the keystream directly
+    u32 mode = (keyslot != 0x03) ? AES_CNT_CTRNAND_MODE : AES_CNT_TWLNAND_MODE;
+    u8 ALIGN(32) ctr[16];
+    u32 blocks = count * (0x200 / 0x10);
+    bool twl = (keyslot == 0x03);
+
+    GetNandCtr(ctr, sector, twl);
+    use_aeskey(keyslot);
+    ctr_keystream(buffer, blocks, mode, ctr);
+    CacheNandCtr(ctr, sector + count, twl);
 }
 
 void CryptSector0x96(void* buffer, bool encrypt)
@@ -250,9 +300,15 @@ int ReadNandBytes(void* buffer, u64 offset, u64 count, u32 keyslot, u32 nand_src
     if (!(offset % 0x200) && !(count % 0x200)) { // aligned data -> simple case
         // simple wrapper function for ReadNandSectors(...)
         return ReadNandSectors(buffer, offset / 0x200, count / 0x200, keyslot, nand_src);
+    } else if (NAND_SPAN_SECTORS(offset, count) <= NAND_BOUNCE_SECTORS) { // small misaligned data -> single read
+        u32 sector = offset / 0x200;
+        int errorcode = ReadNandSectors(NandBounceBuffer, sector, NAND_SPAN_SECTORS(offset, count), keyslot, nand_src);
+        if (errorcode != 0) return errorcode;
+        memcpy(buffer, NandBounceBuffer + (offset % 0x200), count);
+        return 0;
     } else { // misaligned data -> -___-
         u8* buffer8 = (u8*) buffer;
-        u8 l_buffer[0x200];
+        u8* l_buffer = NandBounceBuffer;
         int errorcode = 0;
         if (offset % 0x200) { // handle misaligned offset
             u32 offset_fix = 0x200 - (offset % 0x200);
@@ -283,9 +339,23 @@ int WriteNandBytes(const void* buffer, u64 offset, u64 count, u32 keyslot, u32 n
     if (!(offset % 0x200) && !(count % 0x200)) { // aligned data -> simple case
         // simple wrapper function for WriteNandSectors(...)
         return WriteNandSectors(buffer, offset / 0x200, count / 0x200, keyslot, nand_dst);
+    } else if (NAND_SPAN_SECTORS(offset, count) <= NAND_BOUNCE_SECTORS) { // small misaligned data -> single read / write
+        u32 sector = offset / 0x200;
+        u32 n_sectors = NAND_SPAN_SECTORS(offset, count);
+        int errorcode = 0;
+        if (n_sectors == 1) { // head and tail in the same sector
+            errorcode = ReadNandSectors(NandBounceBuffer, sector, 1, keyslot, nand_dst);
+        } else { // only head and tail sectors are needed, everything in between gets overwritten
+            if (offset % 0x200) errorcode = ReadNandSectors(NandBounceBuffer, sector, 1, keyslot, nand_dst);
+            if (!errorcode && ((offset + count) % 0x200))
+                errorcode = ReadNandSectors(NandBounceBuffer + ((n_sectors - 1) * 0x200), sector + n_sectors - 1, 1, keyslot, nand_dst);
+        }
+        if (errorcode != 0) return errorcode;
+        memcpy(NandBounceBuffer + (offset % 0x200), buffer, count);
+        return WriteNandSectors(NandBounceBuffer, sector, n_sectors, keyslot, nand_dst);
     } else { // misaligned data -> -___-
         u8* buffer8 = (u8*) buffer;
-        u8 l_buffer[0x200];
+        u8* l_buffer = NandBounceBuffer;
         int errorcode = 0;
         if (offset % 0x200) { // handle misaligned offset
             u32 offset_fix = 0x200 - (offset % 0x200);
@@ -337,6 +407,10 @@ int ReadNandSectors(void* buffer, u32 sector, u32 count, u32 keyslot, u32 nand_s
         int errorcode = sdmmc_nand_readsectors(sector, count, buffer8);
         if (errorcode) return errorcode;
     } else if (nand_src == NAND_ZERONAND) { // zero NAND (good for XORpads)
+        if ((keyslot < 0x40) && (keyslot != 0x11)) { // no need to decrypt zeroes
+            XorpadNand(buffer8, sector, count, keyslot);
+            return 0;
+        }
         memset(buffer8, 0, count * 0x200);
     } else {
         return -1;
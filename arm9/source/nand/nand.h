@@ -76,6 +76,7 @@ bool CheckSector0x96Crypto(void);
 bool CheckGenuineNandNcsd(void);
 
 void CryptNand(void* buffer, u32 sector, u32 count, u32 keyslot);
+void XorpadNand(void* buffer, u32 sector, u32 count, u32 keyslot);
 void CryptSector0x96(void* buffer, bool encrypt);
 int ReadNandBytes(void* buffer, u64 offset, u64 count, u32 keyslot, u32 nand_src);
 int WriteNandBytes(const void* buffer, u64 offset, u64 count, u32 keyslot, u32 nand_dst);
@@ -11,6 +11,8 @@
 #include "unittype.h"
 #include "aes.h"
 #include "sha.h"
+#include "timer.h"
+#include "crc32.h"
 
 // use NCCH crypto defines for everything
 #define CRYPTO_DECRYPT  NCCH_NOCRYPTO
@@ -20,6 +22,12 @@
 // partitionA path
 #define PART_PATH       "D:/partitionA.bin"
 
+// content offset for appending to a CIA
+#define CIA_CONTENT_APPEND  ((u64) -1)
+
+// number of failed RomFS blocks listed in the verification report
+#define ROMFS_REPORT_BLOCKS 4
+
 
 u32 GetCbcBlocks(FIL* file, void* buffer, u64 offset, u32 count, u8* titlekey, u8* forced_iv) {
     u8 iv[16] __attribute__((aligned(4)));
@@ -79,28 +87,34 @@ u32 GetNcchHeaders(NcchHeader* ncch, NcchExtHeader* exthdr, ExeFsHeader* exefs,
     return 0;
 }
 
-u32 CheckNcchHash(u8* expected, FIL* file, u32 size_data, u32 offset_ncch, NcchHeader* ncch, ExeFsHeader* exefs) {
+static u32 CheckNcchHashBuffered(u8* expected, FIL* file, u32 size_data, u32 offset_ncch, NcchHeader* ncch, ExeFsHeader* exefs, u8* buffer, u32 bufsize) {
     u32 offset_data = fvx_tell(file) - offset_ncch;
     u8 hash[32];
 
-    u8* buffer = (u8*) malloc(STD_BUFFER_SIZE);
-    if (!buffer) return 1;
-
     sha_init(SHA256_MODE);
-    for (u32 i = 0; i < size_data; i += STD_BUFFER_SIZE) {
-        u32 read_bytes = min(STD_BUFFER_SIZE, (size_data - i));
+    for (u32 i = 0; i < size_data; i += bufsize) {
+        u32 read_bytes = min(bufsize, (size_data - i));
         UINT bytes_read;
-        fvx_read(file, buffer, read_bytes, &bytes_read);
+        if ((fvx_read(file, buffer, read_bytes, &bytes_read) != FR_OK) || (bytes_read != read_bytes))
+            return 1;
         DecryptNcch(buffer, offset_data + i, read_bytes, ncch, exefs);
         sha_update(buffer, read_bytes);
     }
     sha_get(hash);
 
-    free(buffer);
-
     return (memcmp(hash, expected, 32) == 0) ? 0 : 1;
 }
 
+u32 CheckNcchHash(u8* expected, FIL* file, u32 size_data, u32 offset_ncch, NcchHeader* ncch, ExeFsHeader* exefs) {
+    u8* buffer = (u8*) malloc(STD_BUFFER_SIZE);
+    if (!buffer) return 1;
+
+    u32 ret = CheckNcchHashBuffered(expected, file, size_data, offset_ncch, ncch, exefs, buffer, STD_BUFFER_SIZE);
+
+    free(buffer);
+    return ret;
+}
+
 u32 LoadNcchHeaders(NcchHeader* ncch, NcchExtHeader* exthdr, ExeFsHeader* exefs, const char* path, u32 offset) {
     FIL file;
 
@@ -520,7 +534,88 @@ u32 VerifyTmdContent(const char* path, u64 offset, TmdContentChunk* chunk, const
     return memcmp(hash, expected, 32);
 }
 
-u32 VerifyNcchFile(const char* path, u32 offset, u32 size, bool sig_check) {
+static u32 VerifyExeFsFiles(FIL* file, u32 offset, NcchHeader* ncch, ExeFsHeader* exefs) {
+    u32 offset_files = offset + (ncch->offset_exefs * NCCH_MEDIA_UNIT) + 0x200;
+    u32 order[10];
+    u32 n_files = 0;
+
+    // hash files in the order they are stored, so reads stay sequential
+    for (u32 i = 0; i < 10; i++) {
+        if (!exefs->files[i].size) continue;
+        u32 n = n_files++;
+        for (; n && (exefs->files[order[n-1]].offset > exefs->files[i].offset); n--)
+            order[n] = order[n-1];
+        order[n] = i;
+    }
+
+    u8* buffer = (u8*) malloc(STD_BUFFER_SIZE);
+    if (!buffer) return 1;
+
+    u32 ret = 0;
+    for (u32 n = 0; !ret && (n < n_files); n++) {
+        ExeFsFileHeader* exefile = exefs->files + order[n];
+        u8* hash = exefs->hashes[9 - order[n]];
+        if (fvx_tell(file) != offset_files + exefile->offset)
+            fvx_lseek(file, offset_files + exefile->offset);
+        ret = CheckNcchHashBuffered(hash, file, exefile->size, offset, ncch, exefs, buffer, STD_BUFFER_SIZE);
+    }
+
+    free(buffer);
+    return ret;
+}
+
+// streams RomFS lvl3 once, checking every block against the resident lvl2 hash table
+// failed blocks are only listed for top-level, interactive verification
+static u32 VerifyRomFsLvl3(FIL* file, u32 offset, u64 offset_lvl3, NcchHeader* ncch, RomFsIvfcHeader* ivfc, u8* lvl2_data, const char* path, const char* pathstr, bool silent) {
+    u32 block_log = ivfc->log_lvl3;
+    u32 block_size = 1 << min(block_log, 24);
+    u64 size_lvl3 = align(ivfc->size_lvl3, block_size);
+    u32 n_blocks = size_lvl3 >> block_log;
+    u32 bufsize = max(STD_BUFFER_SIZE, block_size);
+    u32 failed[ROMFS_REPORT_BLOCKS];
+    u32 n_failed = 0;
+    u32 ret = 0;
+
+    if (block_log > 24) return 1; // sanity check, real titles use 4KiB blocks
+    u8* buffer = (u8*) malloc(bufsize);
+    if (!buffer) return 1;
+
+    fvx_lseek(file, offset + offset_lvl3);
+    for (u64 pos = 0; !ret && (pos < size_lvl3); pos += bufsize) {
+        u32 read_bytes = min(bufsize, size_lvl3 - pos);
+        UINT btr;
+        if ((fvx_read(file, buffer, read_bytes, &btr) != FR_OK) || (btr != read_bytes) ||
+            (DecryptNcch(buffer, offset_lvl3 + pos, read_bytes, ncch, NULL) != 0)) {
+            ret = 1;
+            break;
+        }
+        for (u32 b = 0; b < (read_bytes >> block_log); b++) {
+            u32 block = (pos >> block_log) + b;
+            if (sha_cmp(lvl2_data + (block*0x20), buffer + (b << block_log), block_size, SHA256_MODE) == 0)
+                continue;
+            if (n_failed < ROMFS_REPORT_BLOCKS) failed[n_failed] = block;
+            n_failed++;
+        }
+        if (!ShowProgress(pos + read_bytes, size_lvl3, path)) ret = 1;
+    }
+
+    free(buffer);
+    if (ret || !n_failed) return ret;
+    if (silent) return 1;
+
+    // report exactly which blocks failed
+    char liststr[ROMFS_REPORT_BLOCKS * 32];
+    char* ptr = liststr;
+    for (u32 i = 0; i < min(n_failed, ROMFS_REPORT_BLOCKS); i++)
+        ptr += snprintf(ptr, 32, "%lu @ %08lX\n", failed[i], failed[i] << block_log);
+    if (n_failed > ROMFS_REPORT_BLOCKS) snprintf(ptr, 32, "(...)");
+    else if (ptr > liststr) *(ptr - 1) = '\0';
+    ShowPrompt(false, STR_PATH_ROMFS_BLOCKS_FAILED_INFO, pathstr, n_failed, n_blocks, block_size, liststr);
+
+    return 1;
+}
+
+u32 VerifyNcchFile(const char* path, u32 offset, u32 size, bool sig_check, bool silent) {
     static bool cryptofix_always = false;
     bool cryptofix = false;
     NcchHeader ncch;
@@ -538,7 +633,7 @@ u32 VerifyNcchFile(const char* path, u32 offset, u32 size, bool sig_check) {
     // fetch and check NCCH header
     fvx_lseek(&file, offset);
     if (GetNcchHeaders(&ncch, NULL, NULL, &file, cryptofix) != 0) {
-        if (!offset) ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_NOT_NCCH_FILE);
+        if (!offset && !silent) ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_NOT_NCCH_FILE);
         fvx_close(&file);
         return 1;
     }
@@ -546,7 +641,7 @@ u32 VerifyNcchFile(const char* path, u32 offset, u32 size, bool sig_check) {
     // check NCCH size
     if (!size) size = fvx_size(&file) - offset;
     if ((fvx_size(&file) < offset) || (size < ncch.size * NCCH_MEDIA_UNIT)) {
-        if (!offset) ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_FILE_IS_TOO_SMALL);
+        if (!offset && !silent) ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_FILE_IS_TOO_SMALL);
         fvx_close(&file);
         return 1;
     }
@@ -561,7 +656,7 @@ u32 VerifyNcchFile(const char* path, u32 offset, u32 size, bool sig_check) {
             fvx_lseek(&file, offset);
             if (GetNcchHeaders(&ncch, NULL, &exefs, &file, cryptofix) == 0) {
                 if (cryptofix_always) borkedflags = true;
-                else {
+                else if (!silent) {
                     const char* optionstr[3] = { STR_ATTEMPT_FIX_THIS_TIME, STR_ATTEMPT_FIX_ALWAYS, STR_ABORT_VERIFICATION };
                     u32 user_select = ShowSelectPrompt(3, optionstr, "%s\n%s", pathstr, STR_ERROR_BAD_CRYPTO_FLAGS);
                     if ((user_select == 1) || (user_select == 2)) borkedflags = true;
@@ -570,7 +665,7 @@ u32 VerifyNcchFile(const char* path, u32 offset, u32 size, bool sig_check) {
             }
         }
         if (!borkedflags) {
-            if (!offset) ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_BAD_EXEFS_HEADER);
+            if (!offset && !silent) ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_BAD_EXEFS_HEADER);
             fvx_close(&file);
             return 1;
         }
@@ -579,21 +674,21 @@ u32 VerifyNcchFile(const char* path, u32 offset, u32 size, bool sig_check) {
     // fetch and check ExtHeader
     fvx_lseek(&file, offset);
     if (ncch.size_exthdr && (GetNcchHeaders(&ncch, &exthdr, NULL, &file, cryptofix) != 0)) {
-        if (!offset) ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_MISSING_EXTHEADER);
+        if (!offset && !silent) ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_MISSING_EXTHEADER);
         fvx_close(&file);
         return 1;
     }
 
     // signature verification
     if (sig_check && ValidateNcchSignature(&ncch, ncch.size_exthdr ? &exthdr : NULL) != 0) {
-        if (!offset) ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_SIGNATURE_CHECK_FAILED);
+        if (!offset && !silent) ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_SIGNATURE_CHECK_FAILED);
         fvx_close(&file);
         return 1;
     }
 
     // check / setup crypto
     if (SetupNcchCrypto(&ncch, NCCH_NOCRYPTO) != 0) {
-        if (!offset) ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_CRYPTO_NOT_SET_UP);
+        if (!offset && !silent) ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_CRYPTO_NOT_SET_UP);
         fvx_close(&file);
         return 1;
     }
@@ -622,15 +717,8 @@ u32 VerifyNcchFile(const char* path, u32 offset, u32 size, bool sig_check) {
 
     // thorough exefs verification (workaround for Process9)
     if (!ShowProgress(0, 0, path)) return 1;
-    if ((ncch.size_exefs > 0) && (memcmp(exthdr.name, "Process9", 8) != 0)) {
-        for (u32 i = 0; !ver_exefs && (i < 10); i++) {
-            ExeFsFileHeader* exefile = exefs.files + i;
-            u8* hash = exefs.hashes[9 - i];
-            if (!exefile->size) continue;
-            fvx_lseek(&file, offset + (ncch.offset_exefs * NCCH_MEDIA_UNIT) + 0x200 + exefile->offset);
-            ver_exefs = CheckNcchHash(hash, &file, exefile->size, offset, &ncch, &exefs);
-        }
-    }
+    if (!ver_exefs && (ncch.size_exefs > 0) && (memcmp(exthdr.name, "Process9", 8) != 0))
+        ver_exefs = VerifyExeFsFiles(&file, offset, &ncch, &exefs);
 
     // thorough romfs verification
     if (!ver_romfs && (ncch.size_romfs > 0)) {
@@ -703,14 +791,9 @@ u32 VerifyNcchFile(const char* path, u32 offset, u32 size, bool sig_check) {
             }
 
             // lvl3 verification (this will take long)
-            u64 offset_add = (ncch.offset_romfs * NCCH_MEDIA_UNIT) + GetRomFsLvOffset(&ivfc, 3);
-            n_blocks = align(ivfc.size_lvl3, 1 << ivfc.log_lvl3) >> ivfc.log_lvl3;
-            block_log = ivfc.log_lvl3;
-            fvx_lseek(&file, offset + offset_add);
-            for (u32 i = 0; !ver_romfs && (i < n_blocks); i++) {
-                ver_romfs = CheckNcchHash(lvl2_data + (i*0x20), &file, 1 << block_log, offset, &ncch, NULL);
-                offset_add += 1 << block_log;
-                if (!(i % 16) && !ShowProgress(i+1, n_blocks, path)) ver_romfs = 1;
+            if (!ver_romfs) {
+                u64 offset_add = (ncch.offset_romfs * NCCH_MEDIA_UNIT) + GetRomFsLvOffset(&ivfc, 3);
+                ver_romfs = VerifyRomFsLvl3(&file, offset, offset_add, &ncch, &ivfc, lvl2_data, path, pathstr, silent || offset);
             }
         }
 
@@ -719,7 +802,7 @@ u32 VerifyNcchFile(const char* path, u32 offset, u32 size, bool sig_check) {
         if (lvl2_data) free(lvl2_data);
     }
 
-    if (!offset && (ver_exthdr|ver_exefs|ver_romfs)) { // verification summary
+    if (!offset && !silent && (ver_exthdr|ver_exefs|ver_romfs)) { // verification summary
         ShowPrompt(false, STR_PATH_NCCH_VERIFICATION_FAILED_INFO, pathstr,
             (!ncch.size_exthdr) ? "-" : (ver_exthdr == 0) ? STR_OK : STR_FAIL,
             (!ncch.size_exefs) ? "-" : (ver_exefs == 0) ? STR_OK : STR_FAIL,
@@ -731,7 +814,7 @@ u32 VerifyNcchFile(const char* path, u32 offset, u32 size, bool sig_check) {
     return ver_exthdr|ver_exefs|ver_romfs;
 }
 
-u32 VerifyNcsdFile(const char* path, bool sig_check) {
+u32 VerifyNcsdFile(const char* path, bool sig_check, bool silent) {
     NcsdHeader ncsd;
 
     // path string
@@ -740,13 +823,13 @@ u32 VerifyNcsdFile(const char* path, bool sig_check) {
 
     // load NCSD header
     if (LoadNcsdHeader(&ncsd, path) != 0) {
-        ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_NOT_NCSD_FILE);
+        if (!silent) ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_NOT_NCSD_FILE);
         return 1;
     }
 
     // signature verification
     if (sig_check && ValidateNcsdSignature(&ncsd) != 0) {
-        ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_SIGNATURE_CHECK_FAILED);
+        if (!silent) ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_SIGNATURE_CHECK_FAILED);
         return 1;
     }
 
@@ -756,8 +839,8 @@ u32 VerifyNcsdFile(const char* path, bool sig_check) {
         u32 offset = partition->offset * NCSD_MEDIA_UNIT;
         u32 size = partition->size * NCSD_MEDIA_UNIT;
         if (!size) continue;
-        if (VerifyNcchFile(path, offset, size, sig_check) != 0) {
-            ShowPrompt(false, STR_PATH_CONTENT_N_SIZE_AT_OFFSET_VERIFICATION_FAILED,
+        if (VerifyNcchFile(path, offset, size, sig_check, silent) != 0) {
+            if (!silent) ShowPrompt(false, STR_PATH_CONTENT_N_SIZE_AT_OFFSET_VERIFICATION_FAILED,
                 pathstr, i, size, offset);
             return 1;
         }
@@ -766,7 +849,7 @@ u32 VerifyNcsdFile(const char* path, bool sig_check) {
     return 0;
 }
 
-u32 VerifyCiaFile(const char* path) {
+u32 VerifyCiaFile(const char* path, bool silent) {
     CiaStub* cia = (CiaStub*) malloc(sizeof(CiaStub));
     CiaInfo info;
     u8 titlekey[16];
@@ -781,14 +864,14 @@ u32 VerifyCiaFile(const char* path) {
     if ((LoadCiaStub(cia, path) != 0) ||
         (GetCiaInfo(&info, &(cia->header)) != 0) ||
         (GetTitleKey(titlekey, (Ticket*)&(cia->ticket)) != 0)) {
-        ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_PROBABLY_NOT_CIA_FILE);
+        if (!silent) ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_PROBABLY_NOT_CIA_FILE);
         free(cia);
         return 1;
     }
 
     // verify TMD
     if (VerifyTmd(&(cia->tmd)) != 0) {
-        ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_TMD_PROBABLY_CORRUPTED);
+        if (!silent) ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_TMD_PROBABLY_CORRUPTED);
         free(cia);
         return 1;
     }
@@ -802,7 +885,7 @@ u32 VerifyCiaFile(const char* path) {
         u16 index = getbe16(chunk->index);
         if (!(cnt_index[index/8] & (1 << (7-(index%8))))) continue; // don't check missing contents
         if (VerifyTmdContent(path, next_offset, chunk, titlekey) != 0) {
-            ShowPrompt(false, STR_PATH_ID_N_SIZE_AT_OFFSET_VERIFICATION_FAILED,
+            if (!silent) ShowPrompt(false, STR_PATH_ID_N_SIZE_AT_OFFSET_VERIFICATION_FAILED,
                 pathstr, getbe32(chunk->id), getbe64(chunk->size), next_offset);
             free(cia);
             return 1;
@@ -814,7 +897,7 @@ u32 VerifyCiaFile(const char* path) {
     return 0;
 }
 
-u32 VerifyTmdFile(const char* path, bool cdn) {
+u32 VerifyTmdFile(const char* path, bool cdn, bool silent) {
     static const u8 dlc_tid_high[] = { DLC_TID_HIGH };
     bool ignore_missing_dlc = false;
 
@@ -835,7 +918,7 @@ u32 VerifyTmdFile(const char* path, bool cdn) {
     TitleMetaData* tmd = (TitleMetaData*) malloc(TMD_SIZE_MAX);
     TmdContentChunk* content_list = (TmdContentChunk*) (tmd + 1);
     if ((LoadTmdFile(tmd, path) != 0) || (VerifyTmd(tmd) != 0)) {
-        ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_TMD_PROBABLY_CORRUPTED);
+        if (!silent) ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_TMD_PROBABLY_CORRUPTED);
         free(tmd);
         return 1;
     }
@@ -848,7 +931,7 @@ u32 VerifyTmdFile(const char* path, bool cdn) {
              (BuildFakeTicket(ticket, tmd->title_id) == 0) &&
              (FindTitleKey(ticket, tmd->title_id) == 0))) ||
             (GetTitleKey(titlekey, ticket) != 0)) {
-            ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_CDN_TITLEKEY_NOT_FOUND);
+            if (!silent) ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_CDN_TITLEKEY_NOT_FOUND);
             free(ticket);
             free(tmd);
             return 1;
@@ -867,12 +950,12 @@ u32 VerifyTmdFile(const char* path, bool cdn) {
             (cdn) ? "%08lx" : (dlc) ? "00000000/%08lx.app" : "%08lx.app", getbe32(chunk->id));
         TruncateString(pathstr, path_content, 32, 8);
         if (dlc && i && !PathExist(path_content)) {
-            if (!ignore_missing_dlc && !ShowPrompt(true, "%s\n%s", pathstr, STR_DLC_CONTENT_IS_MISSING_IGNORE_ALL_AND_CONTINUE)) res = 1;
+            if (!ignore_missing_dlc && !silent && !ShowPrompt(true, "%s\n%s", pathstr, STR_DLC_CONTENT_IS_MISSING_IGNORE_ALL_AND_CONTINUE)) res = 1;
             ignore_missing_dlc = true;
             continue;
         }
         if (VerifyTmdContent(path_content, 0, chunk, titlekey) != 0) {
-            ShowPrompt(false, "%s\n%s", pathstr, PathExist(path_content) ? STR_VERIFICATION_FAILED : STR_CONTENT_IS_MISSING);
+            if (!silent) ShowPrompt(false, "%s\n%s", pathstr, PathExist(path_content) ? STR_VERIFICATION_FAILED : STR_CONTENT_IS_MISSING);
             res = 1;
         }
     }
@@ -881,7 +964,7 @@ u32 VerifyTmdFile(const char* path, bool cdn) {
     return res;
 }
 
-u32 VerifyTieFile(const char* path) {
+u32 VerifyTieFile(const char* path, bool silent) {
     char path_tmd[64];
 
     // get the TMD path
@@ -889,14 +972,17 @@ u32 VerifyTieFile(const char* path) {
         return 1;
 
     // let the TMD verificator take over
-    return VerifyTmdFile(path_tmd, false);
+    return VerifyTmdFile(path_tmd, false, silent);
 }
 
-u32 VerifyTadFile(const char* path) {
+u32 VerifyTadFile(const char* path, bool silent) {
     TadStub tad;
     TadHeader* hdr = &(tad.header);
     TadFooter* ftr = &(tad.footer);
 
+    char pathstr[UTF_BUFFER_BYTESIZE(32)];
+    TruncateString(pathstr, path, 32, 8);
+
     // only works for GM9 decrypted TAD files
     if (!ShowProgress(0, 0, path)) return 1;
     if ((fvx_qread(path, &tad, 0, sizeof(TadStub), NULL) != FR_OK) ||
@@ -909,16 +995,19 @@ u32 VerifyTadFile(const char* path) {
         u8 hash[32];
         u32 len = align(hdr->content_size[i], 0x10);
         if (!len) continue; // non-existant section
-        if (!FileGetSha(path, hash, content_start, len, false) ||
-            (memcmp(hash, ftr->content_sha256[i], 32) != 0))
+        if (!FileGetSha(path, hash, content_start, len, false))
+            return 1;
+        if (memcmp(hash, ftr->content_sha256[i], 32) != 0) {
+            if (!silent) ShowPrompt(false, STR_PATH_SECTION_N_HASH_MISMATCH, pathstr, i);
             return 1;
+        }
         content_start += len + sizeof(TadBlockMetaData);
     }
 
     return 0;
 }
 
-u32 VerifyFirmFile(const char* path) {
+u32 VerifyFirmFile(const char* path, bool silent) {
     char pathstr[UTF_BUFFER_BYTESIZE(32)];
     TruncateString(pathstr, path, 32, 8);
 
@@ -941,7 +1030,7 @@ u32 VerifyFirmFile(const char* path) {
         void* section = ((u8*) firm_buffer) + sct->offset;
         if (!(sct->size)) continue;
         if (sha_cmp(sct->hash, section, sct->size, SHA256_MODE) != 0) {
-            ShowPrompt(false, STR_PATH_SECTION_N_HASH_MISMATCH, pathstr, i);
+            if (!silent) ShowPrompt(false, STR_PATH_SECTION_N_HASH_MISMATCH, pathstr, i);
             free(firm_buffer);
             return 1;
         }
@@ -949,10 +1038,10 @@ u32 VerifyFirmFile(const char* path) {
 
     // no arm11 / arm9 entrypoints?
     if (!header.entry_arm9) {
-        ShowPrompt(false, "%s\n%s", pathstr, STR_ARM9_ENTRYPOINT_IS_MISSING);
+        if (!silent) ShowPrompt(false, "%s\n%s", pathstr, STR_ARM9_ENTRYPOINT_IS_MISSING);
         free(firm_buffer);
         return 1;
-    } else if (!header.entry_arm11) {
+    } else if (!header.entry_arm11 && !silent) {
         ShowPrompt(false, "%s\n%s", pathstr, STR_WARNING_ARM11_ENTRYPOINT_IS_MISSING);
     }
 
@@ -960,7 +1049,7 @@ u32 VerifyFirmFile(const char* path) {
     return 0;
 }
 
-u32 VerifyBossFile(const char* path) {
+u32 VerifyBossFile(const char* path, bool silent) {
     BossHeader boss;
     u32 payload_size;
     bool encrypted = false;
@@ -976,7 +1065,7 @@ u32 VerifyBossFile(const char* path) {
     fvx_lseek(&file, 0);
     if ((fvx_read(&file, &boss, sizeof(BossHeader), &btr) != FR_OK) ||
         (btr != sizeof(BossHeader)) || (ValidateBossHeader(&boss, 0) != 0)) {
-        ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_NOT_A_BOSS_FILE);
+        if (!silent) ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_NOT_A_BOSS_FILE);
         fvx_close(&file);
         return 1;
     }
@@ -1021,7 +1110,7 @@ u32 VerifyBossFile(const char* path) {
     free(buffer);
 
     if (memcmp(hash, boss.hash_payload, 0x20) != 0) {
-        if (ShowPrompt(true, "%s\n%s", pathstr, STR_BOSS_PAYLOAD_HASH_MISMATCH_TRY_TO_FIX_IT)) {
+        if (!silent && ShowPrompt(true, "%s\n%s", pathstr, STR_BOSS_PAYLOAD_HASH_MISMATCH_TRY_TO_FIX_IT)) {
             // fix hash, reencrypt BOSS header if required, write to file
             memcpy(boss.hash_payload, hash, 0x20);
             if (encrypted) CryptBoss((void*) &boss, 0, sizeof(BossHeader), &boss);
@@ -1034,7 +1123,10 @@ u32 VerifyBossFile(const char* path) {
     return 0;
 }
 
-u32 VerifyTicketFile(const char* path) {
+u32 VerifyTicketFile(const char* path, bool silent) {
+    char pathstr[UTF_BUFFER_BYTESIZE(32)];
+    TruncateString(pathstr, path, 32, 8);
+
     // load ticket
     Ticket* ticket;
     if (LoadTicketFile(&ticket, path) != 0)
@@ -1042,33 +1134,334 @@ u32 VerifyTicketFile(const char* path) {
 
     // ticket verification is strict, fake-signed tickets are discarded
     u32 res = ValidateTicketSignature(ticket);
+    if ((res != 0) && !silent) ShowPrompt(false, "%s\n%s", pathstr, STR_ERROR_SIGNATURE_CHECK_FAILED);
     free(ticket);
     return res;
 }
 
-u32 VerifyGameFile(const char* path, bool sig_check) {
+// silent: no prompts, nothing gets fixed, only the result counts
+static u32 VerifyGameFileMode(const char* path, bool sig_check, bool silent) {
     u64 filetype = IdentifyFileType(path);
     if (filetype & GAME_CIA)
-        return VerifyCiaFile(path);
+        return VerifyCiaFile(path, silent);
     else if (filetype & GAME_NCSD)
-        return VerifyNcsdFile(path, sig_check);
+        return VerifyNcsdFile(path, sig_check, silent);
     else if (filetype & GAME_NCCH)
-        return VerifyNcchFile(path, 0, 0, sig_check);
+        return VerifyNcchFile(path, 0, 0, sig_check, silent);
     else if (filetype & (GAME_TMD|GAME_CDNTMD|GAME_TWLTMD))
-        return VerifyTmdFile(path, filetype & (GAME_CDNTMD|GAME_TWLTMD));
+        return VerifyTmdFile(path, filetype & (GAME_CDNTMD|GAME_TWLTMD), silent);
     else if (filetype & GAME_TIE)
-        return VerifyTieFile(path);
+        return VerifyTieFile(path, silent);
     else if (filetype & GAME_TAD)
-        return VerifyTadFile(path);
+        return VerifyTadFile(path, silent);
     else if (filetype & GAME_BOSS)
-        return VerifyBossFile(path);
+        return VerifyBossFile(path, silent);
     else if (filetype & SYS_FIRM)
-        return VerifyFirmFile(path);
+        return VerifyFirmFile(path, silent);
     else if (filetype & GAME_TICKET)
-        return VerifyTicketFile(path);
+        return VerifyTicketFile(path, silent);
     else return 1;
 }
 
+u32 VerifyGameFile(const char* path, bool sig_check) {
+    return VerifyGameFileMode(path, sig_check, false);
+}
+
+// batch verification, results are kept in a CSV manifest
+#define VERIFY_BATCH_MAX    1024
+#define VERIFY_TYPES        (GAME_CIA|GAME_NCSD|GAME_NCCH|GAME_TMD|GAME_CDNTMD|GAME_TWLTMD|GAME_TIE|GAME_TAD|GAME_TICKET|GAME_BOSS|SYS_FIRM)
+
+typedef struct {
+    char path[256];
+    u64 size;
+    u32 timestamp; // (fdate << 16) | ftime
+    u32 cluster; // first cluster, 0 for virtual files
+} VerifyTarget;
+
+typedef struct {
+    const char* path;
+    u64 size;
+    u32 timestamp;
+    u64 title_id;
+    const char* type;
+    u8 sha256[32];
+    bool ok;
+    bool used;
+} VerifyRecord;
+
+static const char* GetVerifyTypeName(u64 filetype) {
+    if (filetype & GAME_CIA) return "CIA";
+    else if (filetype & GAME_NCSD) return "NCSD";
+    else if (filetype & GAME_NCCH) return "NCCH";
+    else if (filetype & (GAME_TMD|GAME_CDNTMD|GAME_TWLTMD)) return "TMD";
+    else if (filetype & GAME_TIE) return "TIE";
+    else if (filetype & GAME_TAD) return "TAD";
+    else if (filetype & GAME_BOSS) return "BOSS";
+    else if (filetype & SYS_FIRM) return "FIRM";
+    else if (filetype & GAME_TICKET) return "TICKET";
+    return "-";
+}
+
+static u32 GetVerifyTarget(VerifyTarget* target, const char* path) {
+    FILINFO fno;
+    FIL file;
+
+    if ((fvx_stat(path, &fno) != FR_OK) || (fno.fattrib & AM_DIR))
+        return 1;
+    strncpy(target->path, path, 255);
+    target->path[255] = '\0';
+    target->size = fno.fsize;
+    target->timestamp = ((u32) fno.fdate << 16) | fno.ftime;
+    target->cluster = 0;
+    if (fvx_open(&file, path, FA_READ | FA_OPEN_EXISTING) == FR_OK) {
+        if (file.obj.fs) target->cluster = file.obj.sclust;
+        fvx_close(&file);
+    }
+
+    return 0;
+}
+
+static int compVerifyTarget(const void* e1, const void* e2) {
+    const VerifyTarget* t1 = (const VerifyTarget*) e1;
+    const VerifyTarget* t2 = (const VerifyTarget*) e2;
+    // group by drive, then by location on disk
+    int cmp = strncmp(t1->path, t2->path, 2);
+    if (cmp != 0) return cmp;
+    return (t1->cluster > t2->cluster) ? 1 : (t1->cluster < t2->cluster) ? -1 : strncmp(t1->path, t2->path, 256);
+}
+
+static int compVerifyRecord(const void* e1, const void* e2) {
+    return strncmp(((const VerifyRecord*) e1)->path, ((const VerifyRecord*) e2)->path, 256);
+}
+
+// parses manifest lines in place: "path",type,title_id,result,size,timestamp,sha256
+static u32 ParseVerifyManifest(char* manifest, VerifyRecord* records, u32 max_records) {
+    u32 n_records = 0;
+
+    for (char* line = manifest; line && *line && (n_records < max_records);) {
+        char* next = strchr(line, '\n');
+        if (next) *(next++) = '\0';
+
+        // quoted path, embedded quotes are doubled (unescaped in place)
+        VerifyRecord* rec = records + n_records;
+        char* path_end = NULL;
+        if (*line == '"') {
+            char* wr = line + 1;
+            for (char* rd = line + 1; *rd; rd++) {
+                if ((*rd == '"') && (rd[1] == '"')) rd++;
+                else if (*rd == '"') {
+                    *wr = '\0';
+                    path_end = rd;
+                    break;
+                }
+                *(wr++) = *rd;
+            }
+        }
+        if (path_end && (path_end[1] == ',')) {
+            char* field[6];
+            char* ptr = path_end + 1;
+            u32 n_field = 0;
+            for (; ptr && (n_field < 6); n_field++) {
+                *(ptr++) = '\0';
+                field[n_field] = ptr;
+                ptr = strchr(ptr, ',');
+            }
+            u64 size;
+            u64 title_id;
+            u32 timestamp;
+            if ((n_field == 6) && (sscanf(field[1], "%llX", &title_id) == 1) &&
+                (sscanf(field[3], "%llu", &size) == 1) &&
+                (sscanf(field[4], "%lX", &timestamp) == 1) &&
+                (strnlen(field[5], 65) >= 64)) {
+                rec->path = line + 1;
+                rec->type = field[0];
+                rec->title_id = title_id;
+                rec->size = size;
+                rec->timestamp = timestamp;
+                rec->ok = (strncmp(field[2], "ok", 3) == 0);
+                rec->used = false;
+                for (u32 i = 0; i < 32; i++) {
+                    u32 byte;
+                    if (sscanf(field[5] + (i*2), "%2lx", &byte) != 1) break;
+                    rec->sha256[i] = (u8) byte;
+                }
+                n_records++;
+            }
+        }
+        line = next;
+    }
+
+    qsort(records, n_records, sizeof(VerifyRecord), compVerifyRecord);
+    return n_records;
+}
+
+static u32 WriteVerifyLine(FIL* file, const char* path, const char* type, u64 title_id, bool ok, u64 size, u32 timestamp, const u8* sha256) {
+    char line[512 + 160];
+    char* ptr = line;
+    UINT bw;
+
+    // path is quoted, quotes inside get doubled
+    *(ptr++) = '"';
+    for (const char* c = path; *c && (c < path + 255); c++) {
+        if (*c == '"') *(ptr++) = '"';
+        *(ptr++) = *c;
+    }
+    ptr += snprintf(ptr, 128, "\",%s,%016llX,%s,", type, title_id, ok ? "ok" : "fail");
+    ptr += snprintf(ptr, 32, "%llu,%08lX,", size, timestamp);
+    for (u32 i = 0; i < 32; i++)
+        ptr += snprintf(ptr, 3, "%02X", sha256[i]);
+    *(ptr++) = '\n';
+
+    return ((fvx_write(file, line, ptr - line, &bw) == FR_OK) && (bw == (UINT) (ptr - line))) ? 0 : 1;
+}
+
+static u32 CollectVerifyTargets(char* path, VerifyTarget* targets, u32* n_targets) {
+    FILINFO fno;
+    DIR pdir;
+
+    if (fvx_opendir(&pdir, path) != FR_OK)
+        return 1;
+
+    char* fname = path + strnlen(path, 255);
+    *(fname++) = '/';
+    while ((fvx_readdir(&pdir, &fno) == FR_OK) && (*n_targets <= VERIFY_BATCH_MAX)) {
+        if ((strncmp(fno.fname, ".", 2) == 0) || (strncmp(fno.fname, "..", 3) == 0))
+            continue; // filter out virtual entries
+        if (fno.fname[0] == 0) break;
+        strncpy(fname, fno.fname, path + 255 - fname);
+        if (fno.fattrib & AM_DIR) CollectVerifyTargets(path, targets, n_targets);
+        else if ((IdentifyFileType(path) & VERIFY_TYPES) &&
+            (GetVerifyTarget(targets + *n_targets, path) == 0))
+            (*n_targets)++;
+    }
+    *(--fname) = '\0';
+
+    fvx_closedir(&pdir);
+    return 0;
+}
+
+static u32 VerifyGameFileTargets(VerifyTarget* targets, u32 n_targets, const char* manifest, bool sig_check, u32* n_total, u32* n_ok, u32* n_skipped) {
+    VerifyRecord* records = NULL;
+    char* old_manifest = NULL;
+    u32 n_records = 0;
+    bool write_err = false;
+    FIL file;
+
+    *n_total = 0;
+    *n_ok = 0;
+    *n_skipped = 0;
+
+    // load previous results (if any), all of them get written back
+    u32 manifest_size = fvx_qsize(manifest);
+    old_manifest = (char*) malloc(manifest_size + 1);
+    if (!old_manifest) return 1;
+    UINT br = 0;
+    if (manifest_size && ((fvx_qread(manifest, old_manifest, 0, manifest_size, &br) != FR_OK) ||
+        (br != manifest_size))) {
+        free(old_manifest);
+        return 1; // don't overwrite what we couldn't read
+    }
+    old_manifest[br] = '\0';
+    u32 max_records = 1;
+    for (char* ptr = old_manifest; (ptr = strchr(ptr, '\n')); ptr++)
+        max_records++;
+    records = (VerifyRecord*) malloc(max_records * sizeof(VerifyRecord));
+    if (!records) {
+        free(old_manifest);
+        return 1;
+    }
+    n_records = ParseVerifyManifest(old_manifest, records, max_records);
+
+    if (fvx_open(&file, manifest, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+        free(old_manifest);
+        free(records);
+        return 1;
+    }
+
+    const char* header = "path,type,title_id,result,size,timestamp,sha256\n";
+    UINT bw;
+    if ((fvx_write(&file, header, strlen(header), &bw) != FR_OK) || (bw != strlen(header)))
+        write_err = true;
+
+    // read everything in on-disk order
+    qsort(targets, n_targets, sizeof(VerifyTarget), compVerifyTarget);
+
+    u32 ret = 0;
+    for (u32 i = 0; !ret && !write_err && (i < n_targets); i++) {
+        VerifyTarget* target = targets + i;
+        u64 filetype = IdentifyFileType(target->path);
+        u8 sha256[32];
+        (*n_total)++;
+
+        // one hashing pass per file, its result is both the skip check and the manifest entry
+        if (!FileGetSha(target->path, sha256, 0, 0, false)) {
+            ret = 1; // cancelled or unreadable
+            break;
+        }
+
+        // unchanged since last good verification (size, timestamp and hash)? skip it
+        VerifyRecord key = { .path = target->path };
+        VerifyRecord* rec = (VerifyRecord*) bsearch(&key, records, n_records, sizeof(VerifyRecord), compVerifyRecord);
+        bool ok;
+        if (rec) rec->used = true;
+        if (rec && rec->ok && (rec->size == target->size) && (rec->timestamp == target->timestamp) &&
+            (memcmp(rec->sha256, sha256, 32) == 0)) {
+            ok = true;
+            (*n_skipped)++;
+        } else ok = (VerifyGameFileMode(target->path, sig_check, true) == 0);
+        if (ok) (*n_ok)++;
+
+        if (WriteVerifyLine(&file, target->path, GetVerifyTypeName(filetype), GetGameFileTitleId(target->path),
+            ok, target->size, target->timestamp, sha256) != 0) {
+            write_err = true;
+            break;
+        }
+    }
+
+    // keep results for files that were not processed in this run
+    for (u32 i = 0; !write_err && (i < n_records); i++) {
+        VerifyRecord* rec = records + i;
+        if (rec->used) continue;
+        write_err = (WriteVerifyLine(&file, rec->path, rec->type, rec->title_id,
+            rec->ok, rec->size, rec->timestamp, rec->sha256) != 0);
+    }
+    if (write_err) ret = 1;
+
+    fvx_close(&file);
+    free(old_manifest);
+    free(records);
+    return ret;
+}
+
+u32 VerifyGameFileBatch(const char** paths, u32 n_paths, const char* manifest, bool sig_check, u32* n_total, u32* n_ok, u32* n_skipped) {
+    // one extra slot, so we know when the list got cut short
+    VerifyTarget* targets = (VerifyTarget*) malloc((VERIFY_BATCH_MAX + 1) * sizeof(VerifyTarget));
+    u32 n_targets = 0;
+    if (!targets) return 1;
+
+    for (u32 i = 0; (i < n_paths) && (n_targets <= VERIFY_BATCH_MAX); i++) {
+        char path[256];
+        strncpy(path, paths[i], 255);
+        path[255] = '\0';
+        if (CollectVerifyTargets(path, targets, &n_targets) == 0) continue; // directory
+        if ((IdentifyFileType(paths[i]) & VERIFY_TYPES) &&
+            (GetVerifyTarget(targets + n_targets, paths[i]) == 0))
+            n_targets++;
+    }
+
+    if ((n_targets > VERIFY_BATCH_MAX) &&
+        !ShowPrompt(true, STR_TOO_MANY_FILES_ONLY_FIRST_N_VERIFIED, VERIFY_BATCH_MAX)) {
+        free(targets);
+        return 1;
+    }
+    n_targets = min(n_targets, VERIFY_BATCH_MAX);
+
+    u32 ret = VerifyGameFileTargets(targets, n_targets, manifest, sig_check, n_total, n_ok, n_skipped);
+
+    free(targets);
+    return ret;
+}
+
 u32 CheckEncryptedNcchFile(const char* path, u32 offset) {
     NcchHeader ncch;
     if (LoadNcchHeaders(&ncch, NULL, NULL, path, offset) != 0)
@@ -1910,6 +2303,152 @@ u32 InstallCiaContent(const char* drv, const char* path_content, u32 offset, u32
     return ret;
 }
 
+// batch install session, title.db / ticket.db updates are staged and committed at once
+typedef struct {
+    u8 title_id[8];
+    char path_titledb[32];
+    char path_ticketdb[32];
+    char path_cmd[64]; // CMAC fixed on commit, empty if not required
+    TitleInfoEntry tie;
+    TicketCommon ticket;
+    Ticket* ticket_old; // previous ticket, for rollback
+    bool ticket_done;
+} InstallBatchEntry;
+
+static InstallBatchEntry* install_batch = NULL;
+static u32 install_batch_max = 0;
+static u32 install_batch_n = 0;
+
+u32 BeginInstallBatch(u32 max_titles) {
+    if (install_batch || !max_titles) return 1;
+    install_batch = (InstallBatchEntry*) malloc(max_titles * sizeof(InstallBatchEntry));
+    if (!install_batch) return 1;
+    install_batch_max = max_titles;
+    install_batch_n = 0;
+    return 0;
+}
+
+static u32 StageInstallBatchEntry(const u8* title_id, const char* path_titledb, const char* path_ticketdb,
+    const char* path_cmd, TitleInfoEntry* tie, TicketCommon* ticket) {
+    if (install_batch_n >= install_batch_max) return 1;
+    InstallBatchEntry* entry = install_batch + install_batch_n++;
+    memset(entry, 0, sizeof(InstallBatchEntry));
+    memcpy(entry->title_id, title_id, 8);
+    strncpy(entry->path_titledb, path_titledb, sizeof(entry->path_titledb) - 1);
+    strncpy(entry->path_ticketdb, path_ticketdb, sizeof(entry->path_ticketdb) - 1);
+    if (path_cmd) strncpy(entry->path_cmd, path_cmd, sizeof(entry->path_cmd) - 1);
+    memcpy(&(entry->tie), tie, sizeof(TitleInfoEntry));
+    memcpy(&(entry->ticket), ticket, sizeof(TicketCommon));
+    return 0;
+}
+
+static void UnstageInstallBatchTitle(u64 tid64) {
+    u32 n = 0;
+    for (u32 i = 0; install_batch && (i < install_batch_n); i++) {
+        if (getbe64(install_batch[i].title_id) == tid64) continue;
+        if (n != i) memcpy(install_batch + n, install_batch + i, sizeof(InstallBatchEntry));
+        n++;
+    }
+    install_batch_n = n;
+}
+
+// applies all staged entries for one database (mounted as image)
+static u32 CommitInstallBatchDb(const char* path_db, bool ticketdb) {
+    for (u32 i = 0; i < install_batch_n; i++) {
+        InstallBatchEntry* entry = install_batch + i;
+        if (strncmp(ticketdb ? entry->path_ticketdb : entry->path_titledb, path_db, 32) != 0)
+            continue;
+        if (!ticketdb) {
+            if (AddTitleInfoEntryToDB(PART_PATH, entry->title_id, &(entry->tie), true) != 0)
+                return 1;
+            continue;
+        }
+        if (ReadTicketFromDB(PART_PATH, entry->title_id, &(entry->ticket_old)) != 0)
+            entry->ticket_old = NULL;
+        entry->ticket_done = true;
+        if (AddTicketToDB(PART_PATH, entry->title_id, (Ticket*) &(entry->ticket), true) != 0) {
+            // workaround for bug #685
+            RemoveTicketFromDB(PART_PATH, entry->title_id);
+            if (AddTicketToDB(PART_PATH, entry->title_id, (Ticket*) &(entry->ticket), true) != 0)
+                return 1;
+        }
+    }
+    return 0;
+}
+
+// undoes CommitInstallBatchDb(): old tickets are restored, new title entries are removed
+static void RollbackInstallBatchDb(const char* path_db, bool ticketdb) {
+    for (u32 i = 0; i < install_batch_n; i++) {
+        InstallBatchEntry* entry = install_batch + i;
+        if (strncmp(ticketdb ? entry->path_ticketdb : entry->path_titledb, path_db, 32) != 0)
+            continue;
+        if (!ticketdb) RemoveTitleInfoEntryFromDB(PART_PATH, entry->title_id);
+        else if (entry->ticket_done) {
+            RemoveTicketFromDB(PART_PATH, entry->title_id);
+            if (entry->ticket_old) AddTicketToDB(PART_PATH, entry->title_id, entry->ticket_old, true);
+        }
+    }
+}
+
+u32 EndInstallBatch(bool to_emunand) {
+    if (!install_batch) return 1;
+
+    // ensure remounting the old mount path
+    char path_store[256] = { 0 };
+    char* path_bak = NULL;
+    strncpy(path_store, GetMountPath(), 256);
+    if (*path_store) path_bak = path_store;
+
+    // every database is mounted (and its CMAC fixed) exactly once: title dbs first, then ticket dbs
+    u32 ret = 0;
+    u32 n_done = 0; // databases processed so far
+    for (u32 pass = 0; !ret && (pass < 2); pass++) {
+        bool ticketdb = (pass == 1);
+        for (u32 i = 0; !ret && (i < install_batch_n); i++) {
+            const char* path_db = ticketdb ? install_batch[i].path_ticketdb : install_batch[i].path_titledb;
+            bool first = true; // first entry using this database?
+            for (u32 j = 0; first && (j < i); j++)
+                first = (strncmp(ticketdb ? install_batch[j].path_ticketdb : install_batch[j].path_titledb, path_db, 32) != 0);
+            if (!first) continue;
+            if (!InitImgFS(path_db) || (CommitInstallBatchDb(path_db, ticketdb) != 0)) ret = 1;
+            n_done++;
+        }
+    }
+
+    // rollback everything on failure
+    if (ret) {
+        for (u32 pass = 0; pass < 2; pass++) {
+            bool ticketdb = (pass == 1);
+            for (u32 i = 0; n_done && (i < install_batch_n); i++) {
+                const char* path_db = ticketdb ? install_batch[i].path_ticketdb : install_batch[i].path_titledb;
+                bool first = true;
+                for (u32 j = 0; first && (j < i); j++)
+                    first = (strncmp(ticketdb ? install_batch[j].path_ticketdb : install_batch[j].path_titledb, path_db, 32) != 0);
+                if (!first) continue;
+                if (InitImgFS(path_db)) RollbackInstallBatchDb(path_db, ticketdb);
+                n_done--;
+            }
+        }
+    }
+
+    // restore old mount path
+    InitImgFS(path_bak);
+
+    // cleanup / fix CMACs where required
+    for (u32 i = 0; i < install_batch_n; i++) {
+        InstallBatchEntry* entry = install_batch + i;
+        if (ret) UninstallGameData(getbe64(entry->title_id), false, false, false, to_emunand);
+        else if (*(entry->path_cmd)) FixFileCmac(entry->path_cmd, true);
+        if (entry->ticket_old) free(entry->ticket_old);
+    }
+
+    free(install_batch);
+    install_batch = NULL;
+    install_batch_max = 0;
+    install_batch_n = 0;
+    return ret;
+}
+
 u32 InstallCiaSystemData(CiaStub* cia, const char* drv) {
     // this assumes contents already installed(!)
     // we use hardcoded IDs for CMD (0x1), TMD (0x0), save (0x1/0x0)
@@ -2003,6 +2542,11 @@ u32 InstallCiaSystemData(CiaStub* cia, const char* drv) {
     if (ncch && (SetupSystemForNcch(ncch, to_emunand) != 0))
         return 1;
 
+    // batch install? stage database changes for later
+    if (install_batch)
+        return StageInstallBatchEntry(title_id, path_titledb, path_ticketdb,
+            syscmd ? NULL : path_cmd, &tie, ticket);
+
     // write ticket and title databases
     // ensure remounting the old mount path
     char path_store[256] = { 0 };
@@ -2037,7 +2581,7 @@ u32 InstallCiaSystemData(CiaStub* cia, const char* drv) {
     return 0;
 }
 
-u32 InsertCiaContent(const char* path_cia, const char* path_content, u32 offset, u32 size,
+static u32 WriteCiaContent(const char* path_cia, u64 offset_dest, const char* path_content, u32 offset, u32 size,
     TmdContentChunk* chunk, const u8* titlekey, bool force_legit, bool cxi_fix, bool cdn_decrypt) {
     // crypto types / ctr
     bool ncch_decrypt = !force_legit;
@@ -2055,13 +2599,13 @@ u32 InsertCiaContent(const char* path_cia, const char* path_content, u32 offset,
     fsize = fvx_size(&ofile);
     if (offset > fsize) return 1;
     if (!size) size = fsize - offset;
-    if (fvx_open(&dfile, path_cia, FA_WRITE | FA_OPEN_APPEND) != FR_OK) {
+    if (fvx_open(&dfile, path_cia, FA_WRITE | FA_OPEN_ALWAYS) != FR_OK) {
         fvx_close(&ofile);
         return 1;
     }
 
     // ensure free space for destination file
-    UINT offset_dest = fvx_size(&dfile);
+    if (offset_dest == CIA_CONTENT_APPEND) offset_dest = fvx_size(&dfile);
     if ((fvx_lseek(&dfile, offset_dest + size) != FR_OK) ||
         (fvx_tell(&dfile) != offset_dest + size) ||
         (fvx_lseek(&dfile, offset_dest) != FR_OK)) {
@@ -2097,7 +2641,7 @@ u32 InsertCiaContent(const char* path_cia, const char* path_content, u32 offset,
     u32 ret = 0;
     GetTmdCtr(ctr_in, chunk);
     GetTmdCtr(ctr_out, chunk);
-    if (!ShowProgress(0, 0, path_content)) ret = 1;
+    if (!ShowProgress(0, 0, path_content)) ret = 3; // cancelled
     for (u32 i = 0; (i < size) && (ret == 0); i += STD_BUFFER_SIZE) {
         u32 read_bytes = min(STD_BUFFER_SIZE, (size - i));
         if (fvx_read(&ofile, buffer, read_bytes, &bytes_read) != FR_OK) ret = 2;
@@ -2109,7 +2653,7 @@ u32 InsertCiaContent(const char* path_cia, const char* path_content, u32 offset,
         if (cia_encrypt && (EncryptCiaContentSequential(buffer, read_bytes, ctr_out, titlekey) != 0)) ret = 1;
         if (fvx_write(&dfile, buffer, read_bytes, &bytes_written) != FR_OK) ret = 1;
         if ((read_bytes != bytes_read) || (bytes_read != bytes_written)) ret = 1;
-        if (!ShowProgress(offset + i + read_bytes, fsize, path_content)) ret = 1;
+        if ((ret == 0) && !ShowProgress(offset + i + read_bytes, fsize, path_content)) ret = 3;
     }
     u8 hash[0x20] __attribute__((aligned(4)));
     sha_get(hash);
@@ -2117,6 +2661,7 @@ u32 InsertCiaContent(const char* path_cia, const char* path_content, u32 offset,
     free(buffer);
     fvx_close(&ofile);
     fvx_close(&dfile);
+    if (ret != 0) return ret; // failed or cancelled, hash is incomplete
 
     // force legit?
     if (force_legit && (memcmp(hash, chunk->hash, 0x20) != 0)) return 2;
@@ -2129,6 +2674,12 @@ u32 InsertCiaContent(const char* path_cia, const char* path_content, u32 offset,
     return ret;
 }
 
+u32 InsertCiaContent(const char* path_cia, const char* path_content, u32 offset, u32 size,
+    TmdContentChunk* chunk, const u8* titlekey, bool force_legit, bool cxi_fix, bool cdn_decrypt) {
+    return WriteCiaContent(path_cia, CIA_CONTENT_APPEND, path_content, offset, size,
+        chunk, titlekey, force_legit, cxi_fix, cdn_decrypt);
+}
+
 u32 InsertCiaMeta(const char* path_cia, CiaMeta* meta) {
     FIL file;
     UINT btw;
@@ -2351,17 +2902,210 @@ u32 BuildCiaFromTadFile(const char* path_tad, const char* path_dest, bool force_
     return 0;
 }
 
+// CIA build journal, allows resuming / updating CIA builds from TMD
+#define CIA_JOURNAL_MAGIC   'C', 'J', 'N', 'L'
+#define CIA_JOURNAL_EXT     ".jnl"
+#define CIA_JOURNAL_DONE_EXT ".done.jnl" // last finished build, next to the work file
+
+typedef struct {
+    TmdContentChunk src; // chunk as found in the source TMD
+    TmdContentChunk out; // chunk as written to the CIA
+    u64 offset; // relative to CIA content offset
+    u64 src_size; // size of the source content file
+    u32 src_timestamp; // (fdate << 16) | ftime of the source content file
+} PACKED_STRUCT CiaJournalEntry;
+
+typedef struct {
+    u8 magic[4];
+    u8 title_id[8];
+    u32 flags;
+    u64 offset_content;
+    u64 cia_size; // finished builds only: size / timestamp of the CIA
+    u32 cia_timestamp;
+    char path_cia[256]; // finished builds only: where the CIA was put
+    u32 n_entries;
+    CiaJournalEntry entries[TMD_MAX_CONTENTS];
+} PACKED_STRUCT CiaJournal;
+
+#define CIA_JOURNAL_SIZE(n) (sizeof(CiaJournal) - ((TMD_MAX_CONTENTS - (n)) * sizeof(CiaJournalEntry)))
+
+static void GetCiaJournalPath(char* path_jnl, const char* path_cia, bool done) {
+    snprintf(path_jnl, 256, "%s%s", path_cia, done ? CIA_JOURNAL_DONE_EXT : CIA_JOURNAL_EXT);
+}
+
+static u32 LoadCiaJournal(CiaJournal* jnl, const char* path_cia, bool done) {
+    const u8 magic[] = { CIA_JOURNAL_MAGIC };
+    char path_jnl[256];
+    UINT br;
+
+    GetCiaJournalPath(path_jnl, path_cia, done);
+    if ((fvx_qread(path_jnl, jnl, 0, sizeof(CiaJournal), &br) != FR_OK) ||
+        (br < CIA_JOURNAL_SIZE(0)) || (memcmp(jnl->magic, magic, sizeof(magic)) != 0) ||
+        (jnl->n_entries > TMD_MAX_CONTENTS) || (br != CIA_JOURNAL_SIZE(jnl->n_entries)))
+        return 1;
+    jnl->path_cia[255] = '\0';
+
+    return 0;
+}
+
+static u32 SaveCiaJournal(CiaJournal* jnl, const char* path_cia, bool done) {
+    char path_jnl[256];
+    UINT size = CIA_JOURNAL_SIZE(jnl->n_entries);
+    UINT bw;
+    FIL file;
+
+    GetCiaJournalPath(path_jnl, path_cia, done);
+    if (fvx_open(&file, path_jnl, FA_WRITE | FA_OPEN_ALWAYS) != FR_OK)
+        return 1;
+    u32 ret = ((fvx_write(&file, jnl, size, &bw) == FR_OK) && (bw == size) &&
+        (f_truncate(&file) == FR_OK)) ? 0 : 1;
+    fvx_close(&file);
+
+    return ret;
+}
+
+static void RemoveCiaJournal(const char* path_cia, bool done) {
+    char path_jnl[256];
+    GetCiaJournalPath(path_jnl, path_cia, done);
+    fvx_unlink(path_jnl);
+}
+
+// keeps the journal of a finished build, so the next build can copy unchanged contents from its CIA
+static void FinishCiaJournal(const char* path_cia, const char* path_final) {
+    CiaJournal* jnl = (CiaJournal*) malloc(sizeof(CiaJournal));
+    FILINFO fno;
+
+    RemoveCiaJournal(path_cia, true);
+    if (jnl && (LoadCiaJournal(jnl, path_cia, false) == 0) && (fvx_stat(path_final, &fno) == FR_OK)) {
+        jnl->cia_size = fno.fsize;
+        jnl->cia_timestamp = ((u32) fno.fdate << 16) | fno.ftime;
+        snprintf(jnl->path_cia, sizeof(jnl->path_cia), "%s", path_final);
+        SaveCiaJournal(jnl, path_cia, true);
+    }
+    RemoveCiaJournal(path_cia, false);
+    free(jnl);
+}
+
+// drops all entries that are not fully inside [0, size)
+static void ClipCiaJournal(CiaJournal* jnl, u64 size) {
+    u32 n = 0;
+    for (u32 i = 0; i < jnl->n_entries; i++) {
+        CiaJournalEntry* entry = jnl->entries + i;
+        if (entry->offset + getbe64(entry->out.size) <= size)
+            memcpy(jnl->entries + n++, entry, sizeof(CiaJournalEntry));
+    }
+    jnl->n_entries = n;
+}
+
+// drops all entries that overlap [offset, offset + size)
+static void CutCiaJournal(CiaJournal* jnl, u64 offset, u64 size) {
+    u32 n = 0;
+    for (u32 i = 0; i < jnl->n_entries; i++) {
+        CiaJournalEntry* entry = jnl->entries + i;
+        if ((entry->offset >= offset + size) || (entry->offset + getbe64(entry->out.size) <= offset))
+            memcpy(jnl->entries + n++, entry, sizeof(CiaJournalEntry));
+    }
+    jnl->n_entries = n;
+}
+
+// source file has to be unchanged and the content has to be inside the CIA, offset (u64) -1 matches any offset
+static CiaJournalEntry* FindCiaJournalEntry(CiaJournal* jnl, TmdContentChunk* chunk, u64 offset, FILINFO* fno_src, u64 size_cia) {
+    for (u32 i = 0; i < jnl->n_entries; i++) {
+        CiaJournalEntry* entry = jnl->entries + i;
+        if (((offset != (u64) -1) && (entry->offset != offset)) ||
+            (memcmp(&(entry->src), chunk, sizeof(TmdContentChunk)) != 0))
+            continue;
+        if ((entry->src_size != fno_src->fsize) ||
+            (entry->src_timestamp != (((u32) fno_src->fdate << 16) | fno_src->ftime)) ||
+            (jnl->offset_content + entry->offset + getbe64(entry->out.size) > size_cia))
+            return NULL;
+        return entry;
+    }
+    return NULL;
+}
+
+// (re)starts the journal for a build, keeps entries still valid for the existing CIA
+static void SetupCiaJournal(CiaJournal* jnl, const char* path_cia, CiaStub* cia, u32 flags) {
+    const u8 magic[] = { CIA_JOURNAL_MAGIC };
+    CiaInfo info;
+    FILINFO fno;
+
+    GetCiaInfo(&info, &(cia->header));
+    if ((LoadCiaJournal(jnl, path_cia, false) != 0) || (fvx_stat(path_cia, &fno) != FR_OK) ||
+        (memcmp(jnl->title_id, cia->tmd.title_id, 8) != 0) || (jnl->flags != flags) ||
+        (jnl->offset_content != info.offset_content) || (fno.fsize < info.offset_content)) {
+        memset(jnl, 0, CIA_JOURNAL_SIZE(0));
+        memcpy(jnl->magic, magic, sizeof(magic));
+        memcpy(jnl->title_id, cia->tmd.title_id, 8);
+        jnl->flags = flags;
+        jnl->offset_content = info.offset_content;
+    } else ClipCiaJournal(jnl, fno.fsize - info.offset_content);
+}
+
+// journal of the last finished build, only usable if its CIA is still there, unchanged
+static void SetupPrevCiaJournal(CiaJournal* jnl, const char* path_cia, CiaStub* cia, u32 flags) {
+    FILINFO fno;
+    if ((LoadCiaJournal(jnl, path_cia, true) != 0) || !*(jnl->path_cia) ||
+        (memcmp(jnl->title_id, cia->tmd.title_id, 8) != 0) || (jnl->flags != flags) ||
+        (fvx_stat(jnl->path_cia, &fno) != FR_OK) || (fno.fsize != jnl->cia_size) ||
+        (jnl->cia_timestamp != (((u32) fno.fdate << 16) | fno.ftime)))
+        memset(jnl, 0, CIA_JOURNAL_SIZE(0));
+}
+
+// plain copy of an already built content from another CIA, returns 3 if cancelled
+static u32 CopyCiaContent(const char* path_cia, u64 offset_dest, const char* path_src, u64 offset_src, u64 size) {
+    FIL sfile;
+    FIL dfile;
+    UINT br, bw;
+
+    if (fvx_open(&sfile, path_src, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+        return 1;
+    if (fvx_open(&dfile, path_cia, FA_WRITE | FA_OPEN_ALWAYS) != FR_OK) {
+        fvx_close(&sfile);
+        return 1;
+    }
+
+    u8* buffer = (u8*) malloc(STD_BUFFER_SIZE);
+    u32 ret = (buffer && (fvx_lseek(&sfile, offset_src) == FR_OK) &&
+        (fvx_lseek(&dfile, offset_dest) == FR_OK) && (fvx_tell(&dfile) == offset_dest)) ? 0 : 1;
+    if ((ret == 0) && !ShowProgress(0, 0, path_src)) ret = 3;
+    for (u64 pos = 0; (pos < size) && (ret == 0); pos += STD_BUFFER_SIZE) {
+        UINT btr = (UINT) min(STD_BUFFER_SIZE, size - pos);
+        if ((fvx_read(&sfile, buffer, btr, &br) != FR_OK) || (br != btr) ||
+            (fvx_write(&dfile, buffer, btr, &bw) != FR_OK) || (bw != btr))
+            ret = 1;
+        else if (!ShowProgress(pos + btr, size, path_src)) ret = 3;
+    }
+
+    if (buffer) free(buffer);
+    fvx_close(&sfile);
+    fvx_close(&dfile);
+    return ret;
+}
+
+static void AddCiaJournalEntry(CiaJournal* jnl, TmdContentChunk* src, TmdContentChunk* out, u64 offset, FILINFO* fno_src) {
+    if (jnl->n_entries >= TMD_MAX_CONTENTS) return; // can't happen with sane TMDs
+    CiaJournalEntry* entry = jnl->entries + jnl->n_entries++;
+    memcpy(&(entry->src), src, sizeof(TmdContentChunk));
+    memcpy(&(entry->out), out, sizeof(TmdContentChunk));
+    entry->offset = offset;
+    entry->src_size = fno_src->fsize;
+    entry->src_timestamp = ((u32) fno_src->fdate << 16) | fno_src->ftime;
+}
+
 u32 BuildInstallFromTmdFileBuffered(const char* path_tmd, const char* path_dest, bool force_legit, bool cdn, void* buffer, bool install) {
     const u8 dlc_tid_high[] = { DLC_TID_HIGH };
     static const u8 twl_tid_high[] = { 0x00, 0x03, 0x00, 0x04 };
     static const u8 ctr_tid_high[] = { 0x00, 0x04, 0x80, 0x04 };
 
     CiaStub* cia = (CiaStub*) buffer;
+    CiaJournal* jnl = (CiaJournal*) (cia + 1); // only used for CIA builds
+    CiaJournal* jnl_prev = jnl + 1; // last finished build of this title
     TitleMetaData* tmd = &(cia->tmd);
     TmdContentChunk* content_list = cia->content_list;
 
     // Init progress bar
-    if (!ShowProgress(0, 0, path_tmd)) return 1;
+    if (!ShowProgress(0, 0, path_tmd)) return 3; // cancelled
 
     // build the CIA stub
     memset(cia, 0, sizeof(CiaStub));
@@ -2427,26 +3171,66 @@ u32 BuildInstallFromTmdFileBuffered(const char* path_tmd, const char* path_dest,
     u32 ret = 0;
     u8 titlekey[16] = { 0xFF };
     if ((GetTitleKey(titlekey, (Ticket*)&(cia->ticket)) != 0) && force_legit) return 1;
+    if (!install) {
+        u32 flags = (force_legit ? 0x1 : 0) | (cdn ? 0x2 : 0);
+        SetupCiaJournal(jnl, path_dest, cia, flags);
+        SetupPrevCiaJournal(jnl_prev, path_dest, cia, flags);
+    }
     if (!install && (WriteCiaStub(cia, path_dest) != 0)) return 1;
+    u64 next_offset = 0;
     for (u32 i = 0; (i < content_count) && (i < TMD_MAX_CONTENTS); i++) {
         TmdContentChunk* chunk = &(content_list[i]);
         if (present[i / 8] & (1 << (i % 8))) {
+            u32 size = (u32) getbe64(chunk->size);
             snprintf(name_content, 256 - (name_content - path_content),
                 (cdn) ? "%08lx" : (dlc && !cdn) ? "00000000/%08lx.app" : "%08lx.app", getbe32(chunk->id));
-            if (!install && ((ret = InsertCiaContent(path_dest, path_content, 0, (u32) getbe64(chunk->size),
-                    chunk, titlekey, force_legit, false, cdn)) != 0)) {
-                ShowPrompt(false, STR_ID_N_DOT_N_STATUS, getbe64(title_id), getbe32(chunk->id),
-                    (ret == 2) ? STR_CONTENT_IS_CORRUPT : STR_INSERT_CONTENT_FAILED);
-                return 1;
+            if (!install) { // skip contents already in the CIA from an interrupted run
+                FILINFO fno_src;
+                if (fvx_stat(path_content, &fno_src) != FR_OK) memset(&fno_src, 0, sizeof(FILINFO));
+                CiaJournalEntry* entry = FindCiaJournalEntry(jnl, chunk, next_offset, &fno_src, fvx_qsize(path_dest));
+                CiaJournalEntry* entry_prev = (entry) ? NULL :
+                    FindCiaJournalEntry(jnl_prev, chunk, (u64) -1, &fno_src, jnl_prev->cia_size);
+                if (entry) memcpy(chunk, &(entry->out), sizeof(TmdContentChunk));
+                else {
+                    TmdContentChunk chunk_src;
+                    memcpy(&chunk_src, chunk, sizeof(TmdContentChunk));
+                    CutCiaJournal(jnl, next_offset, size);
+                    if (SaveCiaJournal(jnl, path_dest, false) != 0) ret = 1;
+                    else if (entry_prev) { // unchanged since the last finished build, copy it from there
+                        ret = CopyCiaContent(path_dest, jnl->offset_content + next_offset, jnl_prev->path_cia,
+                            jnl_prev->offset_content + entry_prev->offset, size);
+                        if (ret == 0) memcpy(chunk, &(entry_prev->out), sizeof(TmdContentChunk));
+                    } else ret = WriteCiaContent(path_dest, jnl->offset_content + next_offset, path_content, 0, size,
+                        chunk, titlekey, force_legit, false, cdn);
+                    if (ret == 3) return 3; // cancelled, the journal keeps what's done
+                    if (ret != 0) {
+                        ShowPrompt(false, STR_ID_N_DOT_N_STATUS, getbe64(title_id), getbe32(chunk->id),
+                            (ret == 2) ? STR_CONTENT_IS_CORRUPT : STR_INSERT_CONTENT_FAILED);
+                        return 1;
+                    }
+                    AddCiaJournalEntry(jnl, &chunk_src, chunk, next_offset, &fno_src);
+                    SaveCiaJournal(jnl, path_dest, false);
+                }
             }
-            if (install && (InstallCiaContent(path_dest, path_content, 0, (u32) getbe64(chunk->size),
+            if (install && (InstallCiaContent(path_dest, path_content, 0, size,
                     chunk, title_id, titlekey, false, cdn) != 0)) {
                 ShowPrompt(false, STR_ID_N_DOT_N_STATUS, getbe64(title_id), getbe32(chunk->id), STR_INSTALL_CONTENT_FAILED);
                 return 1;
             }
+            next_offset += size;
         }
     }
 
+    // cut off leftovers from an earlier, larger CIA
+    if (!install) {
+        FIL file;
+        if (fvx_open(&file, path_dest, FA_WRITE | FA_OPEN_EXISTING) != FR_OK)
+            return 1;
+        bool res = (fvx_lseek(&file, jnl->offset_content + next_offset) == FR_OK) && (f_truncate(&file) == FR_OK);
+        fvx_close(&file);
+        if (!res) return 1;
+    }
+
     // try to build & insert meta, but ignore result (from encrypted data?)
     if (!install && content_count) {
         CiaMeta* meta = (CiaMeta*) malloc(sizeof(CiaMeta));
@@ -2485,7 +3269,7 @@ u32 InstallFromTmdFile(const char* path_tmd, const char* path_dest) {
 }
 
 u32 BuildCiaFromTmdFile(const char* path_tmd, const char* path_dest, bool force_legit, bool cdn) {
-    void* buffer = (void*) malloc(sizeof(CiaStub));
+    void* buffer = (void*) malloc(sizeof(CiaStub) + (2 * sizeof(CiaJournal)));
     if (!buffer) return 1;
 
     u32 ret = BuildInstallFromTmdFileBuffered(path_tmd, path_dest, force_legit, cdn, buffer, false);
@@ -2819,8 +3603,14 @@ u32 BuildCiaFromGameFile(const char* path, bool force_legit) {
         dot = dest + strnlen(dest, 256);
     snprintf(dot, 16, ".%s", "tmp.cia");
 
+    // builds from TMD are journaled, work file is named by title id so a cancelled build can resume
+    char work[256];
+    u64 title_id = (filetype & (GAME_TMD|GAME_CDNTMD|GAME_TWLTMD|GAME_TIE)) ? GetGameFileTitleId(path) : 0;
+    if (title_id) snprintf(work, sizeof(work), "%s/%016llX.%s", OUTPUT_PATH, title_id, "tmp.cia");
+    else strncpy(work, dest, sizeof(work));
+
     if (!CheckWritePermissions(dest)) return 1;
-    f_unlink(dest); // remove the file if it already exists
+    if (!title_id) f_unlink(work); // remove the file if it already exists
 
     // ensure the output dir exists
     if (fvx_rmkdir(OUTPUT_PATH) != FR_OK)
@@ -2828,9 +3618,9 @@ u32 BuildCiaFromGameFile(const char* path, bool force_legit) {
 
     // build CIA from game file
     if (filetype & GAME_TIE)
-        ret = BuildCiaFromTieFile(path, dest, force_legit);
+        ret = BuildCiaFromTieFile(path, work, force_legit);
     else if (filetype & (GAME_TMD|GAME_CDNTMD|GAME_TWLTMD))
-        ret = BuildCiaFromTmdFile(path, dest, force_legit, filetype & (GAME_CDNTMD|GAME_TWLTMD));
+        ret = BuildCiaFromTmdFile(path, work, force_legit, filetype & (GAME_CDNTMD|GAME_TWLTMD));
     else if (filetype & GAME_NCCH)
         ret = BuildInstallFromNcchFile(path, dest, false);
     else if (filetype & GAME_NCSD)
@@ -2842,14 +3632,15 @@ u32 BuildCiaFromGameFile(const char* path, bool force_legit) {
     else ret = 1;
 
     // finalizing CIA build...
-    if (ret != 0) { // try to get rid of the borked file
-        fvx_unlink(dest);
+    if (ret != 0) { // try to get rid of the borked file (cancelled journaled builds are kept for resuming)
+        if (!title_id || (ret != 3)) {
+            fvx_unlink(work);
+            if (title_id) RemoveCiaJournal(work, false);
+        }
     } else { // find a proper extension for CIA
-        char dest_old[256];
-        strncpy(dest_old, dest, 256);
         CiaStub* cia = (CiaStub*) malloc(sizeof(CiaStub));
         if (!cia) return 1;
-        if (LoadCiaStub(cia, dest) != 0) {
+        if (LoadCiaStub(cia, work) != 0) {
             free(cia);
             return 1;
         }
@@ -2863,7 +3654,8 @@ u32 BuildCiaFromGameFile(const char* path, bool force_legit) {
         free(cia);
 
         fvx_unlink(dest);
-        fvx_rename(dest_old, dest);
+        fvx_rename(work, dest);
+        if (title_id) FinishCiaJournal(work, dest); // next build of this title can copy from here
     }
 
     return ret;
@@ -2909,7 +3701,10 @@ u32 InstallGameFile(const char* path, bool to_emunand) {
     else ret = 1;
 
     // cleanup on failed installs, but leave ticket and save untouched
-    if (ret != 0) UninstallGameData(tid64, true, false, false, to_emunand);
+    if (ret != 0) {
+        UnstageInstallBatchTitle(tid64);
+        UninstallGameData(tid64, true, false, false, to_emunand);
+    }
 
     return ret;
 }
@@ -3225,7 +4020,7 @@ u32 ExtractCodeFromCxiFile(const char* path, const char* path_out, char* extstr)
     return 0;
 }
 
-u32 CompressCode(const char* path, const char* path_out) {
+u32 CompressCode(const char* path, const char* path_out, u32 level) {
     char dest[256];
 
     strncpy(dest, path_out ? path_out : OUTPUT_PATH, 255);
@@ -3246,7 +4041,7 @@ u32 CompressCode(const char* path, const char* path_out) {
 
     // load code.bin and compress code
     if ((fvx_qread(path, code_dec, 0, code_dec_size, NULL) != FR_OK) ||
-        (!CompressCodeLzss(code_dec, code_dec_size, code_cmp, &code_cmp_size))) {
+        (!CompressCodeLzss(code_dec, code_dec_size, code_cmp, &code_cmp_size, level))) {
         free(code_dec);
         free(code_cmp);
         return 1;
@@ -3305,7 +4100,44 @@ u64 GetAnyFileTrimmedSize(const char* path) {
     return trimsize;
 }
 
-u64 GetGameFileTrimmedSize(const char* path) {
+// trimmed sizes are cached for display, entries are identified by path hash, file size and timestamp
+#define TRIM_CACHE_SIZE 256
+
+typedef struct {
+    u32 path_hash;
+    u32 timestamp;
+    u64 fsize;
+    u64 trimsize;
+} TrimCacheEntry;
+
+static TrimCacheEntry trim_cache[TRIM_CACHE_SIZE];
+static u32 trim_cache_next = 0;
+
+static TrimCacheEntry* GetTrimCacheEntry(const char* path, FILINFO* fno, bool add) {
+    u32 path_hash = crc32_calculate(0, (const u8*) path, strnlen(path, 256));
+    u32 timestamp = ((u32) fno->fdate << 16) | fno->ftime;
+
+    for (u32 i = 0; i < TRIM_CACHE_SIZE; i++) {
+        TrimCacheEntry* entry = trim_cache + i;
+        if (entry->path_hash != path_hash) continue;
+        if ((entry->fsize == fno->fsize) && (entry->timestamp == timestamp))
+            return entry;
+        if (!add) return NULL;
+        entry->fsize = fno->fsize; // stale, reuse the slot
+        entry->timestamp = timestamp;
+        return entry;
+    }
+    if (!add) return NULL;
+
+    TrimCacheEntry* entry = trim_cache + trim_cache_next;
+    trim_cache_next = (trim_cache_next + 1) % TRIM_CACHE_SIZE;
+    entry->path_hash = path_hash;
+    entry->fsize = fno->fsize;
+    entry->timestamp = timestamp;
+    return entry;
+}
+
+static u64 GetGameFileTrimmedSizeUncached(const char* path) {
     u64 filetype = IdentifyFileType(path);
     u64 trimsize = 0;
 
@@ -3349,8 +4181,23 @@ u64 GetGameFileTrimmedSize(const char* path) {
     return trimsize;
 }
 
+u64 GetGameFileTrimmedSize(const char* path) {
+    FILINFO fno;
+    if (fvx_stat(path, &fno) != FR_OK)
+        return 0;
+
+    TrimCacheEntry* entry = GetTrimCacheEntry(path, &fno, false);
+    if (entry) return entry->trimsize;
+
+    u64 trimsize = GetGameFileTrimmedSizeUncached(path);
+    entry = GetTrimCacheEntry(path, &fno, true);
+    entry->trimsize = trimsize;
+    return trimsize;
+}
+
 u32 TrimGameFile(const char* path) {
-    u64 trimsize = GetGameFileTrimmedSize(path);
+    // never truncate based on the cache
+    u64 trimsize = GetGameFileTrimmedSizeUncached(path);
     if (!trimsize) return 1;
 
     // actual truncate routine - FAT only
@@ -3363,6 +4210,11 @@ u32 TrimGameFile(const char* path) {
     }
     fx_close(&fp);
 
+    // trimmed file stays trimmed, remember that
+    FILINFO fno;
+    if (fvx_stat(path, &fno) == FR_OK)
+        GetTrimCacheEntry(path, &fno, true)->trimsize = trimsize;
+
     // all done
     return 0;
 }
@@ -3642,20 +4494,35 @@ u32 ShowGameCheckerInfo(const char* path) {
     return 0;
 }
 
-u32 BuildNcchInfoXorpads(const char* destdir, const char* path) {
+static int compNcchInfoEntrySize(const void* e1, const void* e2) {
+    const NcchInfoEntry* entry1 = (const NcchInfoEntry*) e1;
+    const NcchInfoEntry* entry2 = (const NcchInfoEntry*) e2;
+    // largest first
+    if (entry1->size_b != entry2->size_b)
+        return (entry1->size_b < entry2->size_b) ? 1 : -1;
+    return strncasecmp(entry1->filename, entry2->filename, 112);
+}
+
+u32 BuildNcchInfoXorpads(const char* destdir, const char* path, u64* total_size, u64* msec) {
     FIL fp_info;
     FIL fp_xorpad;
     UINT bt;
 
+    if (total_size) *total_size = 0;
+    if (msec) *msec = 0;
     if (!CheckWritePermissions(destdir)) return 1;
     // warning: this will only build output dirs in the root dir (!)
     if ((f_stat(destdir, NULL) != FR_OK) && (f_mkdir(destdir) != FR_OK))
         return 1;
 
+    // writing to SD card or RAM drive doesn't touch the AES engine, so the key only gets set up once per pad
+    // anything else (NAND, SD aliases, images) may use it, the key is reselected for each chunk there
+    u32 drvtype = DriveType(destdir);
+    bool reselect_key = !(drvtype & (DRV_SDCARD|DRV_RAMDRIVE)) || (drvtype & DRV_ALIAS);
+
     NcchInfoHeader info;
     u32 version = 0;
     u32 entry_size = 0;
-    u32 ret = 0;
     if (fvx_open(&fp_info, path, FA_READ | FA_OPEN_EXISTING) != FR_OK)
         return 1;
     fvx_lseek(&fp_info, 0);
@@ -3666,34 +4533,63 @@ u32 BuildNcchInfoXorpads(const char* destdir, const char* path) {
     }
     version = GetNcchInfoVersion(&info);
     entry_size = (version == 3) ? NCCHINFO_V3_SIZE : sizeof(NcchInfoEntry);
-    if (!version) ret = 1;
+    if (!version || (fvx_size(&fp_info) < sizeof(NcchInfoHeader) + ((u64) info.n_entries * entry_size))) {
+        fvx_close(&fp_info);
+        return 1;
+    }
+    if (!info.n_entries) { // nothing to do
+        fvx_close(&fp_info);
+        return 0;
+    }
 
+    // read and fix all entries first, then schedule them by size
+    NcchInfoEntry* entries = (NcchInfoEntry*) malloc(info.n_entries * sizeof(NcchInfoEntry));
+    u64 size_all = 0;
+    u32 ret = 0;
+    if (!entries) ret = 1;
+    for (u32 i = 0; (i < info.n_entries) && (ret == 0); i++) {
+        NcchInfoEntry* entry = entries + i;
+        if ((fvx_read(&fp_info, entry, entry_size, &bt) != FR_OK) ||
+            (bt != entry_size)) ret = 1;
+        else if (FixNcchInfoEntry(entry, version) != 0) ret = 1;
+        else size_all += entry->size_b;
+    }
+    fvx_close(&fp_info);
+    if (ret == 0) qsort(entries, info.n_entries, sizeof(NcchInfoEntry), compNcchInfoEntrySize);
+
+    // the buffer is filled directly with keystream, no need to zero it
     u8* buffer = (u8*) malloc(STD_BUFFER_SIZE);
     if (!buffer) ret = 1;
+
+    u64 timer = timer_start();
+    u64 size_done = 0;
     for (u32 i = 0; (i < info.n_entries) && (ret == 0); i++) {
-        NcchInfoEntry entry;
-        if ((fvx_read(&fp_info, &entry, entry_size, &bt) != FR_OK) ||
-            (bt != entry_size)) ret = 1;
-        if (FixNcchInfoEntry(&entry, version) != 0) ret = 1;
-        if (ret != 0) break;
+        NcchInfoEntry* entry = entries + i;
+        u8 ALIGN(32) ctr[16];
+        memcpy(ctr, entry->ctr, 16);
 
         char dest[256]; // 256 is the maximum length of a full path
-        snprintf(dest, sizeof(dest), "%s/%s", destdir, entry.filename);
+        snprintf(dest, sizeof(dest), "%s/%s", destdir, entry->filename);
         if (fvx_open(&fp_xorpad, dest, FA_WRITE | FA_CREATE_ALWAYS) == FR_OK) {
-            if (!ShowProgress(0, 0, entry.filename)) ret = 1;
-            for (u64 p = 0; (p < entry.size_b) && (ret == 0); p += STD_BUFFER_SIZE) {
-                UINT create_bytes = min(STD_BUFFER_SIZE, entry.size_b - p);
-                if (BuildNcchInfoXorpad(buffer, &entry, create_bytes, p) != 0) ret = 1;
+            if (!ShowProgress(size_done, size_all, entry->filename)) ret = 1;
+            else if (SetupNcchInfoXorpadKey(entry) != 0) ret = 1;
+            for (u64 p = 0; (p < entry->size_b) && (ret == 0); p += STD_BUFFER_SIZE) {
+                UINT create_bytes = min(STD_BUFFER_SIZE, entry->size_b - p);
+                if (reselect_key && p && (SetupNcchInfoXorpadKey(entry) != 0)) ret = 1;
+                else if (BuildNcchInfoXorpadStream(buffer, create_bytes, ctr) != 0) ret = 1;
                 if (fvx_write(&fp_xorpad, buffer, create_bytes, &bt) != FR_OK) ret = 1;
-                if (!ShowProgress(p + create_bytes, entry.size_b, entry.filename)) ret = 1;
+                if (!ShowProgress(size_done + p + create_bytes, size_all, entry->filename)) ret = 1;
             }
             fvx_close(&fp_xorpad);
         } else ret = 1;
         if (ret != 0) f_unlink(dest); // get rid of the borked file
+        else size_done += entry->size_b;
     }
 
+    if (total_size) *total_size = size_done;
+    if (msec) *msec = timer_msec(timer);
     if (buffer) free(buffer);
-    fvx_close(&fp_info);
+    if (entries) free(entries);
     return ret;
 }
 
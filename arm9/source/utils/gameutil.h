@@ -2,17 +2,22 @@
 
 #include "common.h"
 
+#define VERIFY_MANIFEST_PATH    OUTPUT_PATH "/verify.csv"
+
 u32 VerifyGameFile(const char* path, bool sig_check);
+u32 VerifyGameFileBatch(const char** paths, u32 n_paths, const char* manifest, bool sig_check, u32* n_total, u32* n_ok, u32* n_skipped);
 u32 CheckEncryptedGameFile(const char* path);
 u32 CryptGameFile(const char* path, bool inplace, bool encrypt, bool restore);
 u32 BuildCiaFromGameFile(const char* path, bool force_legit);
 u32 InstallGameFile(const char* path, bool to_emunand);
+u32 BeginInstallBatch(u32 max_titles);
+u32 EndInstallBatch(bool to_emunand);
 u32 InstallCifinishFile(const char* path, bool to_emunand);
 u32 InstallTicketFile(const char* path, bool to_emunand);
 u32 DumpTicketForGameFile(const char* path, bool force_legit);
 u32 DumpCxiSrlFromGameFile(const char* path);
 u32 ExtractCodeFromCxiFile(const char* path, const char* path_out, char* extstr);
-u32 CompressCode(const char* path, const char* path_out);
+u32 CompressCode(const char* path, const char* path_out, u32 level);
 u64 GetGameFileTrimmedSize(const char* path);
 u32 TrimGameFile(const char* path);
 u32 ShowGameFileIcon(const char* path, u16* screen);
@@ -21,7 +26,7 @@ u64 GetGameFileTitleId(const char* path);
 u32 UninstallGameDataTie(const char* path, bool remove_tie, bool remove_ticket, bool remove_save);
 u32 GetTmdContentPath(char* path_content, const char* path_tmd);
 u32 GetTieContentPath(char* path_content, const char* path_tie);
-u32 BuildNcchInfoXorpads(const char* destdir, const char* path);
+u32 BuildNcchInfoXorpads(const char* destdir, const char* path, u64* total_size, u64* msec);
 u32 CheckHealthAndSafetyInject(const char* hsdrv);
 u32 InjectHealthAndSafety(const char* path, const char* destdrv);
 u32 BuildTitleKeyInfo(const char* path, bool dec, bool dump);
@@ -51,6 +51,57 @@
 //  "%c:/private/movable.sed"                                   movable.sed
 //  "%c:/agbsave.bin"                                           virtual AGBSAVE file
 
+// CMAC path matcher patterns, relative to the drive ("X:")
+// '#' stands for a hex field (max 8 digits), '@' for a hex field (max 16 digits, value ignored)
+#define CMAC_PATTERN_EXTDATA_SD     "/extdata/#/#/#/#"
+#define CMAC_PATTERN_SAVEDATA_SD    "/title/#/#/data/#"
+#define CMAC_PATTERN_CMD_SD         "/title/#/#/content/cmd/#"
+#define CMAC_PATTERN_EXTDATA_SYS    "/data/@@/extdata/#/#/#/#"
+#define CMAC_PATTERN_QUOTA_SYS      "/data/@@/extdata/#/#/Quota.dat"
+#define CMAC_PATTERN_SAVEDATA_SYS   "/data/@@/sysdata/#/#"
+#define CMAC_PATTERN_CMD_TWLN       "/title/00030004/#/content/cmd/#"
+
+typedef struct {
+    u32 type;
+    char drv;
+    u32 xid_high, xid_low; // extdata ID
+    u32 fid_high, fid_low; // extfile ID
+    u32 tid_high, tid_low; // title ID
+    u32 sid; // save ID / various uses
+} CmacPathInfo;
+
+// used by the batch CMAC fixer, keyslot 0x30 is only set up once per drive
+static bool cmac_batch_mode = false;
+static char cmac_batch_slot0x30_drv = '\0';
+
+// matches a path (without drive) against one of the patterns above, literals are case insensitive
+// trailing characters in the path are ignored, same as sscanf() would
+static bool MatchCmacPattern(const char* path, const char* pattern, u32* values, u32 n_values) {
+    u32 n = 0;
+    for (; *pattern; pattern++) {
+        if ((*pattern == '#') || (*pattern == '@')) {
+            u32 max_digits = (*pattern == '#') ? 8 : 16;
+            u32 value = 0;
+            u32 d = 0;
+            for (; d < max_digits; d++, path++) {
+                char c = *path;
+                if ((c >= '0') && (c <= '9')) value = (value << 4) | (c - '0');
+                else if ((c >= 'a') && (c <= 'f')) value = (value << 4) | (c - 'a' + 10);
+                else if ((c >= 'A') && (c <= 'F')) value = (value << 4) | (c - 'A' + 10);
+                else break;
+            }
+            if (!d) return false;
+            if (*pattern == '#') {
+                if (n >= n_values) return false;
+                values[n++] = value;
+            }
+        } else if (tolower((unsigned char) *(path++)) != tolower((unsigned char) *pattern)) {
+            return false;
+        }
+    }
+    return (n == n_values);
+}
+
 
 u32 SetupSlot0x30(char drv) {
     u8 keyy[16] __attribute__((aligned(32)));
@@ -59,11 +110,17 @@ u32 SetupSlot0x30(char drv) {
     if ((drv == 'A') || (drv == 'S')) drv = '1';
     else if ((drv == 'B') || (drv == 'E')) drv = '4';
 
+    if (cmac_batch_mode && (cmac_batch_slot0x30_drv == drv)) {
+        use_aeskey(0x30);
+        return 0;
+    }
+
     snprintf(movable_path, sizeof(movable_path), "%c:/private/movable.sed", drv);
     if (fvx_qread(movable_path, keyy, 0x110, 0x10, NULL) != FR_OK) return 1;
     setup_aeskeyY(0x30, keyy);
     use_aeskey(0x30);
 
+    if (cmac_batch_mode) cmac_batch_slot0x30_drv = drv;
     return 0;
 }
 
@@ -146,15 +203,15 @@ u32 ReadWriteFileCmac(const char* path, u8* cmac, bool do_write, bool check_perm
     else return (fvx_qwrite(path, cmac, offset, 0x10, NULL) != FR_OK) ? 1 : 0;
 }
 
-u32 CalculateFileCmac(const char* path, u8* cmac) {
-    u32 cmac_type = 0;
-    char drv = *path; // drive letter
-    u32 xid_high, xid_low; // extdata ID
-    u32 fid_high, fid_low; // extfile ID
-    u32 tid_high, tid_low; // title ID
-    u32 sid; // save ID / various uses
-    char* name;
-    char* ext;
+static u32 GetCmacPathInfo(const char* path, CmacPathInfo* info) {
+    u32 v[4];
+    const char* name;
+    const char* ext;
+    const char* lpath = path + 2; // path without drive
+
+    memset(info, 0, sizeof(CmacPathInfo));
+    info->drv = *path; // drive letter
+    if (!info->drv || (path[1] != ':')) return 0;
 
     name = strrchr(path, '/'); // filename
     if (!name) return 0; // will not happen
@@ -162,52 +219,78 @@ u32 CalculateFileCmac(const char* path, u8* cmac) {
     ext = strrchr(name, '.'); // extension
     if (ext) ext++;
 
+    char drv = info->drv;
     if ((drv == 'A') || (drv == 'B')) { // data installed on SD
-        if (sscanf(path, "%c:/extdata/%08lx/%08lx/%08lx/%08lx", &drv, &xid_high, &xid_low, &fid_high, &fid_low) == 5) {
-            sid = 1;
-            cmac_type = CMAC_EXTDATA_SD;
-        } else if ((sscanf(path, "%c:/title/%08lx/%08lx/data/%08lx.sav", &drv, &tid_high, &tid_low, &sid) == 4) &&
+        if (MatchCmacPattern(lpath, CMAC_PATTERN_EXTDATA_SD, v, 4)) {
+            info->xid_high = v[0];
+            info->xid_low = v[1];
+            info->fid_high = v[2];
+            info->fid_low = v[3];
+            info->sid = 1;
+            info->type = CMAC_EXTDATA_SD;
+        } else if (MatchCmacPattern(lpath, CMAC_PATTERN_SAVEDATA_SD, v, 3) &&
             ext && (strncasecmp(ext, "sav", 4) == 0)) {
-            if (CheckCmacHeader(path) == 0) cmac_type = CMAC_SAVEDATA_SD; // Check for 3DS save data first.
-            else if (LocateAgbSaveSdBottomSlot(path, NULL) > 0) cmac_type = CMAC_AGBSAVE_SD;
-        } else if ((sscanf(path, "%c:/title/%08lx/%08lx/content/cmd/%08lx.cmd", &drv, &tid_high, &tid_low, &sid) == 4) &&
+            info->tid_high = v[0];
+            info->tid_low = v[1];
+            info->sid = v[2];
+            if (CheckCmacHeader(path) == 0) info->type = CMAC_SAVEDATA_SD; // Check for 3DS save data first.
+            else if (LocateAgbSaveSdBottomSlot(path, NULL) > 0) info->type = CMAC_AGBSAVE_SD;
+        } else if (MatchCmacPattern(lpath, CMAC_PATTERN_CMD_SD, v, 3) &&
             ext && (strncasecmp(ext, "cmd", 4) == 0)) {
-            cmac_type = CMAC_CMD_SD; // this needs special handling, it's in here just for detection
+            info->tid_high = v[0];
+            info->tid_low = v[1];
+            info->sid = v[2];
+            info->type = CMAC_CMD_SD; // this needs special handling, it's in here just for detection
         }
     } else if ((drv == '1') || (drv == '4') || (drv == '7')) { // data on CTRNAND
-        u64 id0_high, id0_low; // ID0
-        if (sscanf(path, "%c:/data/%016llx%016llx/extdata/%08lx/%08lx/%08lx/%08lx", &drv, &id0_high, &id0_low, &xid_high, &xid_low, &fid_high, &fid_low) == 7) {
-            sid = 1;
-            cmac_type = CMAC_EXTDATA_SYS;
-        } else if ((sscanf(path, "%c:/data/%016llx%016llx/extdata/%08lx/%08lx/Quota.dat", &drv, &id0_high, &id0_low, &xid_high, &xid_low) == 5) && (strncasecmp(name, "Quota.dat", 10) == 0)) {
-            sid = 0;
-            fid_low = fid_high = 0;
-            cmac_type = CMAC_EXTDATA_SYS;
-        } else if (sscanf(path, "%c:/data/%016llx%016llx/sysdata/%08lx/%08lx", &drv, &id0_high, &id0_low, &fid_low, &fid_high) == 5)
-            cmac_type = CMAC_SAVEDATA_SYS;
+        if (MatchCmacPattern(lpath, CMAC_PATTERN_EXTDATA_SYS, v, 4)) {
+            info->xid_high = v[0];
+            info->xid_low = v[1];
+            info->fid_high = v[2];
+            info->fid_low = v[3];
+            info->sid = 1;
+            info->type = CMAC_EXTDATA_SYS;
+        } else if (MatchCmacPattern(lpath, CMAC_PATTERN_QUOTA_SYS, v, 2) && (strncasecmp(name, "Quota.dat", 10) == 0)) {
+            info->xid_high = v[0];
+            info->xid_low = v[1];
+            info->sid = 0;
+            info->fid_low = info->fid_high = 0;
+            info->type = CMAC_EXTDATA_SYS;
+        } else if (MatchCmacPattern(lpath, CMAC_PATTERN_SAVEDATA_SYS, v, 2)) {
+            info->fid_low = v[0];
+            info->fid_high = v[1];
+            info->type = CMAC_SAVEDATA_SYS;
+        }
     } else if ((drv == '2') || (drv == '5') || (drv == '8')) { // data on TWLN
-        if ((sscanf(path, "%c:/title/00030004/%08lx/content/cmd/%08lx.cmd", &drv, &tid_low, &sid) == 3) &&
+        if (MatchCmacPattern(lpath, CMAC_PATTERN_CMD_TWLN, v, 2) &&
             ext && (strncasecmp(ext, "cmd", 4) == 0)) {
-            cmac_type = CMAC_CMD_TWLN;
+            info->tid_low = v[0];
+            info->sid = v[1];
+            info->type = CMAC_CMD_TWLN;
         }
     }
 
-    if (!cmac_type) { // path independent stuff
+    if (!info->type) { // path independent stuff
         const char* db_names[] = { SYS_DB_NAMES };
+        u32 sid;
         for (sid = 0; sid < sizeof(db_names) / sizeof(char*); sid++)
             if (strncasecmp(name, db_names[sid], 16) == 0) break;
-        if (sid < sizeof(db_names) / sizeof(char*))
-            cmac_type = ((drv == 'A') || (drv == 'B')) ? CMAC_TITLEDB_SD : CMAC_TITLEDB_SYS;
-        else if (strncasecmp(name, "movable.sed", 16) == 0)
-            cmac_type = CMAC_MOVABLE;
+        if (sid < sizeof(db_names) / sizeof(char*)) {
+            info->sid = sid;
+            info->type = ((drv == 'A') || (drv == 'B')) ? CMAC_TITLEDB_SD : CMAC_TITLEDB_SYS;
+        } else if (strncasecmp(name, "movable.sed", 16) == 0)
+            info->type = CMAC_MOVABLE;
         else if (strncasecmp(name, "agbsave.bin", 16) == 0)
-            cmac_type = CMAC_AGBSAVE;
+            info->type = CMAC_AGBSAVE;
     }
 
-    // exit with cmac_type if (u8*) cmac is NULL
-    // somewhat hacky, but can be used to check if file has a CMAC
-    if (!cmac) return cmac_type;
-    else if ((cmac_type == CMAC_CMD_SD) || (cmac_type == CMAC_CMD_TWLN)) return 1;
+    return info->type;
+}
+
+// disa: the DISA / DIFF header (file offset 0x100, size 0x100), read from the file if NULL
+static u32 CalculateCmacFromInfo(const char* path, const CmacPathInfo* info, const u8* disa, u8* cmac) {
+    u32 cmac_type = info->type;
+    if ((cmac_type == CMAC_CMD_SD) || (cmac_type == CMAC_CMD_TWLN)) return 1;
     else if (!cmac_type) return 1;
 
     static const u32 cmac_keyslot[] = { CMAC_KEYSLOT };
@@ -216,7 +299,7 @@ u32 CalculateFileCmac(const char* path, u8* cmac) {
     u32 hashsize = 0;
 
     // setup slot 0x30 via movable.sed
-    if ((keyslot == 0x30) && (SetupSlot0x30(drv) != 0))
+    if ((keyslot == 0x30) && (SetupSlot0x30(info->drv) != 0))
         return 1;
 
     // build hash data block, get size
@@ -244,33 +327,36 @@ u32 CalculateFileCmac(const char* path, u8* cmac) {
     } else { // "savegame" CMACs
         // see: https://3dbrew.org/wiki/Savegames
         const char* cmac_savetype[] = { CMAC_SAVETYPE };
-        u8 disa[0x100];
-        if (fvx_qread(path, disa, 0x100, 0x100, NULL) != FR_OK)
-            return 1;
+        u8 disa_l[0x100];
+        if (!disa) {
+            if (fvx_qread(path, disa_l, 0x100, 0x100, NULL) != FR_OK)
+                return 1;
+            disa = disa_l;
+        }
         memcpy(hashdata, cmac_savetype[cmac_type], 8);
         if ((cmac_type == CMAC_EXTDATA_SD) || (cmac_type == CMAC_EXTDATA_SYS)) {
-            memcpy(hashdata + 0x08, &xid_low, 4);
-            memcpy(hashdata + 0x0C, &xid_high, 4);
-            memcpy(hashdata + 0x10, &sid, 4);
-            memcpy(hashdata + 0x14, &fid_low, 4);
-            memcpy(hashdata + 0x18, &fid_high, 4);
+            memcpy(hashdata + 0x08, &(info->xid_low), 4);
+            memcpy(hashdata + 0x0C, &(info->xid_high), 4);
+            memcpy(hashdata + 0x10, &(info->sid), 4);
+            memcpy(hashdata + 0x14, &(info->fid_low), 4);
+            memcpy(hashdata + 0x18, &(info->fid_high), 4);
             memcpy(hashdata + 0x1C, disa, 0x100);
             hashsize = 0x11C;
         } else if (cmac_type == CMAC_SAVEDATA_SYS) {
-            memcpy(hashdata + 0x08, &fid_low, 4);
-            memcpy(hashdata + 0x0C, &fid_high, 4);
+            memcpy(hashdata + 0x08, &(info->fid_low), 4);
+            memcpy(hashdata + 0x0C, &(info->fid_high), 4);
             memcpy(hashdata + 0x10, disa, 0x100);
             hashsize = 0x110;
         } else if (cmac_type == CMAC_SAVEDATA_SD) {
             u8* hashdata0 = hashdata + 0x30;
             memcpy(hashdata0 + 0x00, cmac_savetype[CMAC_SAVEGAME], 8);
             memcpy(hashdata0 + 0x08, disa, 0x100);
-            memcpy(hashdata + 0x08, &tid_low, 4);
-            memcpy(hashdata + 0x0C, &tid_high, 4);
+            memcpy(hashdata + 0x08, &(info->tid_low), 4);
+            memcpy(hashdata + 0x0C, &(info->tid_high), 4);
             sha_quick(hashdata + 0x10, hashdata0, 0x108, SHA256_MODE);
             hashsize = 0x30;
         } else if ((cmac_type == CMAC_TITLEDB_SD) || (cmac_type == CMAC_TITLEDB_SYS)) {
-            memcpy(hashdata + 0x08, &sid, 4);
+            memcpy(hashdata + 0x08, &(info->sid), 4);
             memcpy(hashdata + 0x0C, disa, 0x100);
             hashsize = 0x10C;
         }
@@ -286,6 +372,16 @@ u32 CalculateFileCmac(const char* path, u8* cmac) {
     return 0;
 }
 
+u32 CalculateFileCmac(const char* path, u8* cmac) {
+    CmacPathInfo info;
+    u32 cmac_type = GetCmacPathInfo(path, &info);
+
+    // exit with cmac_type if (u8*) cmac is NULL
+    // somewhat hacky, but can be used to check if file has a CMAC
+    if (!cmac) return cmac_type;
+    return CalculateCmacFromInfo(path, &info, NULL, cmac);
+}
+
 u32 CheckFileCmac(const char* path) {
     u32 cmac_type = CalculateFileCmac(path, NULL);
     if ((cmac_type == CMAC_CMD_SD) || (cmac_type == CMAC_CMD_TWLN)) {
@@ -344,7 +440,7 @@ u32 FixAgbSaveCmac(void* data, u8* cmac, const char* sddrv) {
     return 0;
 }
 
-u32 CheckFixCmdCmac(const char* path, bool fix, bool check_perms) {
+static u32 CheckFixCmdCmacWorker(const char* path, bool fix, bool check_perms, bool* was_fixed) {
     u8 cmac[16] __attribute__((aligned(4)));
     u32 keyslot = ((*path == 'A') || (*path == 'B')) ? 0x30 : 0x0B;
     bool fixed = false;
@@ -446,11 +542,66 @@ u32 CheckFixCmdCmac(const char* path, bool fix, bool check_perms) {
     }
 
     // if we end up here, everything is fine
+    if (was_fixed) *was_fixed = fix && fixed;
     free(cmd_data);
     return 0;
 }
 
-u32 RecursiveFixFileCmacWorker(char* path) {
+u32 CheckFixCmdCmac(const char* path, bool fix, bool check_perms) {
+    return CheckFixCmdCmacWorker(path, fix, check_perms, NULL);
+}
+
+static u32 GetCmacCategory(u32 cmac_type) {
+    switch (cmac_type) {
+        case CMAC_SAVEDATA_SYS:
+        case CMAC_SAVEDATA_SD:
+        case CMAC_SAVE_GAMECARD:
+            return CMAC_CAT_SAVEDATA;
+        case CMAC_EXTDATA_SD:
+        case CMAC_EXTDATA_SYS:
+            return CMAC_CAT_EXTDATA;
+        case CMAC_TITLEDB_SYS:
+        case CMAC_TITLEDB_SD:
+            return CMAC_CAT_DATABASE;
+        case CMAC_CMD_SD:
+        case CMAC_CMD_TWLN:
+            return CMAC_CAT_CMD;
+        default:
+            return CMAC_CAT_OTHER;
+    }
+}
+
+// check and (if required) fix a single file, path info is only parsed once
+// returns 0 if the CMAC was already ok, 1 if it got fixed, 2 on failure
+static u32 BatchFixFileCmac(const char* path, const CmacPathInfo* info) {
+    u32 cmac_type = info->type;
+
+    if ((cmac_type == CMAC_CMD_SD) || (cmac_type == CMAC_CMD_TWLN)) {
+        bool fixed = false;
+        if (CheckFixCmdCmacWorker(path, true, true, &fixed) != 0) return 2;
+        return fixed ? 1 : 0;
+    }
+
+    u8 ccmac[16] __attribute__((aligned(4)));
+    u8 fcmac[16];
+
+    if ((cmac_type == CMAC_MOVABLE) || (cmac_type == CMAC_AGBSAVE) || (cmac_type == CMAC_AGBSAVE_SD)) {
+        if ((CalculateCmacFromInfo(path, info, NULL, ccmac) != 0) ||
+            (ReadFileCmac(path, fcmac) != 0)) return 2;
+    } else { // savegame CMACs: stored CMAC and DISA / DIFF header in a single read
+        u8 hdr[0x200];
+        UINT br;
+        if ((fvx_qread(path, hdr, 0, 0x200, &br) != FR_OK) || (br != 0x200) ||
+            (CalculateCmacFromInfo(path, info, hdr + 0x100, ccmac) != 0)) return 2;
+        memcpy(fcmac, hdr, 0x10);
+    }
+
+    if (memcmp(fcmac, ccmac, 0x10) == 0) return 0;
+    return (WriteFileCmac(path, ccmac, true) == 0) ? 1 : 2;
+}
+
+static u32 RecursiveFixFileCmacWorker(char* path, CmacBatchStats* stats) {
+    CmacPathInfo info;
     FILINFO fno;
     DIR pdir;
     u32 err = 0;
@@ -469,21 +620,38 @@ u32 RecursiveFixFileCmacWorker(char* path) {
             if (fno.fname[0] == 0) {
                 break;
             } else if (fno.fattrib & AM_DIR) { // directory, recurse through it
-                if (RecursiveFixFileCmacWorker(path) != 0) err = 1;
-            } else if (CheckCmacPath(path) == 0) { // file, try to fix the CMAC
-                if (FixFileCmac(path, true) != 0) err = 1;
+                if (RecursiveFixFileCmacWorker(path, stats) != 0) err = 1;
                 ShowString("%s\n%s", pathstr, STR_FIXING_CMACS_PLEASE_WAIT);
-            }
+            } else if (GetCmacPathInfo(path, &info)) { // file, try to fix the CMAC
+                u32 res = BatchFixFileCmac(path, &info);
+                if (res == 0) stats->n_ok++;
+                else if (res == 1) stats->n_fixed++;
+                else {
+                    stats->n_failed++;
+                    err = 1;
+                }
+                stats->n_category[GetCmacCategory(info.type)]++;
+            } else stats->n_nocmac++;
         }
         f_closedir(&pdir);
         *(--fname) = '\0';
-    } else if (CheckCmacPath(path) == 0) // fix single file CMAC
-        return FixFileCmac(path, true);
+    } else if (GetCmacPathInfo(path, &info)) { // fix single file CMAC
+        u32 res = BatchFixFileCmac(path, &info);
+        if (res == 0) stats->n_ok++;
+        else if (res == 1) stats->n_fixed++;
+        else stats->n_failed++;
+        stats->n_category[GetCmacCategory(info.type)]++;
+        err = (res > 1) ? 1 : 0;
+    }
 
     return err;
 }
 
-u32 RecursiveFixFileCmac(const char* path) {
+u32 RecursiveFixFileCmacBatch(const char* path, CmacBatchStats* stats) {
+    CmacBatchStats stats_l;
+    if (!stats) stats = &stats_l;
+    memset(stats, 0, sizeof(CmacBatchStats));
+
     // create a fixed up local path
     // (this is highly path sensitive)
     char lpath[256];
@@ -499,5 +667,15 @@ u32 RecursiveFixFileCmac(const char* path) {
         }
     }
 
-    return RecursiveFixFileCmacWorker(lpath);
+    cmac_batch_mode = true;
+    cmac_batch_slot0x30_drv = '\0';
+    u32 ret = RecursiveFixFileCmacWorker(lpath, stats);
+    cmac_batch_mode = false;
+    cmac_batch_slot0x30_drv = '\0';
+
+    return ret;
+}
+
+u32 RecursiveFixFileCmac(const char* path) {
+    return RecursiveFixFileCmacBatch(path, NULL);
 }
@@ -7,6 +7,22 @@
 #define CheckCmdCmac(path)                     CheckFixCmdCmac(path, false, true)
 #define FixCmdCmac(path, check_perms)          CheckFixCmdCmac(path, true, check_perms)
 
+// CMAC categories for batch statistics
+#define CMAC_CAT_SAVEDATA   0
+#define CMAC_CAT_EXTDATA    1
+#define CMAC_CAT_DATABASE   2
+#define CMAC_CAT_CMD        3
+#define CMAC_CAT_OTHER      4
+#define CMAC_CAT_COUNT      5
+
+typedef struct {
+    u32 n_ok; // CMAC was already correct, nothing written
+    u32 n_fixed;
+    u32 n_failed;
+    u32 n_nocmac; // files without a CMAC
+    u32 n_category[CMAC_CAT_COUNT];
+} CmacBatchStats;
+
 u32 CheckCmacPath(const char* path);
 u32 ReadWriteFileCmac(const char* path, u8* cmac, bool do_write, bool check_perms);
 u32 CalculateFileCmac(const char* path, u8* cmac);
@@ -14,4 +30,5 @@ u32 CheckFileCmac(const char* path);
 u32 FixFileCmac(const char* path, bool check_perms);
 u32 FixAgbSaveCmac(void* data, u8* cmac, const char* sddrv);
 u32 CheckFixCmdCmac(const char* path, bool fix, bool check_perms);
+u32 RecursiveFixFileCmacBatch(const char* path, CmacBatchStats* stats);
 u32 RecursiveFixFileCmac(const char* path);
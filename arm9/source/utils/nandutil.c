@@ -14,6 +14,38 @@
 #include "unittype.h"
 #include "memmap.h"
 
+#define NAND_DIFF_REGION_SIZE   (256 * 1024) // must divide STD_BUFFER_SIZE
+#define NAND_MANIFEST_MAGIC     "NSMF"
+
+typedef struct {
+    char magic[4]; // "NSMF"
+    u32 region_size;
+    u32 n_regions;
+    u32 seq; // number of deltas on top of the base image
+    u64 image_size;
+    u8  base_hash[0x20]; // SHA-256 over the region hashes of the base image
+    u8  state_hash[0x20]; // SHA-256 over the region hashes following this header
+} PACKED_STRUCT NandDiffManifest;
+
+typedef struct {
+    char magic[4]; // "NDIF"
+    u32 region_size;
+    u32 n_regions;
+    u32 seq; // 1 for the first delta on top of the base image
+    u64 image_size;
+    u32 n_changed; // region data follows this header, entry table is at the end of the file
+    u8  padding[4];
+    u8  base_hash[0x20];
+    u8  parent_hash[0x20]; // state before applying this delta
+    u8  state_hash[0x20]; // state after applying this delta
+    char base_name[64]; // base image, same folder as the delta
+} PACKED_STRUCT NandDiffHeader;
+
+typedef struct {
+    u32 region;
+    u8  sha256[0x20];
+} PACKED_STRUCT NandDiffEntry;
+
 
 static const u8 twl_mbr_std[0x42] = {
     0x00, 0x04, 0x18, 0x00, 0x06, 0x01, 0xA0, 0x3F, 0x97, 0x00, 0x00, 0x00, 0xA9, 0x7D, 0x04, 0x00,
@@ -392,7 +424,8 @@ u32 ValidateNandDump(const char* path) {
     return 0;
 }
 
-u32 SafeRestoreNandDump(const char* path) {
+u32 SafeRestoreNandDump(const char* path, u64* written) {
+    if (written) *written = 0;
     if ((ValidateNandDump(path) != 0) && // NAND dump validation
         !ShowPrompt(true, "%s", STR_ERROR_NAND_DUMP_IS_CORRUPT_STILL_CONTINUE))
         return 1;
@@ -461,13 +494,17 @@ u32 SafeRestoreNandDump(const char* path) {
         }
     }
 
+    // first half for the image, second half for the local NAND
     u8* buffer = (u8*) malloc(STD_BUFFER_SIZE);
+    u8* buffer_nand = buffer + (STD_BUFFER_SIZE / 2);
+    u32 step = (STD_BUFFER_SIZE / 2) / 0x200;
     if (!buffer) {
         fvx_close(&file);
         return 1;
     }
 
     // main processing loop
+    // both sides stay encrypted, equal sectors are skipped and only differing runs get written
     u32 ret = 0;
     u32 sector0 = SECTOR_SECRET + COUNT_SECRET; // start at the sector after secret sector
     if (!ShowProgress(0, 0, path)) ret = 1;
@@ -477,10 +514,24 @@ u32 SafeRestoreNandDump(const char* path) {
         u32 subtype = NP_SUBTYPE_CTR;
         u32 sector1 = (GetNandNcsdPartitionInfo(&np_info, type, subtype, p, &ncsd_loc) == 0) ? np_info.sector : fsize / 0x200;
         if (sector1 < sector0) ret = 1; // safety check
-        for (u32 s = sector0; (s < sector1) && (ret == 0); s += STD_BUFFER_SIZE / 0x200) {
-            u32 count = min(STD_BUFFER_SIZE / 0x200, (sector1 - s));
-            if (ReadNandFile(&file, buffer, s, count, 0xFF)) ret = 1;
-            if (WriteNandSectors(buffer, s, count, 0xFF, NAND_SYSNAND)) ret = 1;
+        for (u32 s = sector0; (s < sector1) && (ret == 0); s += step) {
+            u32 count = min(step, (sector1 - s));
+            if (ReadNandFile(&file, buffer, s, count, 0xFF) ||
+                ReadNandSectors(buffer_nand, s, count, 0xFF, NAND_SYSNAND)) {
+                ret = 1;
+                break;
+            }
+            for (u32 i = 0; (i < count) && (ret == 0);) {
+                u32 n = 0;
+                while ((i + n < count) && (memcmp(buffer + ((i + n) * 0x200), buffer_nand + ((i + n) * 0x200), 0x200) != 0)) n++;
+                if (!n) { // sector already matches
+                    i++;
+                    continue;
+                }
+                if (WriteNandSectors(buffer + (i * 0x200), s + i, n, 0xFF, NAND_SYSNAND)) ret = 1;
+                else if (written) *written += n * 0x200;
+                i += n;
+            }
             if (!ShowProgress(s + count, fsize / 0x200, path)) ret = 1;
         }
         if (sector1 == fsize / 0x200) break; // at file end
@@ -494,6 +545,308 @@ u32 SafeRestoreNandDump(const char* path) {
     if (header_inject && (ret == 0) &&
         (WriteNandSectors((u8*) &ncsd_img, 0, 1, 0xFF, NAND_SYSNAND) != 0))
         ret = 1;
+    else if (header_inject && (ret == 0) && written)
+        *written += 0x200;
+
+    return ret;
+}
+
+// base.bin -> base.nsm (seq == 0) or base_0001.ndf (seq > 0), next to the base image
+static void GetNandDiffPath(char* path, const char* base_path, u32 seq) {
+    strncpy(path, base_path, 255);
+    path[255] = '\0';
+    char* slash = strrchr(path, '/');
+    char* ext = strrchr(path, '.');
+    if (!ext || (slash && (ext < slash))) ext = path + strnlen(path, 255);
+    if (!seq) snprintf(ext, 256 - (ext - path), ".nsm");
+    else snprintf(ext, 256 - (ext - path), "_%04lu.ndf", seq);
+}
+
+u32 ValidateNandDiffHeader(const void* data, u64 fsize) {
+    const NandDiffHeader* hdr = (const NandDiffHeader*) data;
+    u32 n_regions = (hdr->image_size + NAND_DIFF_REGION_SIZE - 1) / NAND_DIFF_REGION_SIZE;
+    if ((memcmp(hdr->magic, NAND_DIFF_MAGIC, 4) != 0) ||
+        (hdr->region_size != NAND_DIFF_REGION_SIZE) ||
+        (hdr->n_regions != n_regions) || !hdr->seq ||
+        !hdr->n_changed || (hdr->n_changed > n_regions) ||
+        (fsize < sizeof(NandDiffHeader) + (hdr->n_changed * sizeof(NandDiffEntry))) ||
+        (strnlen(hdr->base_name, sizeof(hdr->base_name)) >= sizeof(hdr->base_name)))
+        return 1;
+    return 0;
+}
+
+u32 DiffBackupNandDump(const char* path, const char* base_path, char* path_out, u32* n_changed, u32* n_regions) {
+    NandDiffManifest manifest;
+    char path_manifest[256];
+    FIL src, dst;
+    UINT bw;
+
+    *path_out = '\0';
+    *n_changed = 0;
+    *n_regions = 0;
+    GetNandDiffPath(path_manifest, base_path, 0);
+    if (!CheckWritePermissions(base_path)) return 1;
+
+    // open source, get size
+    if (fvx_open(&src, path, FA_READ | FA_OPEN_EXISTING) != FR_OK)
+        return 1;
+    u64 image_size = fvx_size(&src);
+    *n_regions = (image_size + NAND_DIFF_REGION_SIZE - 1) / NAND_DIFF_REGION_SIZE;
+
+    u8* hashes = (u8*) malloc(*n_regions * 0x20);
+    NandDiffEntry* entries = (NandDiffEntry*) malloc(*n_regions * sizeof(NandDiffEntry));
+    u8* buffer = (u8*) malloc(STD_BUFFER_SIZE);
+    if (!image_size || !hashes || !entries || !buffer) {
+        if (hashes) free(hashes);
+        if (entries) free(entries);
+        if (buffer) free(buffer);
+        fvx_close(&src);
+        return 1;
+    }
+
+    // previous backup available? (manifest matches the image, base image is there)
+    bool diff = ((fvx_qread(path_manifest, &manifest, 0, sizeof(NandDiffManifest), NULL) == FR_OK) &&
+        (memcmp(manifest.magic, NAND_MANIFEST_MAGIC, 4) == 0) &&
+        (manifest.region_size == NAND_DIFF_REGION_SIZE) &&
+        (manifest.n_regions == *n_regions) &&
+        (manifest.image_size == image_size) &&
+        (fvx_qsize(base_path) == image_size) &&
+        (fvx_qread(path_manifest, hashes, sizeof(NandDiffManifest), *n_regions * 0x20, NULL) == FR_OK) &&
+        (sha_cmp(manifest.state_hash, hashes, *n_regions * 0x20, SHA256_MODE) == 0));
+    if (!diff) {
+        memset(&manifest, 0, sizeof(NandDiffManifest));
+        memcpy(manifest.magic, NAND_MANIFEST_MAGIC, 4);
+        manifest.region_size = NAND_DIFF_REGION_SIZE;
+        manifest.n_regions = *n_regions;
+        manifest.image_size = image_size;
+    }
+
+    // no usable manifest -> the base image gets rewritten, don't do that silently
+    if (!diff && (fvx_stat(base_path, NULL) == FR_OK)) {
+        char pathstr[UTF_BUFFER_BYTESIZE(32)];
+        TruncateString(pathstr, base_path, 32, 8);
+        if (!ShowPrompt(true, STR_PATH_NO_VALID_MANIFEST_OVERWRITE_BASE, pathstr)) {
+            fvx_close(&src);
+            free(hashes);
+            free(entries);
+            free(buffer);
+            return 2;
+        }
+    }
+
+    // delta with the next sequence number, or a fresh base image
+    u32 ret = 0;
+    if (diff) GetNandDiffPath(path_out, base_path, manifest.seq + 1);
+    else strncpy(path_out, base_path, 256);
+    if (fvx_open(&dst, path_out, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+        *path_out = '\0';
+        ret = 1;
+    }
+
+    NandDiffHeader hdr;
+    memset(&hdr, 0, sizeof(NandDiffHeader));
+    if ((ret == 0) && diff && ((fvx_write(&dst, &hdr, sizeof(NandDiffHeader), &bw) != FR_OK) || (bw != sizeof(NandDiffHeader))))
+        ret = 1;
+
+    // read the image once, hash all regions, write only what changed
+    if (!ShowProgress(0, 0, path)) ret = 1;
+    for (u64 pos = 0; (pos < image_size) && (ret == 0); pos += STD_BUFFER_SIZE) {
+        UINT btr = (UINT) min(STD_BUFFER_SIZE, image_size - pos);
+        UINT br;
+        if ((fvx_read(&src, buffer, btr, &br) != FR_OK) || (br != btr)) {
+            ret = 1;
+            break;
+        }
+        for (u32 off = 0; (off < btr) && (ret == 0); off += NAND_DIFF_REGION_SIZE) {
+            u32 region = (u32) ((pos + off) / NAND_DIFF_REGION_SIZE);
+            u32 size = min(NAND_DIFF_REGION_SIZE, btr - off);
+            u8 sha[0x20];
+            sha_quick(sha, buffer + off, size, SHA256_MODE);
+            if (diff && (memcmp(sha, hashes + (region * 0x20), 0x20) == 0)) continue;
+            memcpy(hashes + (region * 0x20), sha, 0x20);
+            if (!diff) continue;
+            entries[*n_changed].region = region;
+            memcpy(entries[*n_changed].sha256, sha, 0x20);
+            (*n_changed)++;
+            if ((fvx_write(&dst, buffer + off, size, &bw) != FR_OK) || (bw != size))
+                ret = 1;
+        }
+        if ((ret == 0) && !diff && ((fvx_write(&dst, buffer, btr, &bw) != FR_OK) || (bw != btr)))
+            ret = 1;
+        if (!ShowProgress(pos + btr, image_size, path)) ret = 1;
+    }
+
+    // new state, delta entry table and header
+    memcpy(hdr.parent_hash, manifest.state_hash, 0x20);
+    sha_quick(manifest.state_hash, hashes, *n_regions * 0x20, SHA256_MODE);
+    if (!diff) memcpy(manifest.base_hash, manifest.state_hash, 0x20);
+    if ((ret == 0) && diff && *n_changed) {
+        memcpy(hdr.magic, NAND_DIFF_MAGIC, 4);
+        hdr.region_size = NAND_DIFF_REGION_SIZE;
+        hdr.n_regions = *n_regions;
+        hdr.seq = manifest.seq + 1;
+        hdr.image_size = image_size;
+        hdr.n_changed = *n_changed;
+        memcpy(hdr.base_hash, manifest.base_hash, 0x20);
+        memcpy(hdr.state_hash, manifest.state_hash, 0x20);
+        const char* base_name = strrchr(base_path, '/');
+        snprintf(hdr.base_name, sizeof(hdr.base_name), "%s", base_name ? base_name + 1 : base_path);
+        if ((fvx_write(&dst, entries, *n_changed * sizeof(NandDiffEntry), &bw) != FR_OK) ||
+            (bw != *n_changed * sizeof(NandDiffEntry)) ||
+            (fvx_lseek(&dst, 0) != FR_OK) ||
+            (fvx_write(&dst, &hdr, sizeof(NandDiffHeader), &bw) != FR_OK) ||
+            (bw != sizeof(NandDiffHeader)))
+            ret = 1;
+    }
+
+    if (*path_out) fvx_close(&dst);
+    fvx_close(&src);
+    free(buffer);
+    free(entries);
+
+    // failed or nothing changed -> no output, otherwise the manifest gets updated
+    if (*path_out && ((ret != 0) || (diff && !*n_changed))) {
+        fvx_unlink(path_out);
+        *path_out = '\0';
+    }
+    if ((ret == 0) && *path_out) {
+        if (diff) manifest.seq++;
+        if ((fvx_qwrite(path_manifest, &manifest, 0, sizeof(NandDiffManifest), NULL) != FR_OK) ||
+            (fvx_qwrite(path_manifest, hashes, sizeof(NandDiffManifest), *n_regions * 0x20, NULL) != FR_OK))
+            ret = 1;
+    }
+
+    free(hashes);
+    return ret;
+}
+
+u32 RebuildNandDiffBackup(const char* path, const char* path_out) {
+    NandDiffHeader hdr;
+    NandDiffManifest manifest;
+    char base_path[256];
+    char path_delta[256];
+    FIL src, dst;
+    UINT br, bw;
+
+    // check delta, find base image and manifest (same folder as the delta)
+    if ((fvx_qread(path, &hdr, 0, sizeof(NandDiffHeader), NULL) != FR_OK) ||
+        (ValidateNandDiffHeader(&hdr, fvx_qsize(path)) != 0))
+        return 1;
+    strncpy(base_path, path, 255);
+    base_path[255] = '\0';
+    char* slash = strrchr(base_path, '/');
+    if (!slash) return 1;
+    snprintf(slash + 1, 256 - (slash + 1 - base_path), "%s", hdr.base_name);
+    GetNandDiffPath(path_delta, base_path, 0);
+    if ((fvx_qread(path_delta, &manifest, 0, sizeof(NandDiffManifest), NULL) != FR_OK) ||
+        (memcmp(manifest.magic, NAND_MANIFEST_MAGIC, 4) != 0) ||
+        (memcmp(manifest.base_hash, hdr.base_hash, 0x20) != 0) ||
+        (manifest.image_size != hdr.image_size) ||
+        (fvx_qsize(base_path) != hdr.image_size))
+        return 1;
+
+    if (!CheckWritePermissions(path_out)) return 1;
+    u8* buffer = (u8*) malloc(STD_BUFFER_SIZE);
+    u8* hashes = (u8*) malloc(hdr.n_regions * 0x20);
+    NandDiffEntry* entries = (NandDiffEntry*) malloc(hdr.n_regions * sizeof(NandDiffEntry));
+    if (!buffer || !hashes || !entries) {
+        if (buffer) free(buffer);
+        if (hashes) free(hashes);
+        if (entries) free(entries);
+        return 1;
+    }
+
+    // start from a copy of the base image
+    u32 ret = 0;
+    if (fvx_open(&src, base_path, FA_READ | FA_OPEN_EXISTING) != FR_OK) {
+        free(buffer);
+        free(hashes);
+        free(entries);
+        return 1;
+    }
+    if (fvx_open(&dst, path_out, FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) {
+        fvx_close(&src);
+        free(buffer);
+        free(hashes);
+        free(entries);
+        return 1;
+    }
+    if (!ShowProgress(0, 0, path_out)) ret = 1;
+    for (u64 pos = 0; (pos < hdr.image_size) && (ret == 0); pos += STD_BUFFER_SIZE) {
+        UINT btr = (UINT) min(STD_BUFFER_SIZE, hdr.image_size - pos);
+        if ((fvx_read(&src, buffer, btr, &br) != FR_OK) || (br != btr) ||
+            (fvx_write(&dst, buffer, btr, &bw) != FR_OK) || (bw != btr))
+            ret = 1;
+        for (u32 off = 0; (off < btr) && (ret == 0); off += NAND_DIFF_REGION_SIZE) {
+            u32 region = (u32) ((pos + off) / NAND_DIFF_REGION_SIZE);
+            sha_quick(hashes + (region * 0x20), buffer + off, min(NAND_DIFF_REGION_SIZE, btr - off), SHA256_MODE);
+        }
+        if (!ShowProgress(pos + btr, hdr.image_size, path_out)) ret = 1;
+    }
+    fvx_close(&src);
+
+    // base image must be the one the deltas were taken against
+    if ((ret == 0) && (sha_cmp(hdr.base_hash, hashes, hdr.n_regions * 0x20, SHA256_MODE) != 0))
+        ret = 1;
+
+    // apply all deltas up to this one, in order
+    u8 state[0x20];
+    memcpy(state, hdr.base_hash, 0x20);
+    for (u32 seq = 1; (seq <= hdr.seq) && (ret == 0); seq++) {
+        NandDiffHeader dhdr;
+        if (seq < hdr.seq) GetNandDiffPath(path_delta, base_path, seq);
+        else strncpy(path_delta, path, 256);
+        if (fvx_open(&src, path_delta, FA_READ | FA_OPEN_EXISTING) != FR_OK) {
+            ret = 1;
+            break;
+        }
+        u64 fsize = fvx_size(&src);
+        if ((fvx_read(&src, &dhdr, sizeof(NandDiffHeader), &br) != FR_OK) || (br != sizeof(NandDiffHeader)) ||
+            (ValidateNandDiffHeader(&dhdr, fsize) != 0) || (dhdr.seq != seq) ||
+            (dhdr.image_size != hdr.image_size) ||
+            (memcmp(dhdr.base_hash, hdr.base_hash, 0x20) != 0) ||
+            (memcmp(dhdr.parent_hash, state, 0x20) != 0))
+            ret = 1;
+
+        // entry table is at the end of the file
+        u32 size_table = dhdr.n_changed * sizeof(NandDiffEntry);
+        if ((ret == 0) && ((fvx_lseek(&src, fsize - size_table) != FR_OK) ||
+            (fvx_read(&src, entries, size_table, &br) != FR_OK) || (br != size_table) ||
+            (fvx_lseek(&src, sizeof(NandDiffHeader)) != FR_OK)))
+            ret = 1;
+
+        u64 size_data = 0;
+        for (u32 i = 0; (i < dhdr.n_changed) && (ret == 0); i++) {
+            u32 region = entries[i].region;
+            u64 offset = (u64) region * NAND_DIFF_REGION_SIZE;
+            if ((region >= dhdr.n_regions) ||
+                (sizeof(NandDiffHeader) + size_data + size_table >= fsize)) {
+                ret = 1;
+                break;
+            }
+            u32 size = (u32) min(NAND_DIFF_REGION_SIZE, hdr.image_size - offset);
+            size_data += size;
+            if ((fvx_read(&src, buffer, size, &br) != FR_OK) || (br != size) ||
+                (sha_cmp(entries[i].sha256, buffer, size, SHA256_MODE) != 0) ||
+                (fvx_lseek(&dst, offset) != FR_OK) ||
+                (fvx_write(&dst, buffer, size, &bw) != FR_OK) || (bw != size))
+                ret = 1;
+            memcpy(hashes + (region * 0x20), entries[i].sha256, 0x20);
+            if (!ShowProgress(i + 1, dhdr.n_changed, path_delta)) ret = 1;
+        }
+
+        // region hashes after this delta must add up to its recorded state
+        if ((ret == 0) && (sha_cmp(dhdr.state_hash, hashes, hdr.n_regions * 0x20, SHA256_MODE) != 0))
+            ret = 1;
+        memcpy(state, dhdr.state_hash, 0x20);
+        fvx_close(&src);
+    }
+
+    fvx_close(&dst);
+    free(buffer);
+    free(hashes);
+    free(entries);
+    if (ret != 0) fvx_unlink(path_out);
 
     return ret;
 }
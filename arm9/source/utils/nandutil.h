@@ -2,11 +2,18 @@
 
 #include "common.h"
 
+#define NAND_DIFF_MAGIC         "NDIF"
+#define NAND_DIFF_BASE_SYSNAND  OUTPUT_PATH "/sysnand.bin"
+#define NAND_DIFF_BASE_EMUNAND  OUTPUT_PATH "/emunand.bin"
+
 u32 CheckEmbeddedBackup(const char* path);
 u32 EmbedEssentialBackup(const char* path);
 u32 FixNandHeader(const char* path, bool check_size);
 u32 ValidateNandDump(const char* path);
-u32 SafeRestoreNandDump(const char* path);
+u32 SafeRestoreNandDump(const char* path, u64* written);
+u32 ValidateNandDiffHeader(const void* data, u64 fsize);
+u32 DiffBackupNandDump(const char* path, const char* base_path, char* path_out, u32* n_changed, u32* n_regions);
+u32 RebuildNandDiffBackup(const char* path, const char* path_out);
 u32 SafeInstallFirm(const char* path, u32 slots);
 u32 SafeInstallKeyDb(const char* path);
 u32 DumpGbaVcSavegame(const char* path);
@@ -111,6 +111,7 @@ typedef enum {
     CMD_ID_DUMPTXT,
     CMD_ID_FIXCMAC,
     CMD_ID_VERIFY,
+    CMD_ID_VERIFYALL,
     CMD_ID_DECRYPT,
     CMD_ID_ENCRYPT,
     CMD_ID_BUILDCIA,
@@ -181,17 +182,18 @@ static const Gm9ScriptCmd cmd_list[] = {
     { CMD_ID_FINDNOT , "findnot" , 2, 0 },
     { CMD_ID_FGET    , "fget"    , 2, _FLG('e') },
     { CMD_ID_FSET    , "fset"    , 2, _FLG('e') },
-    { CMD_ID_SHA     , "sha"     , 2, _FLG('1') },
-    { CMD_ID_SHAGET  , "shaget"  , 2, _FLG('1') },
+    { CMD_ID_SHA     , "sha"     , 2, _FLG('1') | _FLG('c') },
+    { CMD_ID_SHAGET  , "shaget"  , 2, _FLG('1') | _FLG('c') },
     { CMD_ID_DUMPTXT , "dumptxt" , 2, _FLG('p') },
     { CMD_ID_FIXCMAC , "fixcmac" , 1, 0 },
     { CMD_ID_VERIFY  , "verify"  , 1, 0 },
+    { CMD_ID_VERIFYALL, "verifyall", 2, 0 },
     { CMD_ID_DECRYPT , "decrypt" , 1, 0 },
     { CMD_ID_ENCRYPT , "encrypt" , 1, 0 },
     { CMD_ID_BUILDCIA, "buildcia", 1, _FLG('l') },
     { CMD_ID_INSTALL , "install" , 1, _FLG('e') },
     { CMD_ID_EXTRCODE, "extrcode", 2, 0 },
-    { CMD_ID_CMPRCODE, "cmprcode", 2, 0 },
+    { CMD_ID_CMPRCODE, "cmprcode", 2, _FLG('q') },
     { CMD_ID_SDUMP   , "sdump"   , 1, _FLG('w') },
     { CMD_ID_APPLYIPS, "applyips", 3, 0 },
     { CMD_ID_APPLYBPS, "applybps", 3, 0 },
@@ -639,6 +641,7 @@ u32 get_flag(char* str, u32 len, char* err_str) {
     else if (strncmp(str, "--sha1", len) == 0) flag_char = '1';
     else if (strncmp(str, "--all", len) == 0) flag_char = 'a';
     else if (strncmp(str, "--before", len) == 0) flag_char = 'b';
+    else if (strncmp(str, "--crc32", len) == 0) flag_char = 'c';
     else if (strncmp(str, "--include_dirs", len) == 0) flag_char = 'd';
     else if (strncmp(str, "--encrypted", len) == 0) flag_char = 'e';
     else if (strncmp(str, "--flip_endian", len) == 0) flag_char = 'e';
@@ -651,6 +654,7 @@ u32 get_flag(char* str, u32 len, char* err_str) {
     else if (strncmp(str, "--no_cancel", len) == 0) flag_char = 'n';
     else if (strncmp(str, "--optional", len) == 0) flag_char = 'o';
     else if (strncmp(str, "--append", len) == 0) flag_char = 'p';
+    else if (strncmp(str, "--quick", len) == 0) flag_char = 'q';
     else if (strncmp(str, "--recursive", len) == 0) flag_char = 'r';
     else if (strncmp(str, "--silent", len) == 0) flag_char = 's';
     else if (strncmp(str, "--unequal", len) == 0) flag_char = 'u';
@@ -1346,10 +1350,11 @@ bool run_cmd(cmd_id id, u32 flags, char** argv, char* err_str) {
         }
     }
     else if (id == CMD_ID_SHA) {
-        const u8 hashlen = (flags & _FLG('1')) ? 20 : 32;
+        const bool crc32 = (flags & _FLG('c'));
+        const u8 hashlen = crc32 ? 4 : (flags & _FLG('1')) ? 20 : 32;
         u8 hash_fil[0x20];
         u8 hash_cmp[0x20];
-        if (!FileGetSha(argv[0], hash_fil, at_org, sz_org, flags & _FLG('1'))) {
+        if (!(crc32 ? FileGetCrc32(argv[0], hash_fil, at_org, sz_org) : FileGetSha(argv[0], hash_fil, at_org, sz_org, flags & _FLG('1')))) {
             ret = false;
             if (err_str) snprintf(err_str, _ERR_STR_LEN, "%s", STR_SCRIPTERR_SHA_ARG0_FAIL);
         } else if ((FileGetData(argv[1], hash_cmp, hashlen, 0) != hashlen) && !strntohex(argv[1], hash_cmp, hashlen)) {
@@ -1361,13 +1366,16 @@ bool run_cmd(cmd_id id, u32 flags, char** argv, char* err_str) {
         }
     }
     else if (id == CMD_ID_SHAGET) {
-        const u8 hashlen = (flags & _FLG('1')) ? 20 : 32;
+        const bool crc32 = (flags & _FLG('c'));
+        const u8 hashlen = crc32 ? 4 : (flags & _FLG('1')) ? 20 : 32;
         u8 hash_fil[0x20];
-        if (!(ret = FileGetSha(argv[0], hash_fil, at_org, sz_org, flags & _FLG('1')))) {
+        if (!(ret = (crc32 ? FileGetCrc32(argv[0], hash_fil, at_org, sz_org) : FileGetSha(argv[0], hash_fil, at_org, sz_org, flags & _FLG('1'))))) {
             if (err_str) snprintf(err_str, _ERR_STR_LEN, "%s", STR_SCRIPTERR_SHA_ARG0_FAIL);
         } else if (!strchr(argv[1], ':')) {
             char hash_str[64+1];
-            if (flags & _FLG('1'))
+            if (crc32)
+                snprintf(hash_str, sizeof(hash_str), "%08lX", getbe32(hash_fil));
+            else if (flags & _FLG('1'))
                 snprintf(hash_str, sizeof(hash_str), "%016llX%016llX%08lX", getbe64(hash_fil + 0), getbe64(hash_fil + 8),
                 getbe32(hash_fil + 16));
             else
@@ -1399,6 +1407,14 @@ bool run_cmd(cmd_id id, u32 flags, char** argv, char* err_str) {
         else ret = (VerifyGameFile(argv[0], false) == 0);
         if (err_str) snprintf(err_str, _ERR_STR_LEN, "%s", STR_VERIFICATION_FAILED);
     }
+    else if (id == CMD_ID_VERIFYALL) {
+        const char* paths[1] = { argv[0] };
+        u32 n_total = 0;
+        u32 n_ok = 0;
+        u32 n_skipped = 0;
+        ret = (VerifyGameFileBatch(paths, 1, argv[1], false, &n_total, &n_ok, &n_skipped) == 0) && (n_ok == n_total);
+        if (err_str) snprintf(err_str, _ERR_STR_LEN, "%lu/%lu %s", n_ok, n_total, STR_VERIFICATION_FAILED);
+    }
     else if (id == CMD_ID_DECRYPT) {
         u64 filetype = IdentifyFileType(argv[0]);
         if (filetype & BIN_KEYDB) ret = (CryptAesKeyDb(argv[0], true, false) == 0);
@@ -1432,7 +1448,7 @@ bool run_cmd(cmd_id id, u32 flags, char** argv, char* err_str) {
     }
     else if (id == CMD_ID_CMPRCODE) {
         ShowString("%s", STR_COMPRESSING_DOT_CODE);
-        ret = (CompressCode(argv[0], argv[1]) == 0);
+        ret = (CompressCode(argv[0], argv[1], (flags & _FLG('q')) ? CODE_LZSS_FAST : CODE_LZSS_BEST) == 0);
         if (err_str) snprintf(err_str, _ERR_STR_LEN, "%s", STR_SCRIPTERR_COMPRESS_DOT_CODE_FAILED);
     }
     else if (id == CMD_ID_SDUMP) {
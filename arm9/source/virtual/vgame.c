@@ -71,6 +71,34 @@
                             "public.sav", "banner.sav", "private.sav"
 #define NAME_TAD_CONTENT    "%016llX.%s" // titleid.type
 
+#define CBC_CACHE_SIZE      0x8000 // decrypted CIA content block cache
+
+#define NCCH_CACHE_PAGE     0x1000 // decrypted NCCH cache page size
+#define NCCH_CACHE_MAX      (1UL << 20) // decrypted NCCH cache, upper limit
+#define NCCH_CACHE_MIN      (64UL << 10) // decrypted NCCH cache, lower limit
+#define NCCH_CACHE_READ_MAX (4 * NCCH_CACHE_PAGE) // bigger reads bypass the cache
+
+
+// CBC stream context for CIA content reads, carries the IV over
+// between sequential reads and keeps a window of decrypted blocks
+typedef struct {
+    u8  iv0[AES_BLOCK_SIZE]; // IV0 of the content this context belongs to
+    u64 block0; // first block of that content
+    u64 next_block; // block following the last decrypted one
+    u8  iv[AES_BLOCK_SIZE]; // ciphertext of (next_block - 1)
+    u64 cache_block; // first block in cache
+    u64 cache_count; // # of blocks in cache
+    u8* cache;
+} CbcStream;
+
+// decrypted NCCH cache page (LRU)
+typedef struct {
+    u32 gen; // crypto context generation (0 = unused)
+    u32 last_use;
+    u32 page; // page index, relative to NCCH start
+    u32 size; // valid bytes in page
+} NcchCachePage;
+
 
 static u64 vgame_type = 0;
 static u32 base_vdir = 0;
@@ -116,20 +144,84 @@ static FirmHeader* firm   = NULL;
 static NcchHeader* ncch   = NULL;
 static ExeFsHeader* exefs = NULL;
 static RomFsLv3Index lv3idx;
-static u8 cia_titlekey[16];
+static NitroRomIndex nitroidx;
+static u8 cia_titlekey[16] __attribute__((aligned(32)));
+static CbcStream cbc_stream;
+
+static NcchCachePage* ncch_cache = NULL; // page table, followed by page data
+static u32 ncch_cache_n = 0;
+static u32 ncch_cache_gen = 0;
+static u32 ncch_cache_tick = 0;
+static u64 ncch_cache_ctx[4] = { 0 }; // NCCH, ExeFS, CIA content offsets + content index
+
+
+static void ResetCbcStream(u8* cache) {
+    memset(&cbc_stream, 0, sizeof(CbcStream));
+    cbc_stream.block0 = (u64) -1;
+    cbc_stream.next_block = (u64) -1;
+    cbc_stream.cache = cache;
+}
+
+// switch the stream context to another content if required
+static bool SyncCbcStream(u8* iv0, u64 block0) {
+    if ((cbc_stream.block0 == block0) && (memcmp(cbc_stream.iv0, iv0, AES_BLOCK_SIZE) == 0))
+        return true;
+    memcpy(cbc_stream.iv0, iv0, AES_BLOCK_SIZE);
+    cbc_stream.block0 = block0;
+    cbc_stream.next_block = (u64) -1;
+    cbc_stream.cache_count = 0;
+    return false;
+}
 
 
 int ReadCbcImageBlocks(void* buffer, u64 block, u64 count, u8* iv0, u64 block0) {
     int ret = ReadImageBytes(buffer, block * AES_BLOCK_SIZE, count * AES_BLOCK_SIZE);
     if ((ret == 0) && iv0) {
         u8 ctr[AES_BLOCK_SIZE] = { 0 };
+        bool carry_iv = SyncCbcStream(iv0, block0) && (block == cbc_stream.next_block);
         if (block == block0) memcpy(ctr, iv0, AES_BLOCK_SIZE);
+        else if (carry_iv) memcpy(ctr, cbc_stream.iv, AES_BLOCK_SIZE); // no need to reread the previous block
         else if ((ret = ReadImageBytes(ctr, (block-1) * AES_BLOCK_SIZE, AES_BLOCK_SIZE)) != 0)
             return ret;
 
+        // setup key for CIA (keyslot 0x11 is shared with NCCH crypto)
+        setup_aeskey(0x11, cia_titlekey);
+        use_aeskey(0x11);
+
         u32 mode = AES_CNT_TITLEKEY_DECRYPT_MODE;
         cbc_decrypt(buffer, buffer, count, mode, ctr);
+
+        // ctr now holds the last ciphertext block, which is the IV for the next block
+        memcpy(cbc_stream.iv, ctr, AES_BLOCK_SIZE);
+        cbc_stream.next_block = block + count;
+    }
+    return ret;
+}
+
+int ReadCbcImageCached(void* buffer, u64 offset, u64 count, u8* iv0, u64 block0) {
+    u64 block = offset / AES_BLOCK_SIZE;
+    u64 last = (offset + count - 1) / AES_BLOCK_SIZE;
+    int ret = 0;
+
+    // refill the cache window, starting at the first requested block
+    bool synced = SyncCbcStream(iv0, block0);
+    if (!synced || (block < cbc_stream.cache_block) ||
+        (last >= cbc_stream.cache_block + cbc_stream.cache_count)) {
+        // only reads continuing the cached data prefetch a full window,
+        // random small reads (headers, TMD) just fetch what they need
+        bool sequential = synced && cbc_stream.cache_count && (block >= cbc_stream.cache_block) &&
+            (block <= cbc_stream.cache_block + cbc_stream.cache_count);
+        u64 n_blocks = sequential ? CBC_CACHE_SIZE / AES_BLOCK_SIZE : last - block + 1;
+        u64 mount_blocks = GetMountSize() / AES_BLOCK_SIZE;
+        if (block + n_blocks > mount_blocks) n_blocks = max(mount_blocks - min(mount_blocks, block), last - block + 1);
+        cbc_stream.cache_count = 0;
+        if ((ret = ReadCbcImageBlocks(cbc_stream.cache, block, n_blocks, iv0, block0)) != 0)
+            return ret;
+        cbc_stream.cache_block = block;
+        cbc_stream.cache_count = n_blocks;
     }
+
+    memcpy(buffer, cbc_stream.cache + (offset - (cbc_stream.cache_block * AES_BLOCK_SIZE)), count);
     return ret;
 }
 
@@ -140,6 +232,10 @@ int ReadCbcImageBytes(void* buffer, u64 offset, u64 count, u8* iv0, u64 offset0)
     u8* buffer8 = (u8*) buffer;
     int ret = 0;
 
+    // small reads are served from the decrypted block cache
+    if (iv0 && cbc_stream.cache && count && (count <= CBC_CACHE_SIZE - AES_BLOCK_SIZE))
+        return ReadCbcImageCached(buffer, offset, count, iv0, block0);
+
     if (off_fix) { // misaligned offset (at beginning)
         u32 fix_byte = ((off_fix + count) >= AES_BLOCK_SIZE) ? AES_BLOCK_SIZE - off_fix : count;
         if ((ret = ReadCbcImageBlocks(temp, offset / AES_BLOCK_SIZE, 1, iv0, block0)) != 0)
@@ -170,13 +266,7 @@ int ReadCbcImageBytes(void* buffer, u64 offset, u64 count, u8* iv0, u64 offset0)
 }
 
 int ReadCiaContentImageBytes(void* buffer, u64 offset, u64 count, u32 cia_cnt_idx, u64 offset0) {
-    // setup key for CIA
-    u8 tik[16] __attribute__((aligned(32)));
-    memcpy(tik, cia_titlekey, 16);
-    setup_aeskey(0x11, tik);
-    use_aeskey(0x11);
-
-    // setup IV0
+    // setup IV0 (key setup is done only when blocks are actually decrypted)
     u8 iv0[AES_BLOCK_SIZE] = { 0 };
     iv0[0] = (cia_cnt_idx >> 8) & 0xFF;
     iv0[1] = (cia_cnt_idx >> 0) & 0xFF;
@@ -195,7 +285,94 @@ int ReadGameImageBytes(void* buffer, u64 offset, u64 count) {
     return ret;
 }
 
+static void InitNcchCache(bool enable) {
+    if (ncch_cache) free(ncch_cache);
+    ncch_cache = NULL;
+    ncch_cache_n = 0;
+    ncch_cache_gen++; // (!) cached pages never survive a remount
+    if (!ncch_cache_gen) ncch_cache_gen++;
+    if (!enable) return;
+
+    // take as much as the memory budget allows, within limits
+    for (u32 size = NCCH_CACHE_MAX; size >= NCCH_CACHE_MIN; size >>= 1) {
+        u32 n = size / NCCH_CACHE_PAGE;
+        ncch_cache = (NcchCachePage*) malloc(n * (sizeof(NcchCachePage) + NCCH_CACHE_PAGE));
+        if (!ncch_cache) continue;
+        memset(ncch_cache, 0, n * sizeof(NcchCachePage));
+        ncch_cache_n = n;
+        break;
+    }
+}
+
+// decrypted data depends on the NCCH, ExeFS (file keys) and CIA content crypto in use
+static void SyncNcchCacheGen(void) {
+    u64 ctx[4] = { offset_ncch, offset_exefs, offset_ccnt, index_ccnt };
+    if (memcmp(ctx, ncch_cache_ctx, sizeof(ctx)) == 0) return;
+    memcpy(ncch_cache_ctx, ctx, sizeof(ctx));
+    if (!++ncch_cache_gen) ncch_cache_gen++;
+}
+
+static u8* GetNcchCachePage(u32 page, u32* size_page) {
+    u8* data = (u8*) (ncch_cache + ncch_cache_n);
+    NcchCachePage* lru = ncch_cache;
+
+    for (u32 i = 0; i < ncch_cache_n; i++) {
+        NcchCachePage* entry = ncch_cache + i;
+        if ((entry->gen == ncch_cache_gen) && (entry->page == page)) {
+            entry->last_use = ++ncch_cache_tick;
+            *size_page = entry->size;
+            return data + (i * NCCH_CACHE_PAGE);
+        }
+        if (lru->gen != ncch_cache_gen) continue; // already got an unused page
+        if ((entry->gen != ncch_cache_gen) || (entry->last_use < lru->last_use)) lru = entry;
+    }
+
+    // not cached, load and decrypt into the least recently used page
+    u8* page_data = data + ((lru - ncch_cache) * NCCH_CACHE_PAGE);
+    u64 offset = offset_ncch + ((u64) page * NCCH_CACHE_PAGE);
+    u64 mount_size = GetMountSize();
+    u32 size = (offset >= mount_size) ? 0 : min(NCCH_CACHE_PAGE, mount_size - offset);
+    lru->gen = 0;
+    if (!size || (ReadGameImageBytes(page_data, offset, size) != 0) ||
+        (DecryptNcch(page_data, page * NCCH_CACHE_PAGE, size, ncch,
+        (offset_exefs == (u64) -1) ? NULL : exefs) != 0))
+        return NULL;
+    lru->gen = ncch_cache_gen;
+    lru->last_use = ++ncch_cache_tick;
+    lru->page = page;
+    lru->size = size;
+
+    *size_page = size;
+    return page_data;
+}
+
+static int ReadNcchImageCached(void* buffer, u64 offset, u64 count) {
+    u8* buffer8 = (u8*) buffer;
+
+    SyncNcchCacheGen();
+    while (count) {
+        u64 offset_rel = offset - offset_ncch;
+        u32 page = offset_rel / NCCH_CACHE_PAGE;
+        u32 offset_page = offset_rel % NCCH_CACHE_PAGE;
+        u32 size = min(NCCH_CACHE_PAGE - offset_page, count);
+        u32 size_page = 0;
+        u8* data = GetNcchCachePage(page, &size_page);
+        if (!data || (offset_page + size > size_page)) return -1;
+        memcpy(buffer8, data + offset_page, size);
+        buffer8 += size;
+        offset += size;
+        count -= size;
+    }
+
+    return 0;
+}
+
 int ReadNcchImageBytes(void* buffer, u64 offset, u64 count) {
+    // small reads from an encrypted NCCH are served from the decrypted page cache
+    if (ncch_cache_n && count && (count <= NCCH_CACHE_READ_MAX) && (offset_ncch != (u64) -1) &&
+        (offset >= offset_ncch) && NCCH_ENCRYPTED(ncch))
+        return ReadNcchImageCached(buffer, offset, count);
+
     int ret = ReadGameImageBytes(buffer, offset, count);
     if ((offset_ncch != (u64) -1) && NCCH_ENCRYPTED(ncch) && (DecryptNcch(buffer, offset - offset_ncch, count,
         ncch, (offset_exefs == (u64) -1) ? NULL : exefs) != 0)) return -1;
@@ -739,8 +916,12 @@ bool BuildVGameTadDir(void) {
 void DeinitVGameDrive(void) {
     if (vgame_buffer) free(vgame_buffer);
     if (vgame_fs_buffer) free(vgame_fs_buffer);
+    FreeNitroRomIndex(&nitroidx);
+    FreeLv3Index(&lv3idx);
     vgame_buffer = NULL;
     vgame_fs_buffer = NULL;
+    ResetCbcStream(NULL);
+    InitNcchCache(false);
 }
 
 u64 InitVGameDrive(void) { // prerequisite: game file mounted as image
@@ -790,6 +971,8 @@ u64 InitVGameDrive(void) { // prerequisite: game file mounted as image
     ncsd  = (NcsdHeader*)    (void*) (((u8*) vgame_buffer) + 0x2F600); // 512 byte reserved
     ncch  = (NcchHeader*)    (void*) (((u8*) vgame_buffer) + 0x2F800); // 512 byte reserved
     exefs = (ExeFsHeader*)   (void*) (((u8*) vgame_buffer) + 0x2FA00); // 512 byte reserved (1kb reserve)
+    ResetCbcStream(((u8*) vgame_buffer) + 0x30000); // 32kb reserved (CIA content block cache)
+    InitNcchCache(type & (GAME_CIA|GAME_NCSD|GAME_NCCH)); // NCCH decryption cache (where required)
     // filesystem stuff (RomFS / NitroFS) and CIA/TADX will be allocated on demand
 
     vgame_type = type;
@@ -902,6 +1085,7 @@ bool OpenVGameDir(VirtualDir* vdir, VirtualFile* ventry) {
             return false;
         }
         // set up filesystem buffer
+        FreeLv3Index(&lv3idx);
         if (vgame_fs_buffer) free(vgame_fs_buffer);
         vgame_fs_buffer = malloc(lv3.offset_filedata);
         if (!vgame_fs_buffer || (offset_lv3 == (u64) -1) ||
@@ -924,10 +1108,15 @@ bool OpenVGameDir(VirtualDir* vdir, VirtualFile* ventry) {
             return false;
         // load NitroFNT & NitroFAT to memory
         u32 size_nitro = (twl->fat_offset + twl->fat_size) - twl->fnt_offset;
+        FreeLv3Index(&lv3idx);
         if (vgame_fs_buffer) free(vgame_fs_buffer);
         vgame_fs_buffer = malloc(size_nitro);
         if (!vgame_fs_buffer || (ReadGameImageBytes(vgame_fs_buffer, vdir->offset + twl->fnt_offset, size_nitro) != 0))
             return false;
+        // index dirs & names once, listings and lookups go through the index
+        // (if that fails, fall back to walking the FNT on every lookup)
+        FreeNitroRomIndex(&nitroidx);
+        BuildNitroRomIndex(&nitroidx, twl, vgame_fs_buffer, vgame_fs_buffer + twl->fat_offset - twl->fnt_offset);
         offset_nitro = offset_nds;
     }
 
@@ -1016,7 +1205,26 @@ bool ReadVGameDirLv3(VirtualFile* vfile, VirtualDir* vdir) {
     return false;
 }
 
-bool ReadVGameDirNitro(VirtualFile* vfile, VirtualDir* vdir) {
+static bool GetVGameNitroFile(VirtualFile* vfile, const NitroRomIndexEntry* entry) {
+    u8* fnt = vgame_fs_buffer;
+    u8* fat = vgame_fs_buffer + twl->fat_offset - twl->fnt_offset;
+    bool is_dir;
+
+    vfile->name[0] = '\0';
+    vfile->flags = VFLAG_NITRO | VFLAG_READONLY;
+    vfile->keyslot = 0;
+
+    if (ReadNitroRomEntry(&(vfile->offset), &(vfile->size), &is_dir, entry->fileid, fnt + entry->offset_entry, fat) != 0)
+        return false;
+    if (!is_dir) vfile->offset += offset_nds;
+    vfile->offset |= ((u64) entry->offset_entry) << 32;
+    if (is_dir) vfile->flags |= VFLAG_DIR;
+
+    return true;
+}
+
+// no index available, walk the FNT subtable directly
+static bool ReadVGameDirNitroWalk(VirtualFile* vfile, VirtualDir* vdir) {
     u8* fnt = vgame_fs_buffer;
     u8* fat = vgame_fs_buffer + twl->fat_offset - twl->fnt_offset;
 
@@ -1054,6 +1262,27 @@ bool ReadVGameDirNitro(VirtualFile* vfile, VirtualDir* vdir) {
     return (vdir->index >= 0);
 }
 
+bool ReadVGameDirNitro(VirtualFile* vfile, VirtualDir* vdir) {
+    u32 dirid = vdir->offset & 0xFFF;
+    if (!nitroidx.entries) return ReadVGameDirNitroWalk(vfile, vdir);
+
+    // start from parent dir object (index holds the current NitroFS index entry)
+    if (vdir->index == -1) {
+        if (dirid < nitroidx.n_dirs) vdir->index = nitroidx.dirs[dirid];
+        else vdir->index = -3; // error
+    }
+
+    // read directory entries until done
+    if (vdir->index >= 0) {
+        if (((u32) vdir->index < nitroidx.dirs[dirid+1]) &&
+            GetVGameNitroFile(vfile, nitroidx.entries + vdir->index))
+            vdir->index++;
+        else vdir->index = -2; // end of dir
+    }
+
+    return (vdir->index >= 0);
+}
+
 bool ReadVGameDir(VirtualFile* vfile, VirtualDir* vdir) {
     VirtualFile* templates = NULL;
     int n = 0;
@@ -1095,6 +1324,16 @@ bool ReadVGameDir(VirtualFile* vfile, VirtualDir* vdir) {
     return false;
 }
 
+static int ReadVGameBytes(u32 flags, u32 keyslot, u32 vfoffset, void* buffer, u64 offset, u64 count) {
+    if (flags & VFLAG_NO_CRYPTO)
+        return ReadImageBytes(buffer, vfoffset + offset, count);
+    else if (flags & VFLAG_CIA_CONTENT)
+        return ReadCiaContentImageBytes(buffer, vfoffset + offset, count, keyslot, vfoffset);
+    else if (flags & VFLAG_NCCH_CRYPTO)
+        return ReadNcchImageBytes(buffer, vfoffset + offset, count);
+    else return ReadGameImageBytes(buffer, vfoffset + offset, count);
+}
+
 int ReadVGameFile(const VirtualFile* vfile, void* buffer, u64 offset, u64 count) {
     u32 vfoffset = vfile->offset;
     if (vfile->flags & VFLAG_LV3) {
@@ -1105,13 +1344,41 @@ int ReadVGameFile(const VirtualFile* vfile, void* buffer, u64 offset, u64 count)
     } else if (vfile->flags & VFLAG_NITRO) {
         vfoffset = vfile->offset & 0xFFFFFFFF;
     }
-    if (vfile->flags & VFLAG_NO_CRYPTO)
-        return ReadImageBytes(buffer, vfoffset + offset, count);
-    else if (vfile->flags & VFLAG_CIA_CONTENT)
-        return ReadCiaContentImageBytes(buffer, vfoffset + offset, count, vfile->keyslot, vfoffset);
-    else if (vfile->flags & VFLAG_NCCH_CRYPTO)
-        return ReadNcchImageBytes(buffer, vfoffset + offset, count);
-    else return ReadGameImageBytes(buffer, vfoffset + offset, count);
+    return ReadVGameBytes(vfile->flags, vfile->keyslot, vfoffset, buffer, offset, count);
+}
+
+u32 GetVGameLv3Entries(u32* offsets, u32 max_entries, bool dirs) {
+    RomFsLv3NameTable* table = dirs ? &(lv3idx.dirnames) : &(lv3idx.filenames);
+    if ((offset_romfs == (u64) -1) || !lv3idx.names) return 0;
+    if (!offsets) return table->n_entries;
+    if (max_entries < table->n_entries) return 0;
+
+    // dirs in meta order, files in data order
+    if (dirs) {
+        for (u32 i = 0; i < table->n_entries; i++)
+            offsets[i] = table->entries[i].offset_meta;
+    } else if (GetLv3FilesByDataOffset(offsets, &lv3idx) != 0) return 0;
+
+    return table->n_entries;
+}
+
+bool GetVGameLv3Path(char* path, u32 n_chars, u32 offset_meta, bool is_dir) {
+    return (offset_romfs != (u64) -1) && (GetLv3Path(path, n_chars, offset_meta, is_dir, &lv3idx) == 0);
+}
+
+bool GetVGameLv3FileData(u32 offset_meta, u64* offset, u64* size) {
+    if ((offset_romfs == (u64) -1) || (offset_meta + sizeof(RomFsLv3FileMeta) - (256*2) > lv3idx.size_filemeta))
+        return false;
+    RomFsLv3FileMeta* lv3file = LV3_GET_FILE(offset_meta, &lv3idx);
+    *offset = lv3file->offset_data;
+    *size = lv3file->size_data;
+    return true;
+}
+
+int ReadVGameLv3Data(const VirtualDir* vdir, void* buffer, u64 offset, u64 count) {
+    // vdir is any LV3 dir object of the current RomFS, offset is relative to the file data region
+    if ((offset_romfs == (u64) -1) || !(vdir->flags & VFLAG_LV3)) return -1;
+    return ReadVGameBytes(vdir->flags, 0, offset_lv3fd, buffer, offset, count);
 }
 
 bool FindVirtualFileInLv3Dir(VirtualFile* vfile, const VirtualDir* vdir, const char* name) {
@@ -1138,10 +1405,30 @@ bool FindVirtualFileInLv3Dir(VirtualFile* vfile, const VirtualDir* vdir, const c
     return false;
 }
 
+// only true if the NitroFS index is available, otherwise the standard search is used
+bool IsVGameNitroDir(const VirtualDir* vdir) {
+    return (vdir->flags & VFLAG_NITRO) && nitroidx.entries;
+}
+
+bool FindVirtualFileInNitroDir(VirtualFile* vfile, const VirtualDir* vdir, const char* name) {
+    NitroRomIndexEntry* entry = FindNitroRomEntry(name, vdir->offset & 0xFFF, &nitroidx, vgame_fs_buffer);
+    if (!entry || !GetVGameNitroFile(vfile, entry)) return false;
+    vfile->flags |= vdir->flags & VRT_SOURCE;
+    return true;
+}
+
 bool GetVGameLv3Filename(char* name, const VirtualFile* vfile, u32 n_chars) {
     if (!(vfile->flags & VFLAG_LV3))
         return false;
 
+    // UTF-8 name table, if available
+    const char* lv3name = GetLv3Name(vfile->offset, vfile->flags & VFLAG_DIR, &lv3idx);
+    if (lv3name) {
+        memset(name, 0, n_chars);
+        strncpy(name, lv3name, n_chars-1);
+        return true;
+    }
+
     u16* wname = NULL;
     u32 name_len = 0;
 
@@ -1166,24 +1453,7 @@ bool GetVGameNitroFilename(char* name, const VirtualFile* vfile, u32 n_chars) {
     if (!(vfile->flags & VFLAG_NITRO))
         return false;
 
-    u8* fnt_entry = vgame_fs_buffer + (vfile->offset >> 32);
-    u32 name_len = (*fnt_entry) & ~0x80;
-    if (name_len >= n_chars) return false;
-    memset(name, 0, n_chars);
-    memcpy(name, fnt_entry + 1, name_len);
-    for (u32 i = 0; i < name_len; i++)
-        if (name[i] == '%') name[i] = '_';
-
-    // Shift-JIS workaround
-    for (u32 i = 0; i < name_len; i++) {
-        if (name[i] >= 0x80) { // this is a Shift-JIS filename
-            // the sequence below is UTF-8 for "Japanese"
-            snprintf(name, 32, "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e%08lX.sjis", (u32) (vfile->offset >> 32));
-            break;
-        }
-    }
-
-    return true;
+    return (GetNitroRomEntryName(name, vgame_fs_buffer, (u32) (vfile->offset >> 32), n_chars) == 0);
 }
 
 bool GetVGameFilename(char* name, const VirtualFile* vfile, u32 n_chars) {
@@ -13,7 +13,13 @@ bool ReadVGameDir(VirtualFile* vfile, VirtualDir* vdir);
 int ReadVGameFile(const VirtualFile* vfile, void* buffer, u64 offset, u64 count);
 // int WriteVGameFile(const VirtualFile* vfile, const void* buffer, u64 offset, u64 count); // writing is not enabled
 
+u32 GetVGameLv3Entries(u32* offsets, u32 max_entries, bool dirs);
+bool GetVGameLv3Path(char* path, u32 n_chars, u32 offset_meta, bool is_dir);
+bool GetVGameLv3FileData(u32 offset_meta, u64* offset, u64* size);
+int ReadVGameLv3Data(const VirtualDir* vdir, void* buffer, u64 offset, u64 count);
 bool FindVirtualFileInLv3Dir(VirtualFile* vfile, const VirtualDir* vdir, const char* name);
+bool IsVGameNitroDir(const VirtualDir* vdir);
+bool FindVirtualFileInNitroDir(VirtualFile* vfile, const VirtualDir* vdir, const char* name);
 bool GetVGameFilename(char* name, const VirtualFile* vfile, u32 n_chars);
 bool MatchVGameFilename(const char* name, const VirtualFile* vfile, u32 n_chars);
 
@@ -128,7 +128,13 @@ bool GetVirtualFile(VirtualFile* vfile, const char* path, u8 mode) {
     VirtualDir vdir;
     if (!OpenVirtualRoot(&vdir, virtual_src)) return false;
     for (name = strtok(lpath + 3, "/"); name && vdir.flags; name = strtok(NULL, "/")) {
-        if (!(vdir.flags & VFLAG_LV3)) { // standard method
+        if (vdir.flags & VFLAG_LV3) { // use lv3 hashes for quicker search
+            if (!FindVirtualFileInLv3Dir(vfile, &vdir, name))
+                return false;
+        } else if ((vdir.flags & VRT_GAME) && IsVGameNitroDir(&vdir)) { // use the NitroFS index
+            if (!FindVirtualFileInNitroDir(vfile, &vdir, name))
+                return false;
+        } else { // standard method
             while (true) {
                 if (!ReadVirtualDir(vfile, &vdir))
                     return ((mode & FA_WRITE) && (vdir.flags & VRT_BDRI) && GetNewVBDRIFile(vfile, &vdir, path));
@@ -137,9 +143,6 @@ bool GetVirtualFile(VirtualFile* vfile, const char* path, u8 mode) {
                     ((vfile->flags & VRT_VRAM) && MatchVVramFilename(name, vfile)))
                     break; // entry found
             }
-        } else { // use lv3 hashes for quicker search
-            if (!FindVirtualFileInLv3Dir(vfile, &vdir, name))
-                return false;
         }
         if (!OpenVirtualDir(&vdir, vfile))
             vdir.flags = 0;